@@ -8,6 +8,7 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <ArduinoJson.h>
+#include "Lzss.h"   // lib/MQTTBrokerManager del broker (ver platformio.ini)
 
 // Configuración de red
 const char* ssid = "DEPOSITO_BROKER";
@@ -25,6 +26,125 @@ bool connectedToBroker = false;
 unsigned long lastHeartbeat = 0;
 const unsigned long HEARTBEAT_INTERVAL = 30000;
 
+// request_id de los últimos comandos ejecutados: el broker reenvía con "dup":true
+// hasta recibir command_ack y puede tener hasta COMMAND_INFLIGHT_WINDOW (4) en
+// vuelo, así que el ring tiene que cubrir al menos esa ventana
+const size_t EXECUTED_RING_SIZE = 8;
+uint32_t executedRequestIds[EXECUTED_RING_SIZE] = {0};
+size_t executedNext = 0;
+// request_id del comando en curso, se devuelve en la respuesta (0 = sin correlación)
+uint32_t currentRequestId = 0;
+
+// El broker descarta líneas de más de 1024 bytes: lo más largo (p.ej. la lista
+// de huellas con 40x5 slots) se manda en trozos ("type":"chunk") que el broker
+// rearma antes de procesarlo
+const size_t CHUNK_THRESHOLD = 900;     // bytes serializados; menos = una sola línea
+const size_t CHUNK_PIECE_BYTES = 384;   // igual que CHUNK_PIECE_BYTES del broker
+uint32_t nextTransferId = 1;
+
+// MessagePack: se pide en el registro ("encodings") y, si registration_response
+// contesta "encoding":"msgpack", desde ahí las tramas van como 2 bytes de largo
+// (big-endian) + cuerpo MessagePack. El primer byte es <= 4, nunca el de una línea JSON
+const size_t PACKED_MAX_FRAME = 1024;   // igual que MQTT_MAX_FRAME_SIZE del broker
+bool packedFrames = false;
+uint8_t packedBody[PACKED_MAX_FRAME];
+
+// Compresión LZSS: se pide en el registro ("compression") y, si la respuesta trae
+// "compression":"lzss", los mensajes grandes pueden ir como 2 bytes de largo con el
+// bit 0x80 + largo del JSON (2 bytes) + stream LZSS. Los cortos siguen igual
+const size_t COMPRESSION_THRESHOLD = 512;         // igual que COMPRESSION_THRESHOLD_BYTES del broker
+const size_t COMPRESSION_MAX_INFLATED = 8192;     // igual que COMPRESSION_MAX_INFLATED_BYTES
+bool compressedFrames = false;
+Lzss lzss;
+uint8_t compressedFrame[2 + PACKED_MAX_FRAME];
+
+// Print que recibe el JSON serializado y lo manda en trozos de CHUNK_PIECE_BYTES
+// (el mensaje completo nunca se arma en un String)
+class ChunkWriter : public Print {
+public:
+  ChunkWriter(uint32_t transferId, size_t totalLength)
+    : transferId(transferId), totalLength(totalLength), seq(0), used(0) {}
+
+  size_t write(uint8_t c) override {
+    // Cortar sólo donde empieza un carácter: un UTF-8 (nombres con tildes) no queda partido
+    if (used == CHUNK_PIECE_BYTES || (used >= CHUNK_PIECE_BYTES - 3 && (c & 0xC0) != 0x80)) sendPiece();
+    piece[used++] = (char)c;
+    return 1;
+  }
+
+  // Lo que quedó en el buffer
+  void finish() {
+    if (used > 0) sendPiece();
+  }
+
+private:
+  uint32_t transferId;
+  size_t totalLength;
+  uint32_t seq;
+  size_t used;
+  char piece[CHUNK_PIECE_BYTES + 1];
+
+  void sendPiece() {
+    piece[used] = '\0';
+    StaticJsonDocument<256> chunk;
+    chunk["type"] = "chunk";
+    chunk["module_id"] = MODULE_ID.c_str();
+    chunk["transfer_id"] = transferId;
+    chunk["seq"] = seq++;
+    chunk["total_len"] = totalLength;
+    chunk["data"] = (const char*)piece;   // sin copiar al documento
+    serializeJson(chunk, client);
+    client.println();
+    used = 0;
+  }
+};
+
+// Trama LZSS del JSON serializado. false = no achica o no entra en una trama
+bool sendCompressed(const JsonDocument& doc, size_t length) {
+  char* json = (char*)malloc(length + 1);
+  if (!json) return false;
+  serializeJson(doc, json, length + 1);
+  size_t streamLength = lzss.compress((const uint8_t*)json, length, compressedFrame + 4, PACKED_MAX_FRAME - 2);
+  free(json);
+  if (streamLength == 0 || streamLength + 4 >= length + 2) return false;
+  size_t body = streamLength + 2;
+  compressedFrame[0] = (uint8_t)(0x80 | (body >> 8));
+  compressedFrame[1] = (uint8_t)body;
+  compressedFrame[2] = (uint8_t)(length >> 8);
+  compressedFrame[3] = (uint8_t)length;
+  client.write(compressedFrame, body + 2);
+  Serial.println("🗜️ Mensaje de " + String(length) + " bytes enviado comprimido en " + String(body + 2));
+  return true;
+}
+
+// Comprimido si es grande y se negoció; MessagePack si se negoció y entra; si no,
+// una línea JSON o trozos
+void sendJson(const JsonDocument& doc) {
+  size_t length = measureJson(doc);
+  if (compressedFrames && length >= COMPRESSION_THRESHOLD && length <= COMPRESSION_MAX_INFLATED &&
+      sendCompressed(doc, length)) {
+    return;
+  }
+  if (packedFrames) {
+    size_t packedLength = measureMsgPack(doc);
+    if (packedLength <= PACKED_MAX_FRAME) {
+      uint8_t prefix[2] = { (uint8_t)(packedLength >> 8), (uint8_t)packedLength };
+      client.write(prefix, 2);
+      serializeMsgPack(doc, client);
+      return;
+    }
+  }
+  if (length <= CHUNK_THRESHOLD) {
+    serializeJson(doc, client);
+    client.println();
+    return;
+  }
+  ChunkWriter writer(nextTransferId++, length);
+  serializeJson(doc, writer);
+  writer.finish();
+  Serial.println("📦 Mensaje de " + String(length) + " bytes enviado en trozos");
+}
+
 void setup() {
   Serial.begin(115200);
   delay(1000);
@@ -112,6 +232,16 @@ void registerModule() {
   registerMsg["mac_address"] = DEVICE_MAC;
   registerMsg["capabilities"] = "scan,enroll,delete,list";
   registerMsg["timestamp"] = millis();
+  // En orden de preferencia; el broker elige la primera que soporte
+  JsonArray encodings = registerMsg.createNestedArray("encodings");
+  encodings.add("msgpack");
+  encodings.add("json");
+  JsonArray compression = registerMsg.createNestedArray("compression");
+  compression.add("lzss");
+  // Este firmware manda command_ack y no repite un request_id: el broker puede
+  // reenviar con "dup":true. Sin esto cada comando sale una sola vez
+  JsonArray delivery = registerMsg.createNestedArray("delivery");
+  delivery.add("ack");
   
   String registerStr;
   serializeJson(registerMsg, registerStr);
@@ -127,25 +257,69 @@ void sendHeartbeat() {
   heartbeatMsg["module_id"] = MODULE_ID;
   heartbeatMsg["timestamp"] = millis();
   
-  String heartbeatStr;
-  serializeJson(heartbeatMsg, heartbeatStr);
-  
-  client.println(heartbeatStr);
+  sendJson(heartbeatMsg);
   Serial.println("💓 Heartbeat enviado (" + String(millis()) + ")");
 }
 
+// 2 bytes de largo (sin el bit de compresión) y el cuerpo, en packedBody
+bool readPrefixedBody(size_t& length) {
+  uint8_t prefix[2];
+  if (client.readBytes((char*)prefix, 2) != 2) return false;
+  length = ((size_t)(prefix[0] & 0x7F) << 8) | prefix[1];
+  if (length > PACKED_MAX_FRAME || client.readBytes((char*)packedBody, length) != length) {
+    Serial.println("❌ Trama con largo incompleta, se cierra la conexión");
+    client.stop();
+    connectedToBroker = false;
+    return false;
+  }
+  return true;
+}
+
+// Lee la trama siguiente (línea JSON, MessagePack o LZSS con largo) y la parsea en doc.
+// false si no había trama completa o no se pudo leer
+bool readFrame(StaticJsonDocument<1024>& doc, DeserializationError& error) {
+  int lead = client.peek();
+  bool packed = packedFrames && lead >= 0 && lead <= (int)(PACKED_MAX_FRAME >> 8);
+  bool compressed = compressedFrames && lead >= 0x80 && (lead & 0x7F) <= (int)(PACKED_MAX_FRAME >> 8);
+  if (packed) {
+    size_t length;
+    if (!readPrefixedBody(length)) return false;
+    Serial.println("📨 Trama MessagePack recibida (" + String(length) + " bytes)");
+    error = deserializeMsgPack(doc, (const char*)packedBody, length);
+    return true;
+  }
+  if (compressed) {
+    size_t length;
+    if (!readPrefixedBody(length)) return false;
+    size_t inflatedLength = length > 2 ? ((size_t)packedBody[0] << 8) | packedBody[1] : 0;
+    uint8_t* inflated = (inflatedLength > 0 && inflatedLength <= COMPRESSION_MAX_INFLATED)
+                            ? (uint8_t*)malloc(inflatedLength) : nullptr;
+    if (!inflated || !Lzss::expand(packedBody + 2, length - 2, inflated, inflatedLength)) {
+      Serial.println("❌ Trama comprimida inválida, descartada");
+      free(inflated);
+      return false;
+    }
+    Serial.println("📨 Trama comprimida recibida (" + String(length) + " -> " + String(inflatedLength) + " bytes)");
+    error = deserializeJson(doc, (const char*)inflated, inflatedLength);
+    free(inflated);
+    return true;
+  }
+
+  String message = client.readStringUntil('\n');
+  message.trim();
+  if (message.length() == 0) return false;
+  Serial.println("📨 Mensaje recibido:");
+  Serial.println("   " + message);
+  error = deserializeJson(doc, message);
+  return true;
+}
+
 void processMessages() {
   if (client.available()) {
-    String message = client.readStringUntil('\n');
-    message.trim();
+    StaticJsonDocument<1024> doc;
+    DeserializationError error;
     
-    if (message.length() > 0) {
-      Serial.println("📨 Mensaje recibido:");
-      Serial.println("   " + message);
-      
-      StaticJsonDocument<1024> doc;
-      DeserializationError error = deserializeJson(doc, message);
-      
+    if (readFrame(doc, error)) {
       if (error) {
         Serial.println("❌ Error parseando JSON: " + String(error.c_str()));
         return;
@@ -164,6 +338,10 @@ void processMessages() {
         handleCommand(doc);
       } else if (type == "system") {
         handleSystemMessage(doc);
+      } else if (type == "chunk_response") {
+        if (doc["status"] != "success") {
+          Serial.println("⚠️ Broker descartó la transferencia " + String((uint32_t)(doc["transfer_id"] | 0)) + ": " + String((const char*)(doc["error"] | "")));
+        }
       } else {
         Serial.println("❓ Tipo de mensaje no manejado: " + type);
       }
@@ -216,6 +394,11 @@ void handleRegistrationResponse(const StaticJsonDocument<1024>& doc) {
   
   if (status == "success") {
     Serial.println("🎉 ¡Módulo registrado exitosamente!");
+    // Lo que sigue a esta respuesta ya viene en la codificación acordada
+    packedFrames = doc["encoding"] == "msgpack";
+    compressedFrames = doc["compression"] == "lzss";
+    Serial.println(packedFrames ? "📦 Tramas en MessagePack" : "📝 Tramas en JSON");
+    if (compressedFrames) Serial.println("🗜️ Mensajes de " + String(COMPRESSION_THRESHOLD) + " bytes o más, comprimidos");
   } else {
     Serial.println("❌ Error en registro del módulo");
   }
@@ -229,6 +412,13 @@ void handleSystemMessage(const StaticJsonDocument<1024>& doc) {
   }
 }
 
+bool alreadyExecuted(uint32_t requestId) {
+  for (size_t i = 0; i < EXECUTED_RING_SIZE; i++) {
+    if (executedRequestIds[i] == requestId) return true;
+  }
+  return false;
+}
+
 void handleCommand(const StaticJsonDocument<1024>& doc) {
   String command = doc["command"];
   String moduleId = doc["module_id"];
@@ -237,6 +427,18 @@ void handleCommand(const StaticJsonDocument<1024>& doc) {
     Serial.println("📨 Comando para otro módulo: " + moduleId);
     return;
   }
+
+  uint32_t requestId = doc["request_id"] | 0;
+  if (requestId != 0) {
+    sendCommandAck(requestId);
+    if (alreadyExecuted(requestId)) {
+      Serial.println("🔁 Comando repetido (request_id " + String(requestId) + "), ya ejecutado");
+      return;
+    }
+    executedRequestIds[executedNext] = requestId;
+    executedNext = (executedNext + 1) % EXECUTED_RING_SIZE;
+  }
+  currentRequestId = requestId;
   
   Serial.println("⚡ Comando recibido: " + command);
   
@@ -256,6 +458,16 @@ void handleCommand(const StaticJsonDocument<1024>& doc) {
   }
 }
 
+void sendCommandAck(uint32_t requestId) {
+  StaticJsonDocument<128> ack;
+  ack["type"] = "command_ack";
+  ack["module_id"] = MODULE_ID;
+  ack["request_id"] = requestId;
+  String ackStr;
+  serializeJson(ack, ackStr);
+  client.println(ackStr);
+}
+
 void simulateFingerprintScan() {
   Serial.println("👆 Simulando escaneo de huella...");
   
@@ -268,6 +480,7 @@ void simulateFingerprintScan() {
   result["type"] = "fingerprint_scan_result";
   result["module_id"] = MODULE_ID;
   result["success"] = success;
+  result["request_id"] = currentRequestId;
   result["timestamp"] = millis();
   
   if (success) {
@@ -302,6 +515,7 @@ void simulateEnrollment(const String& userName) {
   result["user_name"] = userName;
   result["user_id"] = newUserId;
   result["message"] = "Usuario enrolado exitosamente";
+  result["request_id"] = currentRequestId;
   result["timestamp"] = millis();
   
   String resultStr;
@@ -323,6 +537,7 @@ void simulateUserDeletion(int userId) {
   result["success"] = true;
   result["user_id"] = userId;
   result["message"] = "Usuario eliminado exitosamente";
+  result["request_id"] = currentRequestId;
   result["timestamp"] = millis();
   
   String resultStr;
@@ -336,27 +551,26 @@ void simulateUserDeletion(int userId) {
 void sendFingerprintList() {
   Serial.println("📋 Enviando lista de huellas registradas...");
   
-  StaticJsonDocument<800> list;
+  const int SIMULATED_USERS = 40;   // más de lo que entra en una línea: sale en trozos
+  JsonDocument list;   // ArduinoJson 7: crece según haga falta
   list["type"] = "fingerprint_list";
   list["module_id"] = MODULE_ID;
   
   JsonArray users = list.createNestedArray("users");
   
-  // Simular algunos usuarios registrados
-  for (int i = 1; i <= 5; i++) {
+  // Simular usuarios registrados
+  for (int i = 1; i <= SIMULATED_USERS; i++) {
     JsonObject user = users.createNestedObject();
     user["id"] = i;
     user["name"] = "Usuario" + String(i);
     user["registered_at"] = millis() - (i * 86400000); // Hace i días
   }
   
-  list["total_users"] = 5;
+  list["total_users"] = SIMULATED_USERS;
+  list["request_id"] = currentRequestId;
   list["timestamp"] = millis();
   
-  String listStr;
-  serializeJson(list, listStr);
-  client.println(listStr);
+  sendJson(list);
   
-  Serial.println("📤 Lista enviada con 5 usuarios simulados");
-  Serial.println("   " + listStr);
+  Serial.println("📤 Lista enviada con " + String(SIMULATED_USERS) + " usuarios simulados");
 }
\ No newline at end of file
@@ -40,6 +40,7 @@ bool connectedToBroker = false;
 unsigned long lastHeartbeat = 0;
 unsigned long lastDataSend = 0;
 unsigned long lastReconnectAttempt = 0;
+String sessionToken = "";   // de registration_response; permite reconectar con session_resume
 
 const unsigned long HEARTBEAT_INTERVAL = 30000;  // 30 segundos
 const unsigned long DATA_SEND_INTERVAL = 10000;  // 10 segundos
@@ -134,11 +135,16 @@ void connectToBroker() {
     Serial.println("Conectado al broker!");
     connectedToBroker = true;
     
-    // Registrar módulo
-    registerModule();
-    
-    // Suscribirse a comandos para este módulo
-    subscribeToCommands();
+    if (sessionToken.length() > 0) {
+      // Reconexión: el broker recupera registro, suscripciones y comandos pendientes
+      resumeSession();
+    } else {
+      // Registrar módulo
+      registerModule();
+      
+      // Suscribirse a comandos para este módulo
+      subscribeToCommands();
+    }
     
   } else {
     Serial.println("Error conectando al broker");
@@ -163,6 +169,31 @@ void registerModule() {
   Serial.println(registerStr);
 }
 
+void resumeSession() {
+  JsonDocument resumeMsg;
+  resumeMsg["type"] = "session_resume";
+  resumeMsg["module_id"] = MODULE_ID;
+  resumeMsg["session_token"] = sessionToken;
+  
+  String resumeStr;
+  serializeJson(resumeMsg, resumeStr);
+  client.println(resumeStr);
+  Serial.println("Enviado session_resume");
+}
+
+void handleSessionResponse(JsonDocument& doc) {
+  String status = doc["status"];
+  if (status == "success") {
+    Serial.println("Sesión reanudada");
+    return;
+  }
+  // Sesión vencida o desconocida: registro completo
+  Serial.println("Sesión rechazada, registrando de nuevo");
+  sessionToken = "";
+  registerModule();
+  subscribeToCommands();
+}
+
 void subscribeToCommands() {
   JsonDocument subscribeMsg;
   subscribeMsg["type"] = "subscribe";
@@ -282,6 +313,8 @@ void processMessages() {
       
       if (type == "registration_response") {
         handleRegistrationResponse(doc);
+      } else if (type == "session_response") {
+        handleSessionResponse(doc);
       } else if (type == "heartbeat_ack") {
         handleHeartbeatAck(doc);
       } else if (type == "publish") {
@@ -304,6 +337,7 @@ void handleRegistrationResponse(JsonDocument& doc) {
   
   if (status == "success") {
     digitalWrite(LED_PIN, HIGH);  // LED encendido = registrado
+    sessionToken = doc["session_token"] | "";
   } else {
     digitalWrite(LED_PIN, LOW);   // LED apagado = error
   }
@@ -386,6 +420,7 @@ void sendStatusResponse() {
   JsonDocument statusMsg;
   statusMsg["type"] = "publish";
   statusMsg["topic"] = "deposito/" + MODULE_TYPE + "/status/device";
+  statusMsg["retain"] = true;   // el broker lo entrega a quien se suscriba después
   
   JsonObject payload = statusMsg["payload"];
   payload["module_id"] = MODULE_ID;
@@ -22,13 +22,135 @@ extern const bool ENABLE_STATION_MODE;
 // CONFIGURACIÓN DEL BROKER MQTT
 // =================================
 const int MQTT_PORT = 1883;
-const int MAX_CLIENTS = 10;
+const int MAX_CLIENTS = 10;             // slots reservados; el tope en uso se cambia con setMaxClients()
+const int MQTT_ACCEPTS_PER_PASS = 16;   // conexiones aceptadas (o rechazadas) por pasada del loop
+
+// Buffer de recepción por cliente (ring buffer no bloqueante)
+const int MQTT_RX_BUFFER_SIZE = 1536;   // bytes por slot
+const int MQTT_MAX_FRAME_SIZE = 1024;   // línea JSON / paquete MQTT máximo; más largo se descarta
+const int MQTT_MAX_FRAMES_PER_PASS = 8; // líneas despachadas por cliente en cada loop()
+
+// Límite de tráfico entrante por conexión (token buckets), antes de parsear.
+// Lo que excede se descarta; con RATE_LIMIT_DISCONNECT_ON_FLOOD la conexión se
+// corta tras RATE_LIMIT_DISCONNECT_AFTER descartes seguidos
+const int RATE_LIMIT_MESSAGES_PER_SEC = 20;     // mensajes / paquetes MQTT por segundo
+const int RATE_LIMIT_MESSAGE_BURST = 40;        // ráfaga permitida (p.ej. registro + suscripciones)
+const int RATE_LIMIT_BYTES_PER_SEC = 8192;
+const int RATE_LIMIT_BYTE_BURST = 16384;
+const bool RATE_LIMIT_DISCONNECT_ON_FLOOD = false;
+const int RATE_LIMIT_DISCONNECT_AFTER = 50;
+
+// Detección de protocolo por conexión: primer byte 0x10 = MQTT 3.1.1 binario,
+// cualquier otro = JSON. Un cliente que no envía nada en este tiempo es JSON
+// (los módulos esperan la bienvenida antes de registrarse)
+const unsigned long MQTT_PROTOCOL_DETECT_MS = 300;
+
+// Cola de salida por cliente (escrituras agrupadas, no bloqueantes)
+const int MQTT_TX_QUEUE_MAX_MESSAGES = 32;      // mensajes pendientes por slot
+const int MQTT_TX_QUEUE_MAX_BYTES = 8192;       // bytes pendientes por slot
+const int MQTT_TX_COALESCE_BYTES = 1460;        // máximo por write (~1 MSS TCP)
+const int MQTT_TX_MAX_IOV = 16;                 // tramos por sendmsg (2 por línea JSON: cuerpo + "\r\n")
+const bool MQTT_TX_DISCONNECT_ON_OVERFLOW = false; // false = descartar los más antiguos
+
+// Tarea de E/S del broker (BrokerIo): sockets, framing y colas de salida fuera de
+// loop(). Le pasa tramas completas a loop() y recibe las de salida por rings SPSC
+const bool BROKER_IO_TASK = true;                  // false = los sockets se atienden en loop()
+const int BROKER_IO_INBOUND_DEPTH = 32;            // eventos hacia loop() (potencia de 2); lleno = no se lee más
+const int BROKER_IO_OUTBOUND_DEPTH = 64;           // tramas hacia la tarea (potencia de 2); lleno = se descarta
+const int BROKER_IO_TASK_STACK = 4096;             // bytes
+const int BROKER_IO_TASK_PRIORITY = 2;             // loopTask de Arduino corre en 1
+const unsigned long BROKER_IO_POLL_MS = 20;        // espera máxima de la tarea (accept en ESP32 es por intervalo)
+
+// Codificación MessagePack por conexión: la bienvenida la ofrece, el módulo la
+// pide en module_registration / session_resume ("encodings") y desde la respuesta
+// ambos lados pueden mandar tramas de 2 bytes de largo + MessagePack
+const bool MSGPACK_NEGOTIATION = true;              // false = todos siguen en líneas JSON
+
+// Compresión LZSS por conexión (lib/MQTTBrokerManager/Lzss.h) para las tramas grandes
+// (listas de dispositivos y de huellas): se negocia junto con la codificación
+// ("compression") y lo que no llega al umbral sale sin comprimir, sin sumar latencia
+const bool COMPRESSION_NEGOTIATION = true;         // false = no se ofrece
+const int COMPRESSION_THRESHOLD_BYTES = 512;       // JSON más corto no se comprime
+const int COMPRESSION_MAX_INFLATED_BYTES = 8192;   // mensaje expandido máximo por trama
+
+// Mensajes fragmentados ("type":"chunk"): lo que no entra en MQTT_MAX_FRAME_SIZE
+// (p.ej. fingerprint_list con 40x5 slots) llega en trozos y se rearma por conexión
+const int CHUNK_PIECE_BYTES = 384;                    // texto por trozo (escapado sigue entrando en una trama)
+const int CHUNK_MAX_TRANSFER_BYTES = 8192;            // mensaje rearmado máximo por conexión
+const int CHUNK_MAX_DOC_BYTES = 24576;                // documento JSON para parsearlo; más = se rechaza
+const unsigned long CHUNK_TRANSFER_TIMEOUT_MS = 5000;  // sin trozos nuevos -> se descarta
+
+// Mensajes retenidos (último payload por topic, se entrega al suscribirse)
+const int RETAINED_MAX_BYTES = 16384;           // tope global (topic + payload + overhead); lleno = LRU
+const int RETAINED_ENTRY_OVERHEAD = 32;         // bytes contados por entrada además de topic y payload
+
+// Sesiones de módulos: "session_resume" con el token evita repetir el registro
+const unsigned long SESSION_TTL_MS = 600000;   // 10 min desconectado; después hay que registrarse
+const int SESSION_MAX = 16;                     // sesiones guardadas; llena = sale la más vieja
+
+// Pool de documentos JSON preasignados (evita malloc/free por mensaje)
+const int JSON_POOL_DOCUMENTS = 4;                              // anidamiento máximo sin ir al heap
+const int JSON_POOL_DOC_CAPACITY = MQTT_MAX_FRAME_SIZE + 256;   // bytes por documento
+
+// Logger asíncrono (lib/Logger). El nivel se elige con -DLOG_LEVEL
+const int LOG_QUEUE_DEPTH = 32;      // líneas en el ring buffer (potencia de 2)
+const int LOG_LINE_MAX = 128;        // bytes por línea (se trunca)
+const int LOG_DRAIN_PER_PASS = 8;    // líneas volcadas a Serial por loop()
+
+// Ruteo de comandos: si el DeviceManager ya no conoce el módulo, ¿hacer broadcast?
+// (uno registrado sin slot no: sus comandos esperan en la cola offline)
+const bool COMMAND_BROADCAST_FALLBACK = true;
+
+// Correlación comando -> respuesta (request_id)
+const unsigned long COMMAND_REPLY_TIMEOUT_MS = 10000;  // plazo por defecto (enroll tarda ~3 s)
+const int COMMAND_MAX_PENDING = 32;                     // pedidos abiertos; lleno = vence el más antiguo
+
+// Entrega confirmada de comandos (command_ack + reenvío con "dup":true), sólo para
+// módulos que declaran "delivery": ["ack"] en el registro o ya mandaron un command_ack
+const int COMMAND_INFLIGHT_WINDOW = 4;                 // comandos sin confirmar por módulo
+const int COMMAND_MAX_ATTEMPTS = 4;                    // envíos antes de abandonar
+const unsigned long COMMAND_RETRY_INITIAL_MS = 1000;   // primer reintento; después se duplica
+const unsigned long COMMAND_RETRY_MAX_MS = 8000;
+const unsigned long COMMAND_BUSY_RETRY_MS = 250;       // cola de salida del módulo llena: volver a intentar
+
+// Comandos para módulos sin conexión: esperan en RAM hasta que se vuelvan a registrar
+const unsigned long COMMAND_OFFLINE_TTL_MS = 300000;   // 5 min; después se descartan
+const int COMMAND_OFFLINE_QUEUE_MAX = 8;               // por módulo; lleno = sale el más antiguo
+
+// /api/modules/action con "wait_ms": la respuesta HTTP espera la del módulo
+const unsigned long WEB_ACTION_MAX_WAIT_MS = 30000;  // tope para wait_ms
+const int WEB_MAX_PARKED_REQUESTS = 4;               // conexiones HTTP abiertas a la vez (sockets lwIP)
+
+// Sockets lwIP que no son clientes del broker: listeners MQTT y HTTP, la conexión
+// HTTP en curso, las aparcadas por wait_ms y uno de margen. Los clientes MQTT
+// tienen que entrar en CONFIG_LWIP_MAX_SOCKETS menos esto
+const int LWIP_RESERVED_SOCKETS = 4 + WEB_MAX_PARKED_REQUESTS;
 
 // =================================
 // CONFIGURACIÓN DEL SISTEMA
 // =================================
 const unsigned long HEARTBEAT_INTERVAL = 30000;  // 30 segundos
 const unsigned long HEARTBEAT_TIMEOUT = 60000;   // 60 segundos (2x heartbeat)
+const unsigned long CLIENT_PING_INTERVAL = 15000; // ping keep-alive del broker a cada cliente
+
+// Liberación de slots muertos o lentos (se revisa en cada pasada del broker)
+const unsigned long CLIENT_PONG_TIMEOUT_MS = 5000;   // cliente que contesta pings: sin respuesta -> fuera
+const unsigned long CLIENT_IDLE_TIMEOUT_MS = 75000;  // JSON sin pings: nada recibido (2.5 heartbeats) -> fuera
+const unsigned long CLIENT_TX_STALL_MS = 10000;      // cola de salida sin avanzar -> fuera
+// Keepalive TCP de lwIP: un peer caído (half-open) se detecta en IDLE + INTERVAL * COUNT
+const int TCP_KEEPALIVE_IDLE_S = 10;
+const int TCP_KEEPALIVE_INTERVAL_S = 2;
+const int TCP_KEEPALIVE_COUNT = 3;
+
+// Rueda de temporización (lib/TimerWheel) para pings y vencimiento de heartbeats
+const int TIMER_WHEEL_SLOTS = 128;                // cubetas (potencia de 2)
+const unsigned long TIMER_WHEEL_TICK_MS = 250;    // resolución; una vuelta = 32 s
+
+// Loop de eventos (lib/EventLoop)
+const unsigned long EVENT_LOOP_MAX_WAIT_MS = 1000; // espera máxima en select()
+const unsigned long EVENT_LOOP_POLL_MS = 50;       // accept en ESP32 (WiFiServer sin descriptor)
+const unsigned long EVENT_LOOP_INTERACTIVE_POLL_MS = 10; // web sólo con una conexión HTTP en curso (si no, espera el listener)
+const unsigned long EVENT_LOOP_CONSOLE_POLL_MS = 100;    // consola serie (USB CDC sin descriptor); tecleo humano
 
 // =================================
 // TIPOS DE MÓDULOS PERMITIDOS
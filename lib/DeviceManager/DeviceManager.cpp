@@ -1,10 +1,11 @@
 #include "DeviceManager.h"
 #include "WiFiManager.h"
 #include "MQTTBrokerManager.h"
+#include "../Logger/Logger.h"
 #include <algorithm>
 
 DeviceManager::DeviceManager(WiFiManager* wifiMgr, MQTTBrokerManager* mqttMgr, EEPROMManager* eepromMgr) 
-    : wifiManager(wifiMgr), mqttBrokerManager(mqttMgr), eepromManager(eepromMgr) {
+    : wifiManager(wifiMgr), mqttBrokerManager(mqttMgr), eepromManager(eepromMgr), heartbeatTimers(millis()) {
     // Inicializar variables
     lastRequestedMAC = "";
     lastRequestedDeviceType = "";
@@ -17,7 +18,7 @@ DeviceManager::DeviceManager(WiFiManager* wifiMgr, MQTTBrokerManager* mqttMgr, E
 }
 
 void DeviceManager::initialize() {
-    Serial.println("📱 Inicializando Device Manager...");
+    LOG_I("📱 Inicializando Device Manager...");
     if (eepromManager) {
         eepromManager->begin(); // Inicializa EEPROM si existe
         eepromManager->compactDevices(); // Recompactar en arranque para dejar datos consistentes
@@ -31,8 +32,12 @@ void DeviceManager::initialize() {
     // Cargar dispositivos autorizados
     loadAuthorizedDevices();
     
-    Serial.println("📊 Dispositivos registrados: " + String(authorizedDevices.size()));
-    Serial.println("✅ Device Manager listo");
+    LOG_I("📊 Dispositivos registrados: %d", (int)authorizedDevices.size());
+    LOG_I("✅ Device Manager listo");
+}
+
+JsonDocumentPool* DeviceManager::jsonPool() {
+    return mqttBrokerManager ? &mqttBrokerManager->getJsonPool() : nullptr;
 }
 
 String DeviceManager::addDevice(const String& macAddress, const String& deviceType, const String& description) {
@@ -66,7 +71,7 @@ String DeviceManager::addDevice(const String& macAddress, const String& deviceTy
     // Verificar si el dispositivo ya está conectado (buscarlo en scannedDevices)
     for (auto& scannedDevice : scannedDevices) {
         if (scannedDevice.macAddress == macAddress) {
-            Serial.println("🔄 Dispositivo recién registrado ya está conectado - actualizando estado...");
+            LOG_I("🔄 Dispositivo recién registrado ya está conectado - actualizando estado...");
             
             // Buscar su clientIndex en clientes conectados
             if (mqttBrokerManager) {
@@ -75,13 +80,14 @@ String DeviceManager::addDevice(const String& macAddress, const String& deviceTy
                 if (targetIndex >= 0) {
                     // Send auth_success to the specific client
                     mqttBrokerManager->sendAuthSuccessMessage(targetIndex, macAddress, apiKey);
-                    Serial.println("📤 Notificación de registro enviada al cliente index: " + String(targetIndex));
+                    LOG_I("📤 Notificación de registro enviada al cliente index: %d", targetIndex);
                     // Update authorized device clientIndex as well
                     authorizedDevices[macAddress].clientIndex = targetIndex;
                     
                     // Also send explicit module_credentials payload as a fallback
                     eepromManager->begin();
-                    DynamicJsonDocument creds(256);
+                    JsonDocumentPool::Lease credsLease(jsonPool(), 256);
+                    JsonDocument& creds = *credsLease;
                     creds["type"] = "module_credentials";
                     creds["module_id"] = scannedDevice.moduleId;
                     creds["mac_address"] = macAddress;
@@ -91,10 +97,11 @@ String DeviceManager::addDevice(const String& macAddress, const String& deviceTy
                     String credsStr;
                     serializeJson(creds, credsStr);
                     mqttBrokerManager->sendToClient(targetIndex, credsStr);
-                    Serial.println("📤 module_credentials enviado al cliente index: " + String(targetIndex));
+                    LOG_I("📤 module_credentials enviado al cliente index: %d", targetIndex);
                 } else {
                     // Fallback: broadcast registration_success
-                    DynamicJsonDocument notification(256);
+                    JsonDocumentPool::Lease notificationLease(jsonPool(), 256);
+                    JsonDocument& notification = *notificationLease;
                     notification["type"] = "registration_success";
                     notification["mac_address"] = macAddress;
                     notification["message"] = "Dispositivo registrado exitosamente";
@@ -104,7 +111,7 @@ String DeviceManager::addDevice(const String& macAddress, const String& deviceTy
                     serializeJson(notification, notificationStr);
                     
                     mqttBrokerManager->sendToAllClients(notificationStr);
-                    Serial.println("📤 Notificación de registro enviada a todos los clientes (broadcast)");
+                    LOG_I("📤 Notificación de registro enviada a todos los clientes (broadcast)");
                 }
              }
             
@@ -138,7 +145,7 @@ void DeviceManager::removeDeviceVisual(const String& macAddress) {
     for (auto it = scannedDevices.begin(); it != scannedDevices.end(); ) {
         if (it->macAddress == macAddress) {
             it = scannedDevices.erase(it);
-            Serial.println("[DeviceManager] Dispositivo eliminado visualmente de scannedDevices: " + macAddress);
+            LOG_I("[DeviceManager] Dispositivo eliminado visualmente de scannedDevices: %s", macAddress.c_str());
         } else {
             ++it;
         }
@@ -150,9 +157,9 @@ void DeviceManager::removeDeviceVisual(const String& macAddress) {
         authIt->second.isConnected = false;
         authIt->second.clientIndex = -1;
         authIt->second.currentIP = "";
-        Serial.println("[DeviceManager] Dispositivo marcado como desconectado (visual only): " + macAddress);
+        LOG_I("[DeviceManager] Dispositivo marcado como desconectado (visual only): %s", macAddress.c_str());
     } else {
-        Serial.println("[DeviceManager] removeDeviceVisual: MAC no encontrada en authorizedDevices: " + macAddress);
+        LOG_W("[DeviceManager] removeDeviceVisual: MAC no encontrada en authorizedDevices: %s", macAddress.c_str());
     }
 }
 
@@ -167,30 +174,55 @@ bool DeviceManager::authenticateDevice(const String& macAddress, const String& a
         }
     }
     
-    Serial.println("❌ Autenticación fallida para MAC: " + macAddress);
+    LOG_W("❌ Autenticación fallida para MAC: %s", macAddress.c_str());
     return false;
 }
 
 bool DeviceManager::updateModuleHeartbeat(const String& moduleId) {
-    if (registeredModules.find(moduleId) != registeredModules.end()) {
-        registeredModules[moduleId].lastHeartbeat = millis();
+    auto it = registeredModules.find(moduleId);
+    if (it != registeredModules.end()) {
+        it->second.lastHeartbeat = millis();
+        armHeartbeatTimer(it->second);
         return true;
     }
     return false;
 }
 
+// Programa el vencimiento si el módulo está activo y no tiene uno pendiente
+void DeviceManager::armHeartbeatTimer(ModuleInfo& module) {
+    if (!module.isActive || module.expiryTimer != 0) return;
+    module.expiryTimer = ++timerGeneration;
+    if (module.expiryTimer == 0) module.expiryTimer = ++timerGeneration;
+    heartbeatTimers.schedule(ExpiryTimer{module.moduleId, module.expiryTimer},
+                             module.lastHeartbeat + config.heartbeatInterval * 2);
+}
+
+bool DeviceManager::resumeModule(const String& moduleId, int clientIndex, const String& ip) {
+    auto it = registeredModules.find(moduleId);
+    if (it == registeredModules.end() || !it->second.isAuthenticated) return false;
+    ModuleInfo& module = it->second;
+    if (module.macAddress.length() > 0 && authorizedDevices.find(module.macAddress) == authorizedDevices.end()) {
+        return false;
+    }
+
+    module.isActive = true;
+    module.lastHeartbeat = millis();
+    armHeartbeatTimer(module);
+    if (module.macAddress.length() > 0) markDeviceConnected(module.macAddress, clientIndex, ip);
+    return true;
+}
+
 bool DeviceManager::isModuleRegistered(const String& moduleId) {
     return registeredModules.find(moduleId) != registeredModules.end();
 }
 
 void DeviceManager::setDiscoveryMode(bool mode) {
     config.discoveryMode = mode;
-    Serial.print("Modo discovery: ");
-    Serial.println(config.discoveryMode ? "ON" : "OFF");
+    LOG_I("Modo discovery: %s", config.discoveryMode ? "ON" : "OFF");
 }
 
 void DeviceManager::requestDiscovery() {
-    Serial.println("🔍 DISCOVERY: Buscando dispositivos en la red local...");
+    LOG_I("🔍 DISCOVERY: Buscando dispositivos en la red local...");
     
     // Limpiar información anterior para nueva búsqueda
     lastRequestedMAC = "";
@@ -201,14 +233,14 @@ void DeviceManager::requestDiscovery() {
     macRequestTime = millis();
     
     if (isScanMode) {
-        Serial.println("⏳ Esperando respuesta de TODOS los dispositivos conectados...");
+        LOG_I("⏳ Esperando respuesta de TODOS los dispositivos conectados...");
     } else {
-        Serial.println("⏳ Esperando respuesta de dispositivos NO registrados...");
+        LOG_I("⏳ Esperando respuesta de dispositivos NO registrados...");
     }
 }
 
 void DeviceManager::startScan() {
-    Serial.println("🔍 Iniciando scan de dispositivos...");
+    LOG_I("🔍 Iniciando scan de dispositivos...");
     
     // NO limpiar scannedDevices automáticamente
     // Los dispositivos se mantienen hasta que se desconecten explícitamente
@@ -260,35 +292,30 @@ String DeviceManager::sha256Hash(const String& input) {
 
 void DeviceManager::loadAuthorizedDevices() {
     // Cargar desde EEPROM
-    Serial.println("💾 Cargando dispositivos autorizados desde EEPROM...");
+    LOG_I("💾 Cargando dispositivos autorizados desde EEPROM...");
     authorizedDevices.clear();
     auto eepromDevices = eepromManager->loadDevices();
 
     // Nuevo logging detallado sobre lo que devuelve EEPROM
-    Serial.print("[DeviceManager] eepromManager->loadDevices() returned count: ");
-    Serial.println(eepromDevices.size());
+    LOG_D("[DeviceManager] eepromManager->loadDevices() returned count: %d", (int)eepromDevices.size());
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
     int idx = 0;
     for (const auto& pair : eepromDevices) {
-        Serial.print("  [EEPROM] entry "); Serial.print(idx++);
-        Serial.print(" key='"); Serial.print(pair.first); Serial.print("' ");
-        Serial.print("| mac='"); Serial.print(pair.second.macAddress); Serial.print("'");
-        Serial.print(" | type='"); Serial.print(pair.second.deviceType); Serial.print("'");
-        Serial.print(" | apiKey='"); Serial.print(pair.second.apiKey ? pair.second.apiKey : String("")); Serial.print("'");
-        Serial.print(" | desc='"); Serial.print(pair.second.description); Serial.println("'");
+        LOG_D("  [EEPROM] entry %d key='%s' | mac='%s' | type='%s' | apiKey='%s' | desc='%s'",
+              idx++, pair.first.c_str(), pair.second.macAddress.c_str(), pair.second.deviceType.c_str(),
+              pair.second.apiKey.c_str(), pair.second.description.c_str());
     }
+#endif
 
     int loaded = 0;
     for (const auto& pair : eepromDevices) {
         // Saltar entradas con clave vacía o MAC inválida
         if (pair.first.length() < 5) {
-            Serial.print("[DeviceManager] Skipping entry with short/empty key: '");
-            Serial.print(pair.first);
-            Serial.println("'");
+            LOG_W("[DeviceManager] Skipping entry with short/empty key: '%s'", pair.first.c_str());
             continue;
         }
         if (!eepromManager->isMacValid(pair.second.macAddress)) {
-            Serial.print("[DeviceManager] Skipping entry with invalid MAC: ");
-            Serial.println(pair.second.macAddress);
+            LOG_W("[DeviceManager] Skipping entry with invalid MAC: %s", pair.second.macAddress.c_str());
             continue;
         }
 
@@ -304,33 +331,24 @@ void DeviceManager::loadAuthorizedDevices() {
         dev.currentIP = "";
         authorizedDevices[pair.first] = dev;
 
-        Serial.print("[DeviceManager] Dispositivo cargado: ");
-        Serial.print(dev.macAddress);
-        Serial.print(" tipo: ");
-        Serial.print(dev.deviceType);
-        Serial.print(" apiKey: ");
-        Serial.print(dev.apiKey);
-        Serial.print(" desc: ");
-        Serial.println(dev.description);
+        LOG_D("[DeviceManager] Dispositivo cargado: %s tipo: %s apiKey: %s desc: %s",
+              dev.macAddress.c_str(), dev.deviceType.c_str(), dev.apiKey.c_str(), dev.description.c_str());
         loaded++;
     }
 
-    Serial.print("[DeviceManager] loadAuthorizedDevices -> loaded: ");
-    Serial.print(loaded);
-    Serial.print(" entries, authorizedDevices.size(): ");
-    Serial.println(authorizedDevices.size());
+    LOG_D("[DeviceManager] loadAuthorizedDevices -> loaded: %d entries, authorizedDevices.size(): %d",
+          loaded, (int)authorizedDevices.size());
 
     if (loaded == 0) {
-        Serial.println("📱 Sistema de dispositivos autorizados inicializado (vacío)");
+        LOG_I("📱 Sistema de dispositivos autorizados inicializado (vacío)");
     } else {
-        Serial.print("📱 Dispositivos autorizados cargados desde EEPROM: ");
-        Serial.println(loaded);
+        LOG_I("📱 Dispositivos autorizados cargados desde EEPROM: %d", loaded);
     }
 }
 
 void DeviceManager::saveAuthorizedDevices() {
     // Guardar en EEPROM
-    Serial.println("💾 Guardando dispositivos autorizados en EEPROM...");
+    LOG_I("💾 Guardando dispositivos autorizados en EEPROM...");
     std::map<String, DeviceRecord> eepromDevices;
     for (const auto& pair : authorizedDevices) {
         DeviceRecord rec;
@@ -341,8 +359,7 @@ void DeviceManager::saveAuthorizedDevices() {
         eepromDevices[pair.first] = rec;
     }
     eepromManager->saveDevices(eepromDevices);
-    Serial.print("💾 Dispositivos autorizados guardados en EEPROM: ");
-    Serial.println(eepromDevices.size());
+    LOG_I("💾 Dispositivos autorizados guardados en EEPROM: %d", (int)eepromDevices.size());
 }
 
 // Handlers de mensajes
@@ -351,7 +368,7 @@ void DeviceManager::handleMACResponse(int clientIndex, JsonDocument& doc) {
     String macAddress = doc["mac_address"] | "";
     String deviceType = doc["device_type"] | "";
     
-    Serial.println("📡 Respuesta MAC recibida: " + macAddress + " (Tipo: " + deviceType + ") - ModuleID: " + moduleId);
+    LOG_I("📡 Respuesta MAC recibida: %s (Tipo: %s) - ModuleID: %s", macAddress.c_str(), deviceType.c_str(), moduleId.c_str());
     
     // Mapear tipos de dispositivo para compatibilidad con web
     String webDeviceType = deviceType;
@@ -369,7 +386,7 @@ void DeviceManager::handleMACResponse(int clientIndex, JsonDocument& doc) {
     
     if (isAlreadyRegistered) {
         // Dispositivo ya autorizado - conectar y actualizar estado
-        Serial.println("✅ MAC " + macAddress + " (" + deviceType + ") YA está registrada - conectando automáticamente");
+        LOG_I("✅ MAC %s (%s) YA está registrada - conectando automáticamente", macAddress.c_str(), deviceType.c_str());
         
         AuthorizedDevice& device = authorizedDevices[macAddress];
         device.isConnected = true;
@@ -380,7 +397,7 @@ void DeviceManager::handleMACResponse(int clientIndex, JsonDocument& doc) {
         if (mqttBrokerManager) {
             String ip = mqttBrokerManager->getClientIP(clientIndex);
             device.currentIP = ip;
-            Serial.println("📌 Actualizado currentIP para " + macAddress + " -> " + ip);
+            LOG_I("📌 Actualizado currentIP para %s -> %s", macAddress.c_str(), ip.c_str());
         }
         
         // Enviar mensaje de autenticación exitosa al dispositivo registrado
@@ -403,7 +420,8 @@ void DeviceManager::handleMACResponse(int clientIndex, JsonDocument& doc) {
                 mi.macAddress       = macAddress;
                 
                 registeredModules[moduleId] = mi;
-                Serial.println("✅ AUTO-REGISTER: módulo agregado por MAC response -> " + moduleId);
+                armHeartbeatTimer(registeredModules[moduleId]);
+                LOG_I("✅ AUTO-REGISTER: módulo agregado por MAC response -> %s", moduleId.c_str());
             } else {
                 // Refrescar estado del módulo existente
                 ModuleInfo& mi = it->second;
@@ -412,15 +430,16 @@ void DeviceManager::handleMACResponse(int clientIndex, JsonDocument& doc) {
                 mi.isActive        = true;
                 mi.isAuthenticated = true;
                 mi.macAddress      = macAddress;    // asegura vínculo MAC<->módulo
-                Serial.println("🔄 AUTO-REGISTER: módulo ya existía; estado refrescado -> " + moduleId);
+                armHeartbeatTimer(mi);
+                LOG_I("🔄 AUTO-REGISTER: módulo ya existía; estado refrescado -> %s", moduleId.c_str());
             }
         } else {
-            Serial.println("⚠️ AUTO-REGISTER omitido: module_id vacío en MAC response");
+            LOG_W("⚠️ AUTO-REGISTER omitido: module_id vacío en MAC response");
         }
 
     } else {
         // Dispositivo nuevo - disponible para registro manual
-        Serial.println("✅ MAC " + macAddress + " (" + deviceType + ") NO está registrada - disponible para registro");
+        LOG_I("✅ MAC %s (%s) NO está registrada - disponible para registro", macAddress.c_str(), deviceType.c_str());
         lastRequestedMAC        = macAddress;
         lastRequestedDeviceType = webDeviceType;
         macRequestTime          = millis();
@@ -433,7 +452,7 @@ void DeviceManager::handleDeviceInfoResponse(int clientIndex, JsonDocument& doc)
     String macAddress = doc["mac_address"];
     String deviceType = doc["device_type"];
     
-    Serial.println("📡 Respuesta de info de dispositivo: " + macAddress + " (Tipo: " + deviceType + ") - ModuleID: " + moduleId);
+    LOG_I("📡 Respuesta de info de dispositivo: %s (Tipo: %s) - ModuleID: %s", macAddress.c_str(), deviceType.c_str(), moduleId.c_str());
     
     // Mapear tipos de dispositivo
     String webDeviceType = deviceType;
@@ -462,7 +481,7 @@ void DeviceManager::handleDeviceScanResponse(int clientIndex, JsonDocument& doc)
     String macAddress = doc["mac_address"];
     String deviceType = doc["device_type"];
     
-    Serial.println("📡 Respuesta de scan recibida: " + macAddress + " (" + deviceType + ") - ID: " + moduleId);
+    LOG_I("📡 Respuesta de scan recibida: %s (%s) - ID: %s", macAddress.c_str(), deviceType.c_str(), moduleId.c_str());
     
     // Mapear tipos de dispositivo
     String webDeviceType = deviceType;
@@ -501,7 +520,7 @@ void DeviceManager::addToScannedDevices(const String& macAddress, const String&
         newDevice.clientIndex = clientIndex;
         
         scannedDevices.push_back(newDevice);
-        Serial.println("✅ Dispositivo agregado a lista de scan: " + macAddress + " (" + deviceType + ") moduleId=" + moduleId + " clientIndex=" + String(clientIndex));
+        LOG_I("✅ Dispositivo agregado a lista de scan: %s (%s) moduleId=%s clientIndex=%d", macAddress.c_str(), deviceType.c_str(), moduleId.c_str(), clientIndex);
     }
 }
 
@@ -514,31 +533,20 @@ void DeviceManager::reportScannedDevice(const String& macAddress, const String&
 // Métodos JSON
 String DeviceManager::getDevicesJSON() {
     // DEBUG: mostrar el estado interno antes de construir el JSON
-    Serial.print("[DeviceManager] getDevicesJSON - authorizedDevices size: ");
-    Serial.println(authorizedDevices.size());
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    LOG_D("[DeviceManager] getDevicesJSON - authorizedDevices size: %d", (int)authorizedDevices.size());
     for (const auto &pair : authorizedDevices) {
-        Serial.print("  - key: ");
-        Serial.print(pair.first);
-        Serial.print(" | mac: ");
-        Serial.print(pair.second.macAddress);
-        Serial.print(" | type: ");
-        Serial.print(pair.second.deviceType);
-        Serial.print(" | isActive: ");
-        Serial.print(pair.second.isActive ? "YES" : "NO");
-        Serial.print(" | isConnected: ");
-        Serial.print(pair.second.isConnected ? "YES" : "NO");
-        Serial.print(" | clientIndex: ");
-        Serial.println(pair.second.clientIndex);
+        LOG_D("  - key: %s | mac: %s | type: %s | isActive: %s | isConnected: %s | clientIndex: %d",
+              pair.first.c_str(), pair.second.macAddress.c_str(), pair.second.deviceType.c_str(),
+              pair.second.isActive ? "YES" : "NO", pair.second.isConnected ? "YES" : "NO",
+              pair.second.clientIndex);
     }
     // También loguear scannedDevices para ver si hay entradas que coincidan
-    Serial.print("[DeviceManager] scannedDevices size: ");
-    Serial.println(scannedDevices.size());
+    LOG_D("[DeviceManager] scannedDevices size: %d", (int)scannedDevices.size());
     for (const auto &sd : scannedDevices) {
-        Serial.print("  - scanned mac: ");
-        Serial.print(sd.macAddress);
-        Serial.print(" | moduleId: ");
-        Serial.println(sd.moduleId);
+        LOG_D("  - scanned mac: %s | moduleId: %s", sd.macAddress.c_str(), sd.moduleId.c_str());
     }
+#endif
 
     // Construir JSON con capacidad suficiente
     DynamicJsonDocument response(2048);
@@ -564,8 +572,7 @@ String DeviceManager::getDevicesJSON() {
     serializeJson(response, responseStr);
 
     // DEBUG: mostrar JSON generado en consola
-    Serial.print("[DeviceManager] getDevicesJSON response: ");
-    Serial.println(responseStr);
+    LOG_D("[DeviceManager] getDevicesJSON response: %s", responseStr.c_str());
 
     return responseStr;
 }
@@ -579,8 +586,7 @@ String DeviceManager::getModulesJSON() {
     DynamicJsonDocument response(cap);
     JsonArray modulesArray = response.createNestedArray("modules");
 
-    Serial.print("[DeviceManager] registeredModules size: ");
-    Serial.println(registeredModules.size());
+    LOG_D("[DeviceManager] registeredModules size: %d", (int)registeredModules.size());
 
     for (auto& pair : registeredModules) {
         ModuleInfo& module = pair.second;
@@ -596,14 +602,14 @@ String DeviceManager::getModulesJSON() {
 
     String responseStr;
     serializeJson(response, responseStr);
-    Serial.print("[DeviceManager] getModulesJSON response: ");
-    Serial.println(responseStr);
+    LOG_D("[DeviceManager] getModulesJSON response: %s", responseStr.c_str());
     return responseStr;
 }
 
 
 String DeviceManager::getStatsJSON() {
-    DynamicJsonDocument response(512);
+    JsonDocumentPool::Lease responseLease(jsonPool(), 512);
+    JsonDocument& response = *responseLease;
     
     response["registered_devices"] = authorizedDevices.size();
     
@@ -611,25 +617,22 @@ String DeviceManager::getStatsJSON() {
      int connectedDevices = 0;
      unsigned long now = millis();
      
-     Serial.println("📊 DEBUG: Revisando dispositivos conectados:");
+     LOG_D("📊 DEBUG: Revisando dispositivos conectados:");
      for (auto& pair : authorizedDevices) {
          AuthorizedDevice& device = pair.second;
          unsigned long timeSince = (now - device.lastSeen);
          
-         Serial.println("  - MAC: " + device.macAddress + 
-                       " | isConnected: " + String(device.isConnected ? "YES" : "NO") +
-                       " | isActive: " + String(device.isActive ? "YES" : "NO") +
-                       " | lastSeen: " + String(timeSince) + "ms ago" +
-                       " | clientIndex: " + String(device.clientIndex));
+         LOG_D("  - MAC: %s | isConnected: %s | isActive: %s | lastSeen: %lums ago | clientIndex: %d",
+               device.macAddress.c_str(), device.isConnected ? "YES" : "NO",
+               device.isActive ? "YES" : "NO", timeSince, device.clientIndex);
         
         // Usar isConnected flag y verificar que lastSeen no sea muy antiguo
         if (device.isConnected && device.isActive && timeSince < 300000) { // 5 minutos
             connectedDevices++;
-            Serial.println("    ✅ CONTADO como conectado");
+            LOG_D("    ✅ CONTADO como conectado");
         } else {
-            Serial.println("    ❌ NO contado - razón: " + 
-                          String(!device.isConnected ? "no conectado" : 
-                                !device.isActive ? "no activo" : "muy antiguo"));
+            LOG_D("    ❌ NO contado - razón: %s",
+                  !device.isConnected ? "no conectado" : !device.isActive ? "no activo" : "muy antiguo");
         }
     }
     
@@ -647,10 +650,12 @@ String DeviceManager::getScanResultsJSON() {
     JsonArray devices = response.createNestedArray("devices");
 
     // Debug: mostrar cuántos dispositivos hay en scannedDevices
-    Serial.println("📁 getScanResultsJSON - scannedDevices size: " + String(scannedDevices.size()));
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    LOG_D("📁 getScanResultsJSON - scannedDevices size: %d", (int)scannedDevices.size());
     for (const auto &d : scannedDevices) {
-        Serial.println("   - scanned device: " + d.macAddress + " (" + d.deviceType + ") moduleId=" + d.moduleId);
+        LOG_D("   - scanned device: %s (%s) moduleId=%s", d.macAddress.c_str(), d.deviceType.c_str(), d.moduleId.c_str());
     }
+#endif
     
     // Desactivar modo scan
     if (isScanMode) {
@@ -677,7 +682,8 @@ String DeviceManager::getScanResultsJSON() {
 }
 
 String DeviceManager::getLastMacJSON() {
-    DynamicJsonDocument response(256);
+    JsonDocumentPool::Lease responseLease(jsonPool(), 256);
+    JsonDocument& response = *responseLease;
     
     // Verificar si la información es reciente (últimos 30 segundos)
     if (lastRequestedMAC != "" && (millis() - macRequestTime) < 30000) {
@@ -726,19 +732,20 @@ String DeviceManager::getUnregisteredDevicesJSON() {
 }
 
 // Métodos adicionales necesarios
-void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc, WiFiClient* client) {
+void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc, const String& clientIp) {
     String moduleId = doc["module_id"];
     String moduleType = doc["module_type"];
     String capabilities = doc["capabilities"];
     String macAddress = doc["mac_address"];
     String apiKey = doc["api_key"];
     
-    Serial.println("📱 Registro de módulo: " + moduleType);
-    Serial.println("   MAC: " + macAddress);
-    Serial.println("   ModuleID: " + moduleId);
-    Serial.println("   ApiKey: " + (apiKey.length() > 0 ? apiKey.substring(0, 8) + "..." : "VACÍO"));
+    LOG_I("📱 Registro de módulo: %s", moduleType.c_str());
+    LOG_D("   MAC: %s", macAddress.c_str());
+    LOG_D("   ModuleID: %s", moduleId.c_str());
+    LOG_D("   ApiKey: %s", apiKey.length() > 0 ? (apiKey.substring(0, 8) + "...").c_str() : "VACÍO");
     
-    DynamicJsonDocument response(512);
+    JsonDocumentPool::Lease responseLease(jsonPool(), 512);
+    JsonDocument& response = *responseLease;
      response["type"] = "registration_response";
      response["response_type"] = "module";
      response["module_id"] = moduleId;
@@ -746,12 +753,12 @@ void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc,
     // Verificar autenticación
     bool isAuthenticated = authenticateDevice(macAddress, apiKey);
     
-    Serial.println("   🔐 Autenticación: " + String(isAuthenticated ? "EXITOSA" : "FALLIDA"));
+    LOG_I("   🔐 Autenticación: %s", isAuthenticated ? "EXITOSA" : "FALLIDA");
 
     // If not authenticated but the MAC is already authorized, accept the registration
     // regardless of whether the client sent the correct apiKey
     if (!isAuthenticated && authorizedDevices.find(macAddress) != authorizedDevices.end()) {
-        Serial.println("🔁 MAC ya autorizada - forzando autenticación exitosa");
+        LOG_I("🔁 MAC ya autorizada - forzando autenticación exitosa");
         // Use the server-side apiKey for this device
         apiKey = authorizedDevices[macAddress].apiKey;
         isAuthenticated = true;
@@ -763,8 +770,8 @@ void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc,
     }
 
     if (!isAuthenticated) {
-        Serial.println("❌ Dispositivo no autorizado - MAC: " + macAddress);
-        Serial.println("   Enviando registration_response con error...");
+        LOG_W("❌ Dispositivo no autorizado - MAC: %s", macAddress.c_str());
+        LOG_D("   Enviando registration_response con error...");
         response["status"] = "error";
         response["message"] = "Dispositivo no autorizado. Debe registrarse manualmente desde el panel de administración.";
     } else {
@@ -789,23 +796,34 @@ void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc,
             moduleInfo.macAddress = macAddress;
             
             registeredModules[moduleId] = moduleInfo;
+            armHeartbeatTimer(registeredModules[moduleId]);
             
             // Actualizar IP y estado del dispositivo autorizado
             if (authorizedDevices.find(macAddress) != authorizedDevices.end()) {
-                authorizedDevices[macAddress].currentIP = client->remoteIP().toString();
+                authorizedDevices[macAddress].currentIP = clientIp;
                 authorizedDevices[macAddress].lastSeen = millis();
                 authorizedDevices[macAddress].isConnected = true;   // <-- asegurar marcado como conectado
                 authorizedDevices[macAddress].clientIndex = clientIndex; // <-- asignar clientIndex
-                Serial.println("📌 Actualizado authorizedDevice: isConnected=YES clientIndex=" + String(clientIndex) + " IP=" + authorizedDevices[macAddress].currentIP);
+                LOG_I("📌 Actualizado authorizedDevice: isConnected=YES clientIndex=%d IP=%s", clientIndex, authorizedDevices[macAddress].currentIP.c_str());
             } else {
                 // No estaba autorizado previamente: solo log
-                Serial.println("📌 Registro de módulo para MAC no autorizada (no en authorizedDevices): " + macAddress);
+                LOG_W("📌 Registro de módulo para MAC no autorizada (no en authorizedDevices): %s", macAddress.c_str());
             }
             
             response["status"] = "success";
             response["message"] = "Módulo registrado y autenticado exitosamente";
+            // Token para volver con session_resume tras un corte
+            if (mqttBrokerManager) {
+                response["session_token"] = mqttBrokerManager->openSession(moduleId, macAddress);
+                response["session_ttl_ms"] = SESSION_TTL_MS;
+                // "msgpack" / "lzss" si el módulo los pidió; rigen desde la trama siguiente a esta respuesta
+                response["encoding"] = mqttBrokerManager->offerEncoding(clientIndex, doc["encodings"]);
+                response["compression"] = mqttBrokerManager->offerCompression(clientIndex, doc["compression"]);
+                // Sin "delivery": ["ack"] los comandos salen una sola vez (firmware sin command_ack)
+                response["delivery"] = mqttBrokerManager->offerDelivery(moduleId, doc["delivery"]);
+            }
             
-            Serial.println("✅ Módulo " + moduleId + " registrado y autenticado");
+            LOG_I("✅ Módulo %s registrado y autenticado", moduleId.c_str());
         } else {
             response["status"] = "error";
             response["message"] = "Tipo de módulo no permitido";
@@ -816,38 +834,56 @@ void DeviceManager::handleModuleRegistration(int clientIndex, JsonDocument& doc,
     
     String responseStr;
     serializeJson(response, responseStr);
-    client->println(responseStr);
+    // El socket es de la tarea de E/S del broker: la respuesta sale por su cola
+    if (mqttBrokerManager) {
+        mqttBrokerManager->sendToClient(clientIndex, responseStr);
+    } else {
+        LOG_W("⚠️ Sin broker para responder el registro del cliente %d", clientIndex);
+    }
 }
 
 void DeviceManager::handleDeviceRegistration(int clientIndex, JsonDocument& doc) {
     // Este método maneja el registro automático de dispositivos con código de verificación
     // Por simplicidad, lo mantenemos básico por ahora
-    Serial.println("📱 Solicitud de registro de dispositivo recibida");
+    LOG_I("📱 Solicitud de registro de dispositivo recibida");
 }
 
 void DeviceManager::checkModuleHeartbeats(WiFiClient* clients, bool* clientConnected) {
     unsigned long currentTime = millis();
-    
-    for (auto& pair : registeredModules) {
-        if (pair.second.isActive) {
-            unsigned long timeSinceHeartbeat = currentTime - pair.second.lastHeartbeat;
-            
-            if (timeSinceHeartbeat > config.heartbeatInterval * 2) {
-                // Módulo no responde
-                pair.second.isActive = false;
-                Serial.println("Módulo " + pair.second.moduleId + " marcado como inactivo (sin heartbeat)");
-                
-                // Además marcar el dispositivo autorizado asociado como desconectado
-                String mac = pair.second.macAddress;
-                if (mac.length() > 0 && authorizedDevices.find(mac) != authorizedDevices.end()) {
-                    authorizedDevices[mac].isConnected = false;
-                    authorizedDevices[mac].clientIndex = -1;
-                    authorizedDevices[mac].currentIP = "";
-                    Serial.println("📌 AuthorizedDevice " + mac + " marcado como desconectado por heartbeat");
-                }
-            }
+
+    // Sólo los eventos vencidos desde la última pasada (no se recorre registeredModules)
+    if (heartbeatTimers.advance(currentTime, expiredHeartbeats) == 0) return;
+
+    for (const auto& timer : expiredHeartbeats) {
+        auto it = registeredModules.find(timer.key.moduleId);
+        // Módulo eliminado o re-registrado: evento obsoleto
+        if (it == registeredModules.end() || it->second.expiryTimer != timer.key.generation) continue;
+
+        ModuleInfo& module = it->second;
+        module.expiryTimer = 0;
+        if (!module.isActive) continue;
+
+        unsigned long timeSinceHeartbeat = currentTime - module.lastHeartbeat;
+        if (timeSinceHeartbeat <= config.heartbeatInterval * 2) {
+            // Hubo heartbeats desde que se programó: reprogramar al nuevo plazo
+            armHeartbeatTimer(module);
+            continue;
+        }
+
+        // Módulo no responde
+        module.isActive = false;
+        LOG_I("Módulo %s marcado como inactivo (sin heartbeat)", module.moduleId.c_str());
+
+        // Además marcar el dispositivo autorizado asociado como desconectado
+        String mac = module.macAddress;
+        if (mac.length() > 0 && authorizedDevices.find(mac) != authorizedDevices.end()) {
+            authorizedDevices[mac].isConnected = false;
+            authorizedDevices[mac].clientIndex = -1;
+            authorizedDevices[mac].currentIP = "";
+            LOG_I("📌 AuthorizedDevice %s marcado como desconectado por heartbeat", mac.c_str());
         }
     }
+    expiredHeartbeats.clear();
 }
 
 int DeviceManager::getConnectedClientsCount() {
@@ -858,11 +894,27 @@ int DeviceManager::getConnectedClientsCount() {
     return 0;
 }
 
+void DeviceManager::registerEvents(EventLoop& loop) {
+    loop.addSource("devices",
+        [this](EventLoop& l) {
+            // La consola serie (USB CDC / stdin) no tiene descriptor fiable: consultar por intervalo
+            l.wakeAfter(EVENT_LOOP_CONSOLE_POLL_MS);
+            unsigned long due;
+            if (heartbeatTimers.nextDeadline(due)) l.wakeAt(due);
+        },
+        [this]() {
+            checkModuleHeartbeats(nullptr, nullptr);
+            processSystemCommands();
+        });
+}
+
 void DeviceManager::processSystemCommands() {
     // Procesar comandos serie para configuración
     if (Serial.available()) {
         String command = Serial.readStringUntil('\n');
         command.trim();
+        // Volcar los logs pendientes antes de la salida interactiva
+        Logger::flush();
         // Si el comando empieza con 'server:', lo quitamos
         if (command.startsWith("server:")) {
             command = command.substring(7);
@@ -885,6 +937,7 @@ void DeviceManager::processSystemCommands() {
             Serial.println("write_eeprom <num> - Escribe <num> en EEPROM pos 1");
             Serial.println("read_eeprom         - Lee EEPROM pos 1");
             Serial.println("compact_eeprom      - Recompacta EEPROM (reescribe y limpia slots)");
+            Serial.println("max_clients <n>     - Tope de clientes del broker (sin reiniciar)");
         } else if (command.startsWith("write_eeprom")) {
             int spaceIdx = command.indexOf(' ');
             if (spaceIdx > 0) {
@@ -899,6 +952,21 @@ void DeviceManager::processSystemCommands() {
             if (eepromManager) {
                 eepromManager->compactDevices();
             }
+        } else if (command.startsWith("max_clients")) {
+            int spaceIdx = command.indexOf(' ');
+            if (spaceIdx > 0 && mqttBrokerManager) {
+                int limit = command.substring(spaceIdx + 1).toInt();
+                if (!mqttBrokerManager->setMaxClients(limit)) {
+                    Serial.print("Valor inválido: 1..");
+                    Serial.print(MAX_CLIENTS);
+                    Serial.print(" y hasta ");
+                    Serial.print(MQTTBrokerManager::clientSocketBudget());
+                    Serial.println(" por sockets lwIP");
+                }
+            } else if (mqttBrokerManager) {
+                Serial.print("max_clients = ");
+                Serial.println(mqttBrokerManager->getMaxClients());
+            }
         }
     }
 }
@@ -944,13 +1012,14 @@ bool DeviceManager::deregisterModule(const String& moduleId) {
     if (it != registeredModules.end()) {
         String mac = it->second.macAddress;
         registeredModules.erase(it);
-        Serial.println("🗑️ Módulo eliminado: " + moduleId);
+        if (mqttBrokerManager) mqttBrokerManager->closeSession(moduleId);
+        LOG_I("🗑️ Módulo eliminado: %s", moduleId.c_str());
 
         // Si el módulo estaba asociado a un dispositivo autorizado, eliminar ese dispositivo
         if (mac.length() > 0 && authorizedDevices.find(mac) != authorizedDevices.end()) {
             authorizedDevices.erase(mac);
             saveAuthorizedDevices(); // Persistir cambio en EEPROM
-            Serial.println("🗑️ AuthorizedDevice eliminado (persistente): " + mac);
+            LOG_I("🗑️ AuthorizedDevice eliminado (persistente): %s", mac.c_str());
         }
         return true;
     }
@@ -958,12 +1027,15 @@ bool DeviceManager::deregisterModule(const String& moduleId) {
     // Si no existe como módulo, intentar eliminar como MAC (fallback)
     if (authorizedDevices.find(moduleId) != authorizedDevices.end()) {
         bool ok = removeDevice(moduleId); // ya persiste en EEPROM
-        Serial.println(ok ? "🗑️ MAC tratada como dispositivo y eliminada: " + moduleId
-                          : "❌ Error eliminando dispositivo por MAC: " + moduleId);
+        if (ok) {
+            LOG_I("🗑️ MAC tratada como dispositivo y eliminada: %s", moduleId.c_str());
+        } else {
+            LOG_W("❌ Error eliminando dispositivo por MAC: %s", moduleId.c_str());
+        }
         return ok;
     }
 
-    Serial.println("❌ No se encontró módulo o dispositivo para eliminar: " + moduleId);
+    LOG_W("❌ No se encontró módulo o dispositivo para eliminar: %s", moduleId.c_str());
     return false;
 }
 
@@ -1031,12 +1103,12 @@ String DeviceManager::getDebugJSON() {
     response["authorized_count"] = (int)authorizedDevices.size();
     response["registered_modules_count"] = (int)registeredModules.size();
     response["scanned_count"] = (int)scannedDevices.size();
+    response["heartbeat_timers"] = (int)heartbeatTimers.size();
     response["success"] = true;
 
     String out;
     serializeJson(response, out);
-    Serial.print("[DeviceManager] getDebugJSON response: ");
-    Serial.println(out);
+    LOG_D("[DeviceManager] getDebugJSON response: %s", out.c_str());
     return out;
 }
 
@@ -1062,9 +1134,9 @@ void DeviceManager::markDeviceConnected(const String& macAddress, int clientInde
         it->second.clientIndex = clientIndex;
         it->second.currentIP = ip;
         it->second.lastSeen = millis();
-        Serial.println("[DeviceManager] markDeviceConnected -> MAC: " + macAddress + " clientIndex: " + String(clientIndex) + " IP: " + ip);
+        LOG_D("[DeviceManager] markDeviceConnected -> MAC: %s clientIndex: %d IP: %s", macAddress.c_str(), clientIndex, ip.c_str());
     } else {
-        Serial.println("[DeviceManager] markDeviceConnected: MAC no encontrada en authorizedDevices: " + macAddress);
+        LOG_D("[DeviceManager] markDeviceConnected: MAC no encontrada en authorizedDevices: %s", macAddress.c_str());
     }
 }
 
@@ -11,6 +11,9 @@
 
 // Forward declarations
 #include "../EEPROMManager/EEPROMManager.h"
+#include "../MQTTBrokerManager/JsonDocumentPool.h"
+#include "../TimerWheel/TimerWheel.h"
+#include "../EventLoop/EventLoop.h"
 class WiFiManager;
 class MQTTBrokerManager;
 
@@ -23,6 +26,7 @@ struct ModuleInfo {
     bool isActive;
     bool isAuthenticated;
     String macAddress;
+    uint32_t expiryTimer = 0;   // generación del evento de vencimiento pendiente (0 = ninguno)
 };
 
 struct AuthorizedDevice {
@@ -59,6 +63,8 @@ class DeviceManager {
     void initialize();
     void printStatus();
     void processSystemCommands();
+    // Consola serie y vencimiento de heartbeats como fuente del loop de eventos
+    void registerEvents(EventLoop& loop);
 
     // Gestión de dispositivos
     String addDevice(const String& macAddress, const String& deviceType, const String& description);
@@ -73,6 +79,9 @@ class DeviceManager {
     bool isModuleRegistered(const String& moduleId);
     void checkModuleHeartbeats(WiFiClient* clients, bool* clientConnected);
     bool deregisterModule(const String& moduleId);
+    // Reconexión por session_resume: reactivar sin repetir autenticación. false si
+    // el módulo o su MAC ya no están dados de alta
+    bool resumeModule(const String& moduleId, int clientIndex, const String& ip);
 
     // Discovery y scan
     void requestDiscovery();
@@ -84,7 +93,7 @@ class DeviceManager {
     void handleDeviceInfoResponse(int clientIndex, JsonDocument& doc);
     void handleDeviceScanResponse(int clientIndex, JsonDocument& doc);
     void handleDeviceRegistration(int clientIndex, JsonDocument& doc);
-    void handleModuleRegistration(int clientIndex, JsonDocument& doc, WiFiClient* client);
+    void handleModuleRegistration(int clientIndex, JsonDocument& doc, const String& clientIp);
 
     // JSON Responses
     String getDevicesJSON();
@@ -122,6 +131,20 @@ class DeviceManager {
     MQTTBrokerManager* mqttBrokerManager;
     EEPROMManager* eepromManager;
 
+    // Pool de documentos JSON del broker (nullptr si no hay broker -> heap)
+    JsonDocumentPool* jsonPool();
+
+    // Vencimiento de heartbeats: un evento por módulo activo. Un heartbeat sólo
+    // actualiza lastHeartbeat; al vencer el evento se reprograma si hubo actividad.
+    struct ExpiryTimer {
+        String moduleId;
+        uint32_t generation;
+    };
+    TimerWheel<ExpiryTimer> heartbeatTimers;
+    std::vector<TimerWheel<ExpiryTimer>::Timer> expiredHeartbeats;
+    uint32_t timerGeneration = 0;
+    void armHeartbeatTimer(ModuleInfo& module);
+
     // Datos del sistema
     std::map<String, ModuleInfo> registeredModules;
     std::map<String, AuthorizedDevice> authorizedDevices;
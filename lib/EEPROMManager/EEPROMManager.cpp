@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include <vector>
 #include <map>
+#include "../Logger/Logger.h"
 
 EEPROMManager::EEPROMManager() {} // Constructor por defecto
 
@@ -27,7 +28,7 @@ void EEPROMManager::saveDevice(const DeviceInfo& device, int index) {
 
     EEPROM.put(addr, tmp);
     EEPROM.commit();
-    Serial.printf("[EEPROM] Dispositivo guardado en slot %d (addr %d)\n", index, addr);
+    LOG_D("[EEPROM] Dispositivo guardado en slot %d (addr %d)", index, addr);
 }
 
 DeviceInfo EEPROMManager::loadDevice(int index) {
@@ -40,7 +41,7 @@ DeviceInfo EEPROMManager::loadDevice(int index) {
     device.type[sizeof(device.type)-1] = '\0';
     device.apiKey[sizeof(device.apiKey)-1] = '\0';
     device.desc[sizeof(device.desc)-1] = '\0';
-    Serial.printf("[EEPROM] Dispositivo leído de pos %d: MAC=%s\n", addr, device.mac);
+    LOG_D("[EEPROM] Dispositivo leído de pos %d: MAC=%s", addr, device.mac);
     return device;
 }
 
@@ -52,7 +53,7 @@ std::vector<DeviceInfo> EEPROMManager::loadAllDevices(int maxDevices) {
             devices.push_back(device);
         }
     }
-    Serial.printf("[EEPROM] Total recuperados: %d\n", devices.size());
+    LOG_D("[EEPROM] Total recuperados: %d", (int)devices.size());
     return devices;
 }
 
@@ -96,7 +97,7 @@ void EEPROMManager::saveDevices(const std::map<String, DeviceRecord>& devices) {
         if (index >= MAX_EEPROM_DEVICES) break;
         const DeviceRecord& rec = pair.second;
         if (!isMacValid(rec.macAddress)) {
-            Serial.printf("[EEPROM] saveDevices: saltando MAC inválida: '%s'\n", rec.macAddress.c_str());
+            LOG_W("[EEPROM] saveDevices: saltando MAC inválida: '%s'", rec.macAddress.c_str());
             continue;
         }
         DeviceInfo info;
@@ -117,15 +118,15 @@ void EEPROMManager::removeDevice(const String& macAddress) {
         devices.erase(macAddress);
         saveDevices(devices);
         compactDevices();
-        Serial.println("[EEPROM] Device removed and EEPROM compacted");
+        LOG_I("[EEPROM] Device removed and EEPROM compacted");
     } else {
-        Serial.println("[EEPROM] removeDevice: MAC no encontrada");
+        LOG_W("[EEPROM] removeDevice: MAC no encontrada");
     }
 }
 
 // compactDevices: reescribe dispositivos válidos desde slot 0 y limpia el resto
 void EEPROMManager::compactDevices() {
-    Serial.println("[EEPROM] Iniciando recompactación...");
+    LOG_I("[EEPROM] Iniciando recompactación...");
     auto devices = loadDevices(); // ahora solo devuelve MAC válidas
     // Reescribir en slots iniciales
     int idx = 0;
@@ -146,7 +147,7 @@ void EEPROMManager::compactDevices() {
     for (; idx < MAX_EEPROM_DEVICES; ++idx) {
         saveDevice(empty, idx);
     }
-    Serial.printf("[EEPROM] Recompactación completada: %d dispositivos escritos, %d slots limpiados\n",
+    LOG_I("[EEPROM] Recompactación completada: %d dispositivos escritos, %d slots limpiados",
                   (int)devices.size(), MAX_EEPROM_DEVICES - (int)devices.size());
 }
 
@@ -0,0 +1,110 @@
+#include "EventLoop.h"
+
+EventLoop::EventLoop() : current(nullptr), maxFd(-1), passTime(0) {
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+}
+
+void EventLoop::addSource(const char* name, Prepare prepare, Handler handler) {
+    Source source;
+    source.name = name;
+    source.prepare = prepare;
+    source.handler = handler;
+    source.hasDeadline = false;
+    source.deadline = 0;
+    source.immediate = false;
+    sources.push_back(source);
+}
+
+void EventLoop::watchReadable(int fd) {
+    if (!current || fd < 0 || fd >= FD_SETSIZE) return;
+    current->readFds.push_back(fd);
+    FD_SET(fd, &readSet);
+    if (fd > maxFd) maxFd = fd;
+}
+
+void EventLoop::watchWritable(int fd) {
+    if (!current || fd < 0 || fd >= FD_SETSIZE) return;
+    current->writeFds.push_back(fd);
+    FD_SET(fd, &writeSet);
+    if (fd > maxFd) maxFd = fd;
+}
+
+void EventLoop::wakeAt(unsigned long deadline) {
+    if (!current) return;
+    if (!current->hasDeadline || (long)(deadline - current->deadline) < 0) {
+        current->deadline = deadline;
+        current->hasDeadline = true;
+    }
+}
+
+void EventLoop::wakeAfter(unsigned long delayMs) {
+    wakeAt(passTime + delayMs);
+}
+
+void EventLoop::wakeNow() {
+    if (current) current->immediate = true;
+}
+
+bool EventLoop::isReady(const Source& source, unsigned long now) const {
+    if (source.immediate) return true;
+    if (source.hasDeadline && (long)(now - source.deadline) >= 0) return true;
+    for (int fd : source.readFds) {
+        if (FD_ISSET(fd, &readSet)) return true;
+    }
+    for (int fd : source.writeFds) {
+        if (FD_ISSET(fd, &writeSet)) return true;
+    }
+    return false;
+}
+
+void EventLoop::runOnce() {
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    maxFd = -1;
+    passTime = millis();
+
+    // 1) Cada fuente declara sus descriptores y plazos
+    unsigned long timeout = EVENT_LOOP_MAX_WAIT_MS;
+    for (Source& source : sources) {
+        source.readFds.clear();
+        source.writeFds.clear();
+        source.hasDeadline = false;
+        source.immediate = false;
+        current = &source;
+        source.prepare(*this);
+        current = nullptr;
+
+        if (source.immediate) {
+            timeout = 0;
+        } else if (source.hasDeadline) {
+            long remaining = (long)(source.deadline - passTime);
+            if (remaining <= 0) {
+                timeout = 0;
+            } else if ((unsigned long)remaining < timeout) {
+                timeout = (unsigned long)remaining;
+            }
+        }
+    }
+
+    // 2) Esperar hasta que haya E/S o venza el plazo más cercano
+    if (maxFd >= 0) {
+        struct timeval tv;
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        int ready = select(maxFd + 1, &readSet, &writeSet, nullptr, &tv);
+        if (ready <= 0) {
+            // Timeout o EINTR: ningún descriptor listo
+            FD_ZERO(&readSet);
+            FD_ZERO(&writeSet);
+        }
+    } else if (timeout > 0) {
+        delay(timeout);
+    }
+
+    // 3) Despachar sólo las fuentes con algo listo
+    unsigned long now = millis();
+    for (Source& source : sources) {
+        if (isReady(source, now)) source.handler();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "../../include/config.h"
+
+#ifdef NATIVE_BUILD
+#include <sys/select.h>
+#else
+#include <lwip/sockets.h>
+#endif
+
+// Planificador cooperativo para loop(): en lugar de consultar todos los
+// subsistemas y dormir delay(10), espera en select() hasta que un socket
+// registrado tenga datos / admita escritura o venza el próximo plazo.
+//
+// Cada subsistema registra una fuente con addSource(). Antes de cada espera
+// se llama a su prepare(), que declara qué necesita en esta pasada:
+//   watchReadable(fd) / watchWritable(fd)  -> despertar por el socket
+//   wakeAt(ms) / wakeAfter(ms)             -> despertar por plazo (timers)
+//   wakeNow()                              -> trabajo pendiente, no esperar
+// Después de la espera se llama a handler() sólo de las fuentes que tienen
+// algo listo. Lo que no tiene descriptor (USB CDC del ESP32-C3, accept del
+// WiFiServer en modo inline) se registra con wakeAfter() a intervalo fijo.
+class EventLoop {
+public:
+    typedef std::function<void(EventLoop&)> Prepare;
+    typedef std::function<void()> Handler;
+
+    EventLoop();
+
+    void addSource(const char* name, Prepare prepare, Handler handler);
+
+    // Sólo válidos dentro de prepare()
+    void watchReadable(int fd);
+    void watchWritable(int fd);
+    void wakeAt(unsigned long deadline);
+    void wakeAfter(unsigned long delayMs);
+    void wakeNow();
+
+    // Una pasada: preparar, esperar (como mucho EVENT_LOOP_MAX_WAIT_MS) y despachar
+    void runOnce();
+
+
+private:
+    struct Source {
+        const char* name;
+        Prepare prepare;
+        Handler handler;
+        std::vector<int> readFds;
+        std::vector<int> writeFds;
+        bool hasDeadline;
+        unsigned long deadline;
+        bool immediate;
+    };
+
+    std::vector<Source> sources;
+    Source* current;
+    fd_set readSet;
+    fd_set writeSet;
+    int maxFd;
+    unsigned long passTime;
+
+    bool isReady(const Source& source, unsigned long now) const;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "Wakeup.h"
+
+#ifdef NATIVE_BUILD
+#include <fcntl.h>
+#include <sys/select.h>
+#include <unistd.h>
+#else
+#include <lwip/sockets.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "esp_vfs_eventfd.h"
+#endif
+
+Wakeup::Wakeup() : readFd(-1), writeFd(-1), signalled(false) {}
+
+Wakeup::~Wakeup() {
+    if (readFd >= 0) close(readFd);
+    if (writeFd >= 0 && writeFd != readFd) close(writeFd);
+}
+
+bool Wakeup::begin() {
+    if (readFd >= 0) return true;
+#ifdef NATIVE_BUILD
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    readFd = fds[0];
+    writeFd = fds[1];
+#else
+    // El driver se registra una vez para todo el sistema (ESP_ERR_INVALID_STATE = ya estaba)
+    static bool registered = false;
+    if (!registered) {
+        esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+        esp_err_t err = esp_vfs_eventfd_register(&config);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return false;
+        registered = true;
+    }
+    readFd = eventfd(0, 0);
+    if (readFd < 0) return false;
+    writeFd = readFd;
+#endif
+    return true;
+}
+
+void Wakeup::notify() {
+    // Un solo productor por Wakeup: load/store alcanzan (sin RMW atómicos)
+    if (writeFd < 0 || signalled.load(std::memory_order_acquire)) return;
+    signalled.store(true, std::memory_order_release);
+#ifdef NATIVE_BUILD
+    uint8_t byte = 1;
+    (void)write(writeFd, &byte, 1);
+#else
+    uint64_t one = 1;
+    (void)write(writeFd, &one, sizeof(one));
+#endif
+}
+
+void Wakeup::drain() {
+    if (readFd < 0) return;
+    for (;;) {
+        // Leer sólo si hay algo: el eventfd de ESP-IDF bloquearía con el contador en 0
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(readFd, &readable);
+        struct timeval tv = {0, 0};
+        if (select(readFd + 1, &readable, nullptr, nullptr, &tv) <= 0) break;
+#ifdef NATIVE_BUILD
+        uint8_t buf[16];
+        if (read(readFd, buf, sizeof(buf)) <= 0) break;
+#else
+        uint64_t value;
+        if (read(readFd, &value, sizeof(value)) <= 0) break;
+#endif
+    }
+    // La bandera al final: si se bajara antes, un notify() entre medio escribiría
+    // y esa escritura se leería acá con la bandera ya en true, y los siguientes
+    // no despertarían a nadie. Un notify() que cae antes de esto no escribe, pero
+    // lo suyo ya está en la cola que el que llama atiende después de drain()
+    signalled.store(false, std::memory_order_release);
+}
@@ -0,0 +1,35 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Descriptor para despertar un select() desde otro hilo / tarea.
+// El productor de una cola llama a notify() después de encolar; el consumidor
+// llama a drain() antes de atenderla. Varias notificaciones seguidas cuestan
+// una sola escritura: la bandera evita la syscall si ya hay una pendiente.
+//   ESP32: eventfd de ESP-IDF (esp_vfs_eventfd), que select() mezcla con sockets lwIP
+//   nativo: pipe no bloqueante
+class Wakeup {
+public:
+    Wakeup();
+    ~Wakeup();
+
+    bool begin();
+    int fd() const { return readFd; }
+
+    // Sólo el productor (un hilo)
+    void notify();
+    // Sólo el consumidor, el hilo que espera en fd()
+    void drain();
+
+private:
+    int readFd;
+    int writeFd;
+    std::atomic<bool> signalled;
+
+    Wakeup(const Wakeup&) = delete;
+    Wakeup& operator=(const Wakeup&) = delete;
+};
+
+#endif
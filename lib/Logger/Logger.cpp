@@ -0,0 +1,57 @@
+#include "Logger.h"
+#include "SpscRing.h"
+#include <stdio.h>
+
+struct LogLine {
+    uint8_t level;
+    char text[LOG_LINE_MAX];
+};
+
+static SpscRing<LogLine, LOG_QUEUE_DEPTH> logRing;
+static unsigned long droppedLines = 0;
+static unsigned long reportedDrops = 0;
+
+void Logger::write(uint8_t level, const char* format, ...) {
+    LogLine* line = logRing.reserve();
+    if (!line) {
+        // Buffer lleno: descartar (nunca bloquear el camino caliente)
+        droppedLines++;
+        return;
+    }
+    line->level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line->text, sizeof(line->text), format, args);
+    va_end(args);
+    logRing.commit();
+}
+
+size_t Logger::drain(size_t maxLines) {
+    size_t written = 0;
+    if (droppedLines != reportedDrops) {
+        Serial.printf("⚠️ [log] %lu líneas descartadas (buffer lleno)\n", droppedLines - reportedDrops);
+        reportedDrops = droppedLines;
+    }
+    LogLine* line;
+    while (written < maxLines && (line = logRing.front()) != nullptr) {
+        if (line->level == LOG_LEVEL_ERROR) Serial.print("[E] ");
+        else if (line->level == LOG_LEVEL_WARN) Serial.print("[W] ");
+        else if (line->level == LOG_LEVEL_DEBUG) Serial.print("[D] ");
+        Serial.println(line->text);
+        logRing.release();
+        written++;
+    }
+    return written;
+}
+
+void Logger::flush() {
+    while (drain(LOG_QUEUE_DEPTH) > 0) {}
+}
+
+size_t Logger::pending() {
+    return logRing.size();
+}
+
+unsigned long Logger::dropped() {
+    return droppedLines;
+}
@@ -0,0 +1,61 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "../../include/config.h"
+
+// Niveles de log. El nivel se fija al compilar (-DLOG_LEVEL=N en platformio.ini):
+// las llamadas por encima de LOG_LEVEL no generan código ni evalúan sus argumentos.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Logger asíncrono: write() formatea (printf) en un slot de un ring buffer sin
+// locks y vuelve; drain() lo vuelca a Serial cuando loop() no tiene trabajo.
+// Así el costo de los 115200 baudios no cae en el camino de cada mensaje.
+// Un solo productor: llamar sólo desde la tarea de loop().
+class Logger {
+public:
+    static void write(uint8_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Vuelca hasta maxLines líneas pendientes. Devuelve cuántas escribió
+    static size_t drain(size_t maxLines = LOG_DRAIN_PER_PASS);
+    // Vuelca todo (fin de setup(), antes de reiniciar)
+    static void flush();
+
+    static size_t pending();
+    static unsigned long dropped();
+};
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(...) Logger::write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...) Logger::write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...) Logger::write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...) Logger::write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Cola circular sin locks para un productor y un consumidor.
+// N debe ser potencia de 2. Sólo usa loads/stores atómicos (acquire/release),
+// que en el ESP32-C3 (RV32IMC, sin extensión A) son lw/sw + fence: no hace
+// falta libatomic ni deshabilitar interrupciones.
+//
+// Productor: reserve() -> escribir el elemento -> commit()  (o push())
+// Consumidor: front() -> leer el elemento -> release()      (o pop())
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing: N debe ser potencia de 2");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Productor: slot libre para escribir en sitio, o nullptr si está llena
+    T* reserve() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+        return &items[h & (N - 1)];
+    }
+
+    void commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool push(const T& item) {
+        T* slot = reserve();
+        if (!slot) return false;
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    // Consumidor: elemento más antiguo, o nullptr si está vacía
+    T* front() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return nullptr;
+        return &items[t & (N - 1)];
+    }
+
+    void release() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool pop(T& out) {
+        T* slot = front();
+        if (!slot) return false;
+        out = *slot;
+        release();
+        return true;
+    }
+
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T items[N];
+    std::atomic<size_t> head;  // sólo lo escribe el productor
+    std::atomic<size_t> tail;  // sólo lo escribe el consumidor
+};
+
+#endif
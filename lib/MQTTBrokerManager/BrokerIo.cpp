@@ -0,0 +1,595 @@
+#include "BrokerIo.h"
+#ifdef NATIVE_BUILD
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#else
+#include <lwip/sockets.h>
+#endif
+
+// Contadores con un único escritor: load + store, sin RMW atómicos (el C3 no tiene extensión A)
+static void bump(std::atomic<uint32_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Keepalive TCP propio: los defaults de lwIP (2 h) dejan un slot half-open casi para siempre
+static void configureKeepalive(int fd) {
+    if (fd < 0) return;
+    int on = 1;
+    int idle = TCP_KEEPALIVE_IDLE_S;
+    int interval = TCP_KEEPALIVE_INTERVAL_S;
+    int count = TCP_KEEPALIVE_COUNT;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+BrokerIo::BrokerIo()
+    : server(MQTT_PORT), txOverflowPolicy(ClientTxQueue::DROP_OLDEST), acceptedCount(0),
+      refusedCount(0), droppedCommandCount(0), emptyFrameCount(0), stalledReadCount(0), running(false) {
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        active[i] = false;
+        generation[i] = 0;
+        protocol[i] = 0;
+        inputFormats[i] = 0;
+        protocolDeadline[i] = 0;
+        txProgressAt[i] = 0;
+        pendingDisconnect[i] = false;
+        pendingClose[i] = -1;
+        stats[i].rxBuffered.store(0);
+        stats[i].oversizedFrames.store(0);
+        stats[i].txDepth.store(0);
+        stats[i].txBytes.store(0);
+        stats[i].txHighWater.store(0);
+        stats[i].txDropped.store(0);
+        stats[i].txOverflows.store(0);
+    }
+}
+
+BrokerIo::~BrokerIo() {
+    stop();
+}
+
+void BrokerIo::begin(int limit, ClientTxQueue::OverflowPolicy policy) {
+    maxClients = limit;
+    txOverflowPolicy = policy;
+    rebuildFreeSlots();
+    server.begin();
+}
+
+bool BrokerIo::start() {
+    if (!BROKER_IO_TASK) return true;
+    if (!inboundReady.begin() || !outboundReady.begin()) return false;
+    useTask = true;
+    running.store(true, std::memory_order_release);
+#ifdef NATIVE_BUILD
+    worker = std::thread([this]() { run(); });
+#else
+    if (xTaskCreate(taskEntry, "broker_io", BROKER_IO_TASK_STACK, this, BROKER_IO_TASK_PRIORITY, &worker) != pdPASS) {
+        running.store(false, std::memory_order_release);
+        useTask = false;
+        return false;
+    }
+#endif
+    return true;
+}
+
+void BrokerIo::stop() {
+    if (!running.load(std::memory_order_acquire)) return;
+    running.store(false, std::memory_order_release);
+    outboundReady.notify();
+#ifdef NATIVE_BUILD
+    if (worker.joinable()) worker.join();
+#endif
+    // En el ESP32 la tarea termina sola al ver running = false
+}
+
+#ifndef NATIVE_BUILD
+void BrokerIo::taskEntry(void* arg) {
+    static_cast<BrokerIo*>(arg)->run();
+    vTaskDelete(nullptr);
+}
+#endif
+
+void BrokerIo::run() {
+    while (running.load(std::memory_order_acquire)) {
+        waitForWork(BROKER_IO_POLL_MS);
+        service();
+    }
+}
+
+// ---- Lado loop() ----
+
+BrokerIo::Event* BrokerIo::nextEvent() {
+    return inbound.front();
+}
+
+void BrokerIo::releaseEvent() {
+    Event* event = inbound.front();
+    if (!event) return;
+    event->data = String();   // no retener la trama en el ring hasta que se reuse el slot
+    inbound.release();
+}
+
+bool BrokerIo::send(int slot, uint32_t gen, const SharedPayload& frame, bool binary, bool raw) {
+    // Ninguna trama sale vacía: sin bytes = no hubo heap para el SharedPayload
+    // (se mandaría un "\r\n" suelto)
+    if (frame.empty()) {
+        bump(emptyFrameCount);
+        return false;
+    }
+    Command* cmd = outbound.reserve();
+    if (!cmd && !useTask) {
+        // Inline: pasar lo encolado a las colas de cada slot y volver a intentar
+        applyCommands();
+        cmd = outbound.reserve();
+    }
+    if (!cmd) {
+        bump(droppedCommandCount);
+        return false;
+    }
+    cmd->kind = Command::SEND;
+    cmd->slot = (int8_t)slot;
+    cmd->binary = binary;
+    cmd->raw = raw;
+    cmd->generation = gen;
+    cmd->arg = 0;
+    cmd->data = frame;
+    outbound.commit();
+    outboundReady.notify();
+    return true;
+}
+
+void BrokerIo::close(int slot, uint32_t gen) {
+    Command* cmd = outbound.reserve();
+    if (!cmd && !useTask) {
+        applyCommands();
+        cmd = outbound.reserve();
+    }
+    if (!cmd) {
+        // Sin lugar: la tarea lo cierra igual por inactividad o cola trabada
+        bump(droppedCommandCount);
+        return;
+    }
+    cmd->kind = Command::CLOSE;
+    cmd->slot = (int8_t)slot;
+    cmd->binary = false;
+    cmd->raw = false;
+    cmd->generation = gen;
+    cmd->arg = 0;
+    cmd->data = SharedPayload();
+    outbound.commit();
+    outboundReady.notify();
+}
+
+void BrokerIo::setMaxClients(int limit) {
+    Command cmd;
+    cmd.kind = Command::SET_MAX_CLIENTS;
+    cmd.slot = -1;
+    cmd.binary = false;
+    cmd.raw = false;
+    cmd.generation = 0;
+    cmd.arg = limit;
+    if (!outbound.push(cmd) && !useTask) {
+        applyCommands();
+        outbound.push(cmd);
+    }
+    outboundReady.notify();
+}
+
+void BrokerIo::setInputFormats(int slot, uint32_t gen, uint8_t formats) {
+    Command cmd;
+    cmd.kind = Command::SET_INPUT_FORMATS;
+    cmd.slot = (int8_t)slot;
+    cmd.binary = false;
+    cmd.raw = false;
+    cmd.generation = gen;
+    cmd.arg = formats;
+    if (!outbound.push(cmd) && !useTask) {
+        applyCommands();
+        outbound.push(cmd);
+    }
+    outboundReady.notify();
+}
+
+void BrokerIo::setTxOverflowPolicy(ClientTxQueue::OverflowPolicy policy) {
+    Command cmd;
+    cmd.kind = Command::SET_TX_POLICY;
+    cmd.slot = -1;
+    cmd.binary = false;
+    cmd.raw = false;
+    cmd.generation = 0;
+    cmd.arg = (int)policy;
+    if (!outbound.push(cmd) && !useTask) {
+        applyCommands();
+        outbound.push(cmd);
+    }
+    outboundReady.notify();
+}
+
+void BrokerIo::clearWakeup() {
+    inboundReady.drain();
+}
+
+void BrokerIo::prepare(EventLoop& loop) {
+    if (!inbound.empty()) loop.wakeNow();
+    if (useTask) {
+        loop.watchReadable(inboundReady.fd());
+        return;
+    }
+
+    // Inline: los mismos sockets que esperaría la tarea
+#ifdef NATIVE_BUILD
+    loop.watchReadable(server.fd());
+#else
+    // WiFiServer de Arduino-ESP32 no expone su descriptor: aceptar por intervalo
+    loop.wakeAfter(EVENT_LOOP_POLL_MS);
+#endif
+    if (backlog) loop.wakeNow();
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!active[i]) continue;
+        if (pendingDisconnect[i] || pendingClose[i] >= 0) {
+            loop.wakeNow();
+            continue;
+        }
+        if (protocol[i] == 0) loop.wakeAt(protocolDeadline[i]);
+        int fd = clients[i].fd();
+        loop.watchReadable(fd);
+        if (!txQueues[i].empty()) {
+            loop.watchWritable(fd);
+            loop.wakeAt(txProgressAt[i] + CLIENT_TX_STALL_MS);
+        }
+    }
+}
+
+// ---- Lado tarea ----
+
+void BrokerIo::service() {
+    unsigned long now = millis();
+    outboundReady.drain();
+    applyCommands();
+    acceptConnections(now);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (active[i]) readSlot(i, now);
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (active[i]) flushSlot(i, now);
+        publishStats(i);
+    }
+}
+
+unsigned long BrokerIo::nextDeadline(unsigned long now, unsigned long maxWaitMs) {
+    unsigned long timeout = maxWaitMs;
+    bool room = inbound.size() < inbound.capacity();
+    if (backlog && room) return 0;
+    auto earliest = [&](unsigned long deadline) {
+        long remaining = (long)(deadline - now);
+        if (remaining <= 0) timeout = 0;
+        else if ((unsigned long)remaining < timeout) timeout = (unsigned long)remaining;
+    };
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!active[i]) continue;
+        if (pendingDisconnect[i]) return 0;
+        if (protocol[i] == 0 && room) earliest(protocolDeadline[i]);
+        if (!txQueues[i].empty()) earliest(txProgressAt[i] + CLIENT_TX_STALL_MS);
+    }
+    return timeout;
+}
+
+void BrokerIo::waitForWork(unsigned long maxWaitMs) {
+    fd_set readSet;
+    fd_set writeSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    int maxFd = -1;
+    auto watch = [&](fd_set& set, int fd) {
+        if (fd < 0 || fd >= FD_SETSIZE) return;
+        FD_SET(fd, &set);
+        if (fd > maxFd) maxFd = fd;
+    };
+
+    watch(readSet, outboundReady.fd());
+    // Con inbound lleno no se espera por lecturas (se volvería enseguida):
+    // se reintenta al vencer la espera, cuando loop() ya liberó lugar
+    bool room = inbound.size() < inbound.capacity();
+#ifdef NATIVE_BUILD
+    if (room) watch(readSet, server.fd());
+#endif
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!active[i] || pendingClose[i] >= 0) continue;
+        int fd = clients[i].fd();
+        if (room) watch(readSet, fd);
+        if (!txQueues[i].empty()) watch(writeSet, fd);
+    }
+
+    unsigned long timeout = nextDeadline(millis(), maxWaitMs);
+    struct timeval tv;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    if (maxFd >= 0) {
+        select(maxFd + 1, &readSet, &writeSet, nullptr, &tv);
+    } else if (timeout > 0) {
+        delay(timeout);
+    }
+}
+
+void BrokerIo::applyCommands() {
+    Command* cmd;
+    while ((cmd = outbound.front()) != nullptr) {
+        int i = cmd->slot;
+        // Comandos para una conexión que ya no existe (se cerró y el slot se reusó) se descartan
+        bool current = i >= 0 && i < MAX_CLIENTS && active[i] && generation[i] == cmd->generation &&
+                       pendingClose[i] < 0;
+        switch (cmd->kind) {
+            case Command::SEND:
+                // JSON encolado antes de detectar MQTT (o al revés) no sirve para este cliente
+                if (current && !pendingDisconnect[i] && cmd->binary == (protocol[i] == PROTOCOL_MQTT)) {
+                    if (!txQueues[i].push(cmd->data, txOverflowPolicy, cmd->raw)) pendingDisconnect[i] = true;
+                }
+                break;
+            case Command::CLOSE:
+                if (current) {
+                    // Intentar entregar lo pendiente (p.ej. el CONNACK de rechazo) antes de cerrar
+                    txQueues[i].flush(clients[i]);
+                    releaseSocket(i);
+                }
+                break;
+            case Command::SET_MAX_CLIENTS:
+                maxClients = cmd->arg;
+                rebuildFreeSlots();
+                break;
+            case Command::SET_TX_POLICY:
+                txOverflowPolicy = (ClientTxQueue::OverflowPolicy)cmd->arg;
+                break;
+            case Command::SET_INPUT_FORMATS:
+                if (current) inputFormats[i] = (uint8_t)cmd->arg;
+                break;
+        }
+        cmd->data = SharedPayload();   // soltar la referencia: la cola del slot tiene la suya
+        outbound.release();
+    }
+}
+
+BrokerIo::Event* BrokerIo::reserveEvent() {
+    Event* event = inbound.reserve();
+    if (event) {
+        event->value = 0;
+        event->flags = 0;
+    }
+    return event;
+}
+
+void BrokerIo::commitEvent() {
+    inbound.commit();
+    inboundReady.notify();
+}
+
+void BrokerIo::acceptConnections(unsigned long now) {
+    // Aceptar todo lo pendiente (con tope por pasada para no frenar al resto)
+    backlog = false;
+    for (int accepted = 0; ; accepted++) {
+        if (accepted == MQTT_ACCEPTS_PER_PASS) {
+            backlog = true;
+            break;
+        }
+        // Sin lugar para avisarle a loop(): la conexión espera en el backlog de listen()
+        Event* event = reserveEvent();
+        if (!event) break;
+        WiFiClient client = server.available();
+        if (!client) break;
+
+        int i = freeSlotCount > 0 ? freeSlots[--freeSlotCount] : -1;
+        if (i < 0) {
+            refuse(client);
+            event->kind = Event::REFUSED;
+            event->slot = -1;
+            event->generation = 0;
+            event->data = String();
+            commitEvent();
+            continue;
+        }
+
+        bump(acceptedCount);
+        clients[i] = client;
+        active[i] = true;
+        generation[i]++;
+        protocol[i] = 0;
+        inputFormats[i] = 0;
+        protocolDeadline[i] = now + MQTT_PROTOCOL_DETECT_MS;
+        txProgressAt[i] = now;
+        pendingDisconnect[i] = false;
+        pendingClose[i] = -1;
+        rxBuffers[i].reset();
+        txQueues[i].clear();
+        txQueues[i].setLineFraming(true);
+        configureKeepalive(client.fd());
+
+        event->kind = Event::CONNECTED;
+        event->slot = (int8_t)i;
+        event->generation = generation[i];
+        event->data = client.remoteIP().toString();
+        commitEvent();
+    }
+}
+
+// Sin lugar: avisar antes de cerrar en vez de dejar al cliente esperando la bienvenida
+void BrokerIo::refuse(WiFiClient& client) {
+    bump(refusedCount);
+    if (client.available() > 0 && client.peek() == MQTT_CONNECT_HEADER) {
+        String frame;
+        mqttEncodeConnack(frame, false, MQTT_CONNACK_SERVER_UNAVAILABLE);
+        client.write((const uint8_t*)frame.c_str(), frame.length());
+    } else {
+        client.println("{\"type\":\"error\",\"code\":\"server_full\",\"message\":\"Broker lleno, reintentar más tarde\"}");
+    }
+    client.stop();
+}
+
+// El protocolo se decide con el primer byte; hasta entonces no se entrega nada
+bool BrokerIo::detectProtocol(int slot, unsigned long now) {
+    int first = rxBuffers[slot].peek();
+    uint8_t detected = 0;
+    if (first == MQTT_CONNECT_HEADER) {
+        detected = PROTOCOL_MQTT;
+    } else if (first >= 0 || (long)(now - protocolDeadline[slot]) >= 0) {
+        // Cualquier otro byte (o un cliente que espera la bienvenida antes de hablar) es JSON
+        detected = PROTOCOL_JSON;
+    }
+    if (detected == 0) return false;
+
+    Event* event = reserveEvent();
+    if (!event) return false;
+    event->kind = Event::PROTOCOL;
+    event->slot = (int8_t)slot;
+    event->generation = generation[slot];
+    event->value = detected;
+    event->data = String();
+    commitEvent();
+
+    protocol[slot] = detected;
+    if (detected == PROTOCOL_MQTT) {
+        // Lo encolado durante la detección es JSON: no sirve para este cliente
+        txQueues[slot].clear();
+        txQueues[slot].setLineFraming(false);
+    }
+    return true;
+}
+
+void BrokerIo::readSlot(int slot, unsigned long now) {
+    if (pendingClose[slot] >= 0) {
+        closeSlot(slot, (CloseReason)pendingClose[slot]);
+        return;
+    }
+
+    // Leer sólo lo disponible y entregar tramas completas mientras haya lugar en inbound
+    ClientRxBuffer& rx = rxBuffers[slot];
+    unsigned long oversizedBefore = rx.oversizedFrames();
+    rx.fill(clients[slot]);
+    bool blocked = false;
+    if (protocol[slot] == 0 && !detectProtocol(slot, now)) {
+        blocked = inbound.size() == inbound.capacity();
+    }
+
+    Event* event = nullptr;
+    if (protocol[slot] == PROTOCOL_JSON) {
+        uint8_t format = 0;
+        while ((event = reserveEvent()) != nullptr && rx.nextFrame(event->data, inputFormats[slot], format)) {
+            event->kind = Event::FRAME;
+            event->slot = (int8_t)slot;
+            event->generation = generation[slot];
+            event->value = 0;
+            event->flags = format;
+            commitEvent();
+        }
+        blocked = event == nullptr;
+    } else if (protocol[slot] == PROTOCOL_MQTT) {
+        MqttPacket packet;
+        while ((event = reserveEvent()) != nullptr && rx.nextPacket(packet, rxScratch)) {
+            // Copia del cuerpo: la vista apunta al ring, que el próximo fill() sobrescribe
+            event->kind = Event::FRAME;
+            event->slot = (int8_t)slot;
+            event->generation = generation[slot];
+            event->value = (uint8_t)packet.type;
+            event->flags = packet.flags;
+            event->data = String();
+            if (packet.length > 0) event->data.concat((const char*)packet.body, packet.length);
+            commitEvent();
+        }
+        blocked = event == nullptr;
+        if (rx.malformed()) {
+            closeSlot(slot, CLOSE_MALFORMED);
+            return;
+        }
+    }
+
+    if (rx.oversizedFrames() != oversizedBefore && (event = reserveEvent()) != nullptr) {
+        event->kind = Event::OVERSIZED;
+        event->slot = (int8_t)slot;
+        event->generation = generation[slot];
+        event->data = String();
+        commitEvent();
+    }
+
+    if (blocked) {
+        // Tramas esperando lugar en inbound: el cierre se informa después de entregarlas
+        bump(stalledReadCount);
+        return;
+    }
+    if (!clients[slot].connected()) closeSlot(slot, CLOSE_PEER);
+}
+
+void BrokerIo::flushSlot(int slot, unsigned long now) {
+    if (pendingClose[slot] >= 0) return;
+    if (pendingDisconnect[slot]) {
+        closeSlot(slot, CLOSE_TX_OVERFLOW);
+        return;
+    }
+    ClientTxQueue& tx = txQueues[slot];
+    if (tx.empty()) {
+        txProgressAt[slot] = now;
+        return;
+    }
+    int sent = tx.flush(clients[slot]);
+    if (sent < 0) {
+        closeSlot(slot, CLOSE_WRITE_ERROR);
+    } else if (sent > 0) {
+        txProgressAt[slot] = now;
+    } else if (now - txProgressAt[slot] >= CLIENT_TX_STALL_MS) {
+        closeSlot(slot, CLOSE_TX_STALLED);
+    }
+}
+
+// Cierre decidido por la tarea: loop() se entera con CLOSED. Si inbound está
+// lleno el socket queda abierto (sin leer ni escribir) hasta poder avisar
+void BrokerIo::closeSlot(int slot, CloseReason reason) {
+    Event* event = reserveEvent();
+    if (!event) {
+        pendingClose[slot] = reason;
+        return;
+    }
+    event->kind = Event::CLOSED;
+    event->slot = (int8_t)slot;
+    event->generation = generation[slot];
+    event->value = reason;
+    event->data = String();
+    commitEvent();
+    releaseSocket(slot);
+}
+
+void BrokerIo::releaseSocket(int slot) {
+    clients[slot].stop();
+    clients[slot] = WiFiClient();
+    rxBuffers[slot].reset();
+    txQueues[slot].clear();
+    txQueues[slot].setLineFraming(true);
+    pendingDisconnect[slot] = false;
+    pendingClose[slot] = -1;
+    protocol[slot] = 0;
+    inputFormats[slot] = 0;
+    if (active[slot] && slot < maxClients) {
+        // Slots por encima del tope (se bajó con clientes conectados) no vuelven a usarse
+        freeSlots[freeSlotCount++] = slot;
+    }
+    active[slot] = false;
+}
+
+void BrokerIo::rebuildFreeSlots() {
+    // Orden inverso: el tope de la pila es el slot libre más bajo
+    freeSlotCount = 0;
+    for (int i = maxClients - 1; i >= 0; i--) {
+        if (!active[i]) freeSlots[freeSlotCount++] = i;
+    }
+}
+
+void BrokerIo::publishStats(int slot) {
+    SlotStats& out = stats[slot];
+    out.rxBuffered.store((uint32_t)rxBuffers[slot].bufferedBytes(), std::memory_order_relaxed);
+    out.oversizedFrames.store((uint32_t)rxBuffers[slot].oversizedFrames(), std::memory_order_relaxed);
+    out.txDepth.store((uint32_t)txQueues[slot].depth(), std::memory_order_relaxed);
+    out.txBytes.store((uint32_t)txQueues[slot].queuedBytes(), std::memory_order_relaxed);
+    out.txHighWater.store((uint32_t)txQueues[slot].highWaterMark(), std::memory_order_relaxed);
+    out.txDropped.store((uint32_t)txQueues[slot].droppedMessages(), std::memory_order_relaxed);
+    out.txOverflows.store((uint32_t)txQueues[slot].overflows(), std::memory_order_relaxed);
+}
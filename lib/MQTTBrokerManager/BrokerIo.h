@@ -0,0 +1,184 @@
+#ifndef BROKER_IO_H
+#define BROKER_IO_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+#include "../../include/config.h"
+#include "ClientRxBuffer.h"
+#include "ClientTxQueue.h"
+#include "MqttCodec.h"
+#include "../Logger/SpscRing.h"
+#include "../EventLoop/EventLoop.h"
+#include "../EventLoop/Wakeup.h"
+
+#ifdef NATIVE_BUILD
+#include <thread>
+#endif
+
+// E/S de sockets del broker, separada del procesamiento de mensajes.
+// Es dueña del listener, de los WiFiClient de cada slot, del framing (ClientRxBuffer)
+// y de las colas de salida (ClientTxQueue). Con BROKER_IO_TASK corre en su propia
+// tarea (FreeRTOS en el ESP32, std::thread en el build nativo) y un EEPROM.commit()
+// o un JSON grande en loop() ya no frenan las lecturas ni las escrituras.
+//
+// Con loop() se comunica sólo por dos rings SPSC sin locks:
+//   inbound  (tarea -> loop): conexiones, protocolo detectado, tramas completas, cierres
+//   outbound (loop -> tarea): tramas a enviar, cierres pedidos, cambios de política
+// Cada lado despierta al otro con un Wakeup. Si inbound se llena la tarea deja de
+// leer (el ring por slot y la ventana TCP hacen de contrapresión); si outbound se
+// llena la trama se descarta y se cuenta.
+//
+// La tarea no loguea: Logger es SPSC con loop() como productor. Lo que merece un
+// log (rechazos, tramas grandes, cierres) sube como evento y lo registra loop().
+class BrokerIo {
+public:
+    enum Protocol : uint8_t {
+        PROTOCOL_JSON = 1,   // líneas JSON (módulos propios)
+        PROTOCOL_MQTT = 2    // MQTT 3.1.1 binario
+    };
+
+    // Por qué la tarea cerró la conexión por su cuenta
+    enum CloseReason : uint8_t {
+        CLOSE_PEER,          // el otro extremo cerró
+        CLOSE_WRITE_ERROR,
+        CLOSE_TX_OVERFLOW,   // cola de salida llena con política DISCONNECT
+        CLOSE_TX_STALLED,    // cola de salida sin avanzar CLIENT_TX_STALL_MS
+        CLOSE_MALFORMED      // remaining length MQTT inválido
+    };
+
+    struct Event {
+        enum Kind : uint8_t { CONNECTED, PROTOCOL, FRAME, CLOSED, REFUSED, OVERSIZED };
+        Kind kind;
+        int8_t slot;            // -1 en REFUSED
+        uint32_t generation;    // cambia en cada conexión del slot
+        uint8_t value;          // PROTOCOL: Protocol. FRAME MQTT: tipo. CLOSED: CloseReason
+        uint8_t flags;          // FRAME MQTT: flags del paquete. FRAME JSON: FRAME_PACKED / FRAME_COMPRESSED
+        String data;            // FRAME: línea JSON o cuerpo MQTT. CONNECTED: IP remota
+    };
+
+    // FRAME de un cliente JSON que llegó con 2 bytes de largo delante: MessagePack,
+    // o LZSS (2 bytes de largo expandido + stream) que loop() expande
+    static const uint8_t FRAME_PACKED = ClientRxBuffer::FORMAT_PACKED;
+    static const uint8_t FRAME_COMPRESSED = ClientRxBuffer::FORMAT_COMPRESSED;
+
+    struct Command {
+        enum Kind : uint8_t { SEND, CLOSE, SET_MAX_CLIENTS, SET_TX_POLICY, SET_INPUT_FORMATS };
+        Kind kind;
+        int8_t slot;
+        bool binary;            // SEND: trama MQTT (si no, línea JSON)
+        bool raw;               // SEND a cliente JSON: trama con su largo (MessagePack / LZSS), sin "\r\n"
+        uint32_t generation;
+        int arg;                // SET_MAX_CLIENTS / SET_TX_POLICY / SET_INPUT_FORMATS
+        SharedPayload data;     // SEND: referencia a la trama (un broadcast comparte el buffer)
+    };
+
+    // Contadores por slot publicados por la tarea (loop() sólo los lee)
+    struct SlotStats {
+        std::atomic<uint32_t> rxBuffered;
+        std::atomic<uint32_t> oversizedFrames;
+        std::atomic<uint32_t> txDepth;
+        std::atomic<uint32_t> txBytes;
+        std::atomic<uint32_t> txHighWater;
+        std::atomic<uint32_t> txDropped;
+        std::atomic<uint32_t> txOverflows;
+    };
+
+    BrokerIo();
+    ~BrokerIo();
+
+    // Listener y Wakeups; después start() lanza la tarea (o nada, en modo inline)
+    void begin(int maxClients, ClientTxQueue::OverflowPolicy policy);
+    bool start();
+    void stop();
+    bool threaded() const { return useTask; }
+
+    // ---- Lado loop() ----
+    // Antes de recorrer los eventos: lo que llegue después vuelve a despertar a loop()
+    void clearWakeup();
+    // Evento más antiguo (nullptr = ninguno). releaseEvent() lo devuelve al ring
+    Event* nextEvent();
+    void releaseEvent();
+    bool hasEvents() const { return !inbound.empty(); }
+    // false = ring de salida lleno o trama vacía (falló su reserva): se descarta
+    bool send(int slot, uint32_t generation, const SharedPayload& frame, bool binary, bool raw = false);
+    void close(int slot, uint32_t generation);
+    // Tramas con largo aceptadas además de líneas JSON (FRAME_PACKED | FRAME_COMPRESSED,
+    // negociado en el registro)
+    void setInputFormats(int slot, uint32_t generation, uint8_t formats);
+    void setMaxClients(int limit);
+    void setTxOverflowPolicy(ClientTxQueue::OverflowPolicy policy);
+    // Qué despierta a loop(): el Wakeup de la tarea, o los sockets en modo inline
+    void prepare(EventLoop& loop);
+    // Modo inline: una pasada de E/S dentro de loop()
+    void service();
+
+    const SlotStats& slotStats(int slot) const { return stats[slot]; }
+    unsigned long acceptedConnections() const { return acceptedCount.load(std::memory_order_relaxed); }
+    unsigned long refusedConnections() const { return refusedCount.load(std::memory_order_relaxed); }
+    unsigned long droppedCommands() const { return droppedCommandCount.load(std::memory_order_relaxed); }
+    unsigned long emptyFrames() const { return emptyFrameCount.load(std::memory_order_relaxed); }
+    unsigned long stalledReads() const { return stalledReadCount.load(std::memory_order_relaxed); }
+    size_t pendingEvents() const { return inbound.size(); }
+    size_t pendingCommands() const { return outbound.size(); }
+
+private:
+    // ---- Estado de la tarea (loop() no lo toca) ----
+    WiFiServer server;
+    WiFiClient clients[MAX_CLIENTS];
+    bool active[MAX_CLIENTS];
+    uint32_t generation[MAX_CLIENTS];
+    uint8_t protocol[MAX_CLIENTS];         // 0 = pendiente, si no Protocol
+    uint8_t inputFormats[MAX_CLIENTS];
+    unsigned long protocolDeadline[MAX_CLIENTS];
+    unsigned long txProgressAt[MAX_CLIENTS];
+    bool pendingDisconnect[MAX_CLIENTS];
+    int pendingClose[MAX_CLIENTS];         // CloseReason a informar cuando haya lugar (-1 = nada)
+    ClientRxBuffer rxBuffers[MAX_CLIENTS];
+    ClientTxQueue txQueues[MAX_CLIENTS];
+    ClientTxQueue::OverflowPolicy txOverflowPolicy;
+    int freeSlots[MAX_CLIENTS];
+    int freeSlotCount = 0;
+    int maxClients = MAX_CLIENTS;
+    bool backlog = false;   // quedó algo por hacer sin esperar al socket (ring lleno, tope de accepts)
+    uint8_t rxScratch[MQTT_MAX_FRAME_SIZE];
+
+    // ---- Compartido ----
+    SpscRing<Event, BROKER_IO_INBOUND_DEPTH> inbound;
+    SpscRing<Command, BROKER_IO_OUTBOUND_DEPTH> outbound;
+    Wakeup inboundReady;    // lo notifica la tarea, lo espera loop()
+    Wakeup outboundReady;   // lo notifica loop(), lo espera la tarea
+    SlotStats stats[MAX_CLIENTS];
+    std::atomic<uint32_t> acceptedCount;
+    std::atomic<uint32_t> refusedCount;
+    std::atomic<uint32_t> droppedCommandCount;   // lo escribe loop()
+    std::atomic<uint32_t> emptyFrameCount;       // lo escribe loop()
+    std::atomic<uint32_t> stalledReadCount;   // pasadas sin leer por inbound lleno
+    std::atomic<bool> running;
+    bool useTask = false;   // se fija antes de lanzar la tarea
+
+#ifdef NATIVE_BUILD
+    std::thread worker;
+#else
+    TaskHandle_t worker = nullptr;
+    static void taskEntry(void* arg);
+#endif
+
+    void run();
+    void waitForWork(unsigned long maxWaitMs);
+    unsigned long nextDeadline(unsigned long now, unsigned long maxWaitMs);
+    void applyCommands();
+    void acceptConnections(unsigned long now);
+    void readSlot(int slot, unsigned long now);
+    void flushSlot(int slot, unsigned long now);
+    bool detectProtocol(int slot, unsigned long now);
+    Event* reserveEvent();
+    void commitEvent();
+    void closeSlot(int slot, CloseReason reason);
+    void releaseSocket(int slot);
+    void refuse(WiFiClient& client);
+    void publishStats(int slot);
+    void rebuildFreeSlots();
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "ChunkAssembler.h"
+#include <utility>
+
+ChunkAssembler::ChunkAssembler() {
+    lastError = "";
+    reset();
+}
+
+void ChunkAssembler::reset() {
+    buffer = String();   // libera la reserva, no sólo el contenido
+    transferId = 0;
+    nextSeq = 0;
+    totalLength = 0;
+    lastChunkAt = 0;
+    inProgress = false;
+    values = 1;
+    inString = false;
+    escaped = false;
+}
+
+ChunkAssembler::Result ChunkAssembler::reject(const char* reason) {
+    reset();
+    lastError = reason;
+    return REJECTED;
+}
+
+ChunkAssembler::Result ChunkAssembler::add(uint32_t id, uint32_t seq, size_t total,
+                                           const char* data, size_t length, unsigned long now) {
+    if (seq == 0) {
+        // Una transferencia nueva reemplaza a la que estaba a medias
+        reset();
+        if (total == 0 || total > (size_t)CHUNK_MAX_TRANSFER_BYTES) return reject("too_large");
+        if (!buffer.reserve(total)) return reject("no_memory");
+        transferId = id;
+        totalLength = total;
+        inProgress = true;
+    } else if (!inProgress || id != transferId) {
+        return reject("unknown_transfer");
+    } else if (seq != nextSeq) {
+        return reject("out_of_order");
+    } else if (total != totalLength) {
+        return reject("length_mismatch");
+    }
+
+    if (length > totalLength - buffer.length()) return reject("overflow");
+    buffer.concat(data, length);
+    scan(data, length);
+    nextSeq = seq + 1;
+    lastChunkAt = now;
+    return buffer.length() == totalLength ? COMPLETE : PENDING;
+}
+
+String ChunkAssembler::takeMessage() {
+    String message = std::move(buffer);
+    reset();
+    return message;
+}
+
+void ChunkAssembler::scan(const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        if (inString) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == ',' || c == '[' || c == '{') {
+            values++;
+        }
+    }
+}
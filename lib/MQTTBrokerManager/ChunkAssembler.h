@@ -0,0 +1,59 @@
+#ifndef CHUNK_ASSEMBLER_H
+#define CHUNK_ASSEMBLER_H
+
+#include <Arduino.h>
+#include "../../include/config.h"
+
+// Rearmado de un mensaje JSON que llega fragmentado ("type":"chunk").
+// El emisor serializa el mensaje original (p.ej. un fingerprint_list con 200
+// huellas) y lo manda en trozos de texto que entran en una trama:
+//   {"type":"chunk","transfer_id":7,"seq":0,"total_len":2345,"data":"{\"type\":\"publish\",..."}
+// Los trozos de una transferencia llegan en orden (TCP); un salto de seq, otro
+// transfer_id a mitad de camino o más bytes que total_len la descartan.
+// Una transferencia por conexión; el buffer se reserva una vez con total_len
+// (tope CHUNK_MAX_TRANSFER_BYTES) y se libera al entregar o descartar.
+class ChunkAssembler {
+public:
+    enum Result {
+        PENDING,    // faltan trozos
+        COMPLETE,   // mensaje completo: takeMessage()
+        REJECTED    // transferencia descartada: error()
+    };
+
+    ChunkAssembler();
+
+    Result add(uint32_t transferId, uint32_t seq, size_t totalLength,
+               const char* data, size_t length, unsigned long now);
+    // Entrega el mensaje rearmado y deja el ensamblador libre
+    String takeMessage();
+    void reset();
+
+    bool active() const { return inProgress; }
+    bool expired(unsigned long now) const {
+        return inProgress && now - lastChunkAt >= CHUNK_TRANSFER_TIMEOUT_MS;
+    }
+    unsigned long deadline() const { return lastChunkAt + CHUNK_TRANSFER_TIMEOUT_MS; }
+    uint32_t transfer() const { return transferId; }
+    size_t bufferedBytes() const { return buffer.length(); }
+    // Cota de valores JSON del mensaje (comas y aperturas fuera de strings),
+    // para dimensionar el documento antes de parsearlo
+    size_t valueCount() const { return values; }
+    const char* error() const { return lastError; }
+
+private:
+    String buffer;
+    uint32_t transferId;
+    uint32_t nextSeq;
+    size_t totalLength;
+    unsigned long lastChunkAt;
+    bool inProgress;
+    size_t values;
+    bool inString;   // estado del recuento entre trozos
+    bool escaped;
+    const char* lastError;
+
+    Result reject(const char* reason);
+    void scan(const char* data, size_t length);
+};
+
+#endif
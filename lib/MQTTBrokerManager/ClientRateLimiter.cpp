@@ -0,0 +1,26 @@
+#include "ClientRateLimiter.h"
+
+ClientRateLimiter::ClientRateLimiter()
+    : consecutiveDrops(0), droppedMessages(0), droppedBytes(0) {
+    reset(0);
+}
+
+void ClientRateLimiter::reset(unsigned long now) {
+    messages.configure(RATE_LIMIT_MESSAGES_PER_SEC, RATE_LIMIT_MESSAGE_BURST, now);
+    bytes.configure(RATE_LIMIT_BYTES_PER_SEC, RATE_LIMIT_BYTE_BURST, now);
+    consecutiveDrops = 0;
+    droppedMessages = 0;
+    droppedBytes = 0;
+}
+
+bool ClientRateLimiter::admit(size_t frameBytes, unsigned long now) {
+    // El balde de mensajes se consulta primero: un rechazo no gasta bytes
+    if (messages.consume(1, now) && bytes.consume((uint32_t)frameBytes, now)) {
+        consecutiveDrops = 0;
+        return true;
+    }
+    consecutiveDrops++;
+    droppedMessages++;
+    droppedBytes += frameBytes;
+    return false;
+}
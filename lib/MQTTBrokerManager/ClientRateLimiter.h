@@ -0,0 +1,77 @@
+#ifndef CLIENT_RATE_LIMITER_H
+#define CLIENT_RATE_LIMITER_H
+
+#include <Arduino.h>
+#include "../../include/config.h"
+
+// Token bucket en milésimas de token: rate tokens por segundo = rate milésimas
+// por ms, así el relleno no pierde precisión entre pasadas cortas del loop.
+class TokenBucket {
+public:
+    TokenBucket() : rate(0), capacity(0), level(0), lastRefill(0) {}
+
+    void configure(uint32_t ratePerSec, uint32_t burst, unsigned long now) {
+        rate = ratePerSec;
+        capacity = burst * 1000UL;
+        level = capacity;
+        lastRefill = now;
+    }
+
+    bool consume(uint32_t tokens, unsigned long now) {
+        refill(now);
+        uint32_t cost = tokens * 1000UL;
+        if (cost > level) return false;
+        level -= cost;
+        return true;
+    }
+
+private:
+    uint32_t rate;
+    uint32_t capacity;
+    uint32_t level;
+    unsigned long lastRefill;
+
+    void refill(unsigned long now) {
+        unsigned long elapsed = now - lastRefill;
+        lastRefill = now;
+        // Tras una pausa larga el balde ya estaría lleno (y se evita el overflow)
+        if (rate == 0 || elapsed >= (capacity / rate) + 1) {
+            level = capacity;
+            return;
+        }
+        uint32_t added = (uint32_t)elapsed * rate;
+        level = (capacity - level < added) ? capacity : level + added;
+    }
+};
+
+// Límite de mensajes y bytes entrantes de una conexión. admit() se consulta por
+// trama (línea JSON o paquete MQTT) antes de parsearla: lo que excede se descarta
+// sin costo de JSON, logs ni búsquedas en DeviceManager.
+class ClientRateLimiter {
+public:
+    enum Policy {
+        DROP,         // descartar la trama
+        DISCONNECT    // además, cortar tras RATE_LIMIT_DISCONNECT_AFTER descartes seguidos
+    };
+
+    ClientRateLimiter();
+
+    void reset(unsigned long now);
+    bool admit(size_t frameBytes, unsigned long now);
+
+    // ¿Se acaba de empezar a descartar? (para loguear una vez por episodio)
+    bool throttleStarted() const { return consecutiveDrops == 1; }
+    bool floodDetected() const { return consecutiveDrops >= (uint32_t)RATE_LIMIT_DISCONNECT_AFTER; }
+
+    unsigned long throttledMessages() const { return droppedMessages; }
+    unsigned long throttledBytes() const { return droppedBytes; }
+
+private:
+    TokenBucket messages;
+    TokenBucket bytes;
+    uint32_t consecutiveDrops;
+    unsigned long droppedMessages;
+    unsigned long droppedBytes;
+};
+
+#endif
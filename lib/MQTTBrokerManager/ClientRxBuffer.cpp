@@ -0,0 +1,207 @@
+#include "ClientRxBuffer.h"
+
+ClientRxBuffer::ClientRxBuffer() {
+    oversizedCount = 0;
+    reset();
+}
+
+void ClientRxBuffer::reset() {
+    head = 0;
+    count = 0;
+    scanned = 0;
+    discarding = false;
+    lengthDecoder.reset();
+    skipBytes = 0;
+    malformedStream = false;
+}
+
+void ClientRxBuffer::drop(size_t n) {
+    if (n > count) n = count;
+    head = (head + n) % MQTT_RX_BUFFER_SIZE;
+    count -= n;
+    scanned = (scanned > n) ? scanned - n : 0;
+}
+
+size_t ClientRxBuffer::fill(WiFiClient& client) {
+    int avail = client.available();
+    if (avail <= 0) return 0;
+
+    size_t freeSpace = MQTT_RX_BUFFER_SIZE - count;
+    size_t toRead = ((size_t)avail < freeSpace) ? (size_t)avail : freeSpace;
+    size_t total = 0;
+
+    // Hasta dos tramos contiguos (antes y después del wrap)
+    while (toRead > 0) {
+        size_t tail = (head + count) % MQTT_RX_BUFFER_SIZE;
+        size_t chunk = MQTT_RX_BUFFER_SIZE - tail;
+        if (chunk > toRead) chunk = toRead;
+        int n = client.read(&buffer[tail], chunk);
+        if (n <= 0) break;
+        count += n;
+        total += n;
+        toRead -= n;
+    }
+    return total;
+}
+
+void ClientRxBuffer::copyOut(String& out, size_t offset, size_t length) const {
+    // Puede cruzar el final del ring
+    out = "";
+    out.reserve(length);
+    size_t start = (head + offset) % MQTT_RX_BUFFER_SIZE;
+    size_t first = MQTT_RX_BUFFER_SIZE - start;
+    if (first > length) first = length;
+    out.concat((const char*)&buffer[start], first);
+    if (first < length) out.concat((const char*)&buffer[0], length - first);
+}
+
+bool ClientRxBuffer::nextLine(String& out) {
+    return readLine(out, 0);
+}
+
+uint8_t ClientRxBuffer::prefixedAhead(uint8_t accepted) const {
+    if (discarding || scanned != 0 || count == 0) return 0;
+    uint8_t lead = at(0);
+    if ((accepted & FORMAT_PACKED) && lead <= PACKED_LEAD_MAX) return FORMAT_PACKED;
+    if ((accepted & FORMAT_COMPRESSED) && (lead & COMPRESSED_LEAD_BIT) &&
+        (lead & ~COMPRESSED_LEAD_BIT) <= PACKED_LEAD_MAX) {
+        return FORMAT_COMPRESSED;
+    }
+    return 0;
+}
+
+bool ClientRxBuffer::nextFrame(String& out, uint8_t accepted, uint8_t& format) {
+    format = 0;
+    if (accepted == 0) return readLine(out, 0);
+
+    while (true) {
+        if (skipBytes > 0) {
+            // Resto de una trama con largo demasiado grande
+            size_t n = (skipBytes < count) ? skipBytes : count;
+            drop(n);
+            skipBytes -= n;
+            if (skipBytes > 0) return false;
+        }
+        // Blancos entre tramas (p.ej. "\r\n" tras la última línea JSON)
+        while (!discarding && scanned == 0 && count > 0 &&
+               (at(0) == '\r' || at(0) == '\n' || at(0) == ' ' || at(0) == '\t')) {
+            drop(1);
+        }
+        uint8_t ahead = prefixedAhead(accepted);
+        if (ahead == 0) {
+            if (readLine(out, accepted)) return true;
+            ahead = prefixedAhead(accepted);
+            if (ahead == 0) return false;
+        }
+
+        if (count < 2) return false;
+        size_t length = ((size_t)(at(0) & ~COMPRESSED_LEAD_BIT) << 8) | at(1);
+        if (length > (size_t)MQTT_MAX_FRAME_SIZE) {
+            oversizedCount++;
+            skipBytes = 2 + length;
+            continue;
+        }
+        if (count < 2 + length) return false;
+        copyOut(out, 2, length);
+        drop(2 + length);
+        if (length > 0) {
+            format = ahead;
+            return true;
+        }
+    }
+}
+
+bool ClientRxBuffer::readLine(String& out, uint8_t stopAt) {
+    while (true) {
+        // Lo que sigue es una trama con largo: la entrega nextFrame()
+        if (stopAt && prefixedAhead(stopAt)) return false;
+
+        // Buscar '\n' sólo en los bytes aún no revisados
+        size_t i = scanned;
+        while (i < count && at(i) != '\n') i++;
+
+        if (i == count) {
+            scanned = count;
+            // Línea parcial que ya no entra en una trama válida: descartar
+            if (!discarding && count > (size_t)MQTT_MAX_FRAME_SIZE) {
+                discarding = true;
+                oversizedCount++;
+            }
+            if (discarding) drop(count);
+            return false;
+        }
+
+        if (discarding) {
+            // Fin de la trama descartada
+            drop(i + 1);
+            discarding = false;
+            continue;
+        }
+
+        if (i > (size_t)MQTT_MAX_FRAME_SIZE) {
+            oversizedCount++;
+            drop(i + 1);
+            continue;
+        }
+
+        copyOut(out, 0, i);
+        drop(i + 1);
+
+        out.trim();
+        if (out.length() > 0) return true;
+    }
+}
+
+bool ClientRxBuffer::nextPacket(MqttPacket& out, uint8_t* scratch) {
+    while (true) {
+        if (skipBytes > 0) {
+            size_t n = (skipBytes < count) ? skipBytes : count;
+            drop(n);
+            skipBytes -= n;
+            if (skipBytes > 0) return false;
+        }
+        if (malformedStream || count < 2) return false;
+
+        // Seguir el header desde donde quedó la lectura anterior
+        while (lengthDecoder.status() == MqttLengthDecoder::NEED_MORE) {
+            size_t pos = 1 + lengthDecoder.bytesUsed();
+            if (pos >= count) return false;
+            lengthDecoder.feed(at(pos));
+        }
+        if (lengthDecoder.status() == MqttLengthDecoder::MALFORMED) {
+            malformedStream = true;
+            drop(count);
+            return false;
+        }
+
+        size_t headerLen = 1 + lengthDecoder.bytesUsed();
+        uint32_t bodyLen = lengthDecoder.length();
+        if (bodyLen > (uint32_t)MQTT_MAX_FRAME_SIZE) {
+            // Saltear el paquete completo aunque todavía no haya llegado
+            oversizedCount++;
+            skipBytes = headerLen + bodyLen;
+            lengthDecoder.reset();
+            continue;
+        }
+        if (count < headerLen + bodyLen) return false;
+
+        uint8_t first = at(0);
+        out.type = (MqttPacketType)(first >> 4);
+        out.flags = first & 0x0F;
+        out.length = bodyLen;
+
+        size_t start = (head + headerLen) % MQTT_RX_BUFFER_SIZE;
+        if (start + bodyLen <= (size_t)MQTT_RX_BUFFER_SIZE) {
+            out.body = &buffer[start];
+        } else {
+            size_t firstPart = MQTT_RX_BUFFER_SIZE - start;
+            memcpy(scratch, &buffer[start], firstPart);
+            memcpy(scratch + firstPart, &buffer[0], bodyLen - firstPart);
+            out.body = scratch;
+        }
+        // Los bytes siguen en el ring hasta el próximo fill()
+        drop(headerLen + bodyLen);
+        lengthDecoder.reset();
+        return true;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef CLIENT_RX_BUFFER_H
+#define CLIENT_RX_BUFFER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "../../include/config.h"
+#include "MqttCodec.h"
+
+// Ring buffer de recepción por slot de cliente.
+// fill() lee sólo lo que ya está disponible en el socket (nunca bloquea) y
+// nextLine() entrega únicamente líneas completas terminadas en '\n'.
+// Una línea que supera MQTT_MAX_FRAME_SIZE se descarta hasta el próximo '\n'
+// y se cuenta en oversizedFrames().
+//
+// Con MessagePack negociado, nextFrame() entrega además tramas con 2 bytes de
+// largo (big-endian) delante. Una línea JSON nunca empieza con un byte
+// <= PACKED_LEAD_MAX, así que cada trama se reconoce por su primer byte.
+// Con compresión negociada, lo mismo con el bit 0x80 en el primer byte: el
+// cuerpo es LZSS (nunca empieza así una línea JSON; 0x80-0xBF no abre UTF-8).
+//
+// Para clientes MQTT binarios se usa nextPacket() en lugar de nextLine():
+// el "remaining length" se decodifica a medida que llegan los bytes y el
+// paquete se entrega como vista dentro del ring (sin copiar) salvo que cruce
+// el final del buffer.
+class ClientRxBuffer {
+public:
+    ClientRxBuffer();
+
+    // Vaciar estado (nueva conexión / desconexión)
+    void reset();
+
+    // Leer del socket sin bloquear; devuelve bytes leídos
+    size_t fill(WiFiClient& client);
+
+    // Extraer la próxima línea completa (sin '\n' ni espacios extremos)
+    bool nextLine(String& out);
+
+    // Formatos de trama con largo delante, además de la línea JSON
+    static const uint8_t FORMAT_PACKED = 0x01;       // MessagePack
+    static const uint8_t FORMAT_COMPRESSED = 0x02;   // LZSS, ver Lzss.h
+
+    // Próxima línea JSON (format = 0) o trama de uno de los formatos aceptados
+    bool nextFrame(String& out, uint8_t accepted, uint8_t& format);
+
+    // Extraer el próximo paquete MQTT completo. out.body apunta al ring o a
+    // scratch (MQTT_MAX_FRAME_SIZE bytes) si el paquete cruza el final; válido
+    // hasta el próximo fill()
+    bool nextPacket(MqttPacket& out, uint8_t* scratch);
+
+    // Primer byte pendiente sin consumirlo (-1 si no hay datos)
+    int peek() const { return count > 0 ? at(0) : -1; }
+
+    // Remaining length inválido: el stream ya no se puede sincronizar
+    bool malformed() const { return malformedStream; }
+
+    size_t bufferedBytes() const { return count; }
+    unsigned long oversizedFrames() const { return oversizedCount; }
+
+private:
+    uint8_t buffer[MQTT_RX_BUFFER_SIZE];
+    size_t head;       // posición del primer byte válido
+    size_t count;      // bytes almacenados
+    size_t scanned;    // bytes ya revisados sin encontrar '\n'
+    bool discarding;   // descartando el resto de una trama demasiado grande
+    unsigned long oversizedCount;
+    MqttLengthDecoder lengthDecoder;   // header del paquete en curso
+    size_t skipBytes;                  // resto de un paquete MQTT demasiado grande
+    bool malformedStream;
+
+    // Primer byte de una trama con largo: el byte alto del largo (| 0x80 si va comprimida)
+    static const uint8_t PACKED_LEAD_MAX = (uint8_t)(MQTT_MAX_FRAME_SIZE >> 8);
+    static const uint8_t COMPRESSED_LEAD_BIT = 0x80;
+
+    uint8_t at(size_t offset) const { return buffer[(head + offset) % MQTT_RX_BUFFER_SIZE]; }
+    bool readLine(String& out, uint8_t stopAt);
+    // Formato de la trama con largo que empieza en el próximo byte (0 = ninguna)
+    uint8_t prefixedAhead(uint8_t accepted) const;
+    void copyOut(String& out, size_t offset, size_t length) const;
+    void drop(size_t n);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "ClientTxQueue.h"
+#include <errno.h>
+#include <string.h>
+#include <utility>
+#ifdef NATIVE_BUILD
+#include <sys/socket.h>
+#include <sys/uio.h>
+#else
+#include <lwip/sockets.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char LINE_TERMINATOR[] = "\r\n";
+
+ClientTxQueue::ClientTxQueue() {
+    maxDepth = 0;
+    dropped = 0;
+    overflowCount = 0;
+    terminatorLength = 2;
+    clear();
+}
+
+void ClientTxQueue::clear() {
+    messages.clear();
+    bytes = 0;
+    frontOffset = 0;
+}
+
+void ClientTxQueue::setLineFraming(bool enabled) {
+    if (!messages.empty()) return;
+    terminatorLength = enabled ? 2 : 0;
+}
+
+void ClientTxQueue::popFront() {
+    bytes -= frameLength(messages.front()) - frontOffset;
+    frontOffset = 0;
+    messages.pop_front();
+}
+
+bool ClientTxQueue::wouldOverflow(size_t len) const {
+    return messages.size() >= (size_t)MQTT_TX_QUEUE_MAX_MESSAGES ||
+           bytes + len > (size_t)MQTT_TX_QUEUE_MAX_BYTES;
+}
+
+bool ClientTxQueue::push(const SharedPayload& message, OverflowPolicy policy, bool raw) {
+    Entry entry{message, (uint8_t)(raw ? 0 : terminatorLength)};
+    size_t len = frameLength(entry);
+    if (wouldOverflow(len)) {
+        overflowCount++;
+        if (policy == DISCONNECT) return false;
+
+        // Más grande que toda la cola: no entra nunca, no vaciar la de nadie por él
+        if (len > (size_t)MQTT_TX_QUEUE_MAX_BYTES) {
+            dropped++;
+            return true;
+        }
+
+        while (!messages.empty() && wouldOverflow(len)) {
+            if (frontOffset > 0) {
+                // No cortar un mensaje a medio enviar (rompería el framing): descartar el siguiente
+                if (messages.size() < 2) break;
+                auto second = messages.begin() + 1;
+                bytes -= frameLength(*second);
+                messages.erase(second);
+            } else {
+                popFront();
+            }
+            dropped++;
+        }
+        // No alcanzó (sólo queda el mensaje a medio enviar): se descarta el nuevo,
+        // el tope no se pasa
+        if (wouldOverflow(len)) {
+            dropped++;
+            return true;
+        }
+    }
+
+    messages.push_back(std::move(entry));
+    bytes += len;
+    if (messages.size() > maxDepth) maxDepth = messages.size();
+    return true;
+}
+
+void ClientTxQueue::consume(size_t n) {
+    while (n > 0 && !messages.empty()) {
+        size_t remaining = frameLength(messages.front()) - frontOffset;
+        if (n >= remaining) {
+            n -= remaining;
+            popFront();
+        } else {
+            frontOffset += n;
+            bytes -= n;
+            n = 0;
+        }
+    }
+}
+
+int ClientTxQueue::flush(WiFiClient& client) {
+    if (messages.empty()) return 0;
+    int fd = client.fd();
+    if (fd < 0) return -1;
+
+    // Un tramo por cuerpo y otro por terminador, apuntando a los buffers compartidos
+    // (un único sendmsg por pasada, sin copiar a un scratch)
+    struct iovec iov[MQTT_TX_MAX_IOV];
+    int count = 0;
+    size_t len = 0;
+    size_t offset = frontOffset;
+    bool full = false;
+    for (auto it = messages.begin(); it != messages.end() && !full; ++it) {
+        const Entry& entry = *it;
+        for (int part = 0; part < 2; part++) {
+            const char* base = (part == 0) ? entry.payload.data() : LINE_TERMINATOR;
+            size_t partLen = (part == 0) ? entry.payload.length() : entry.terminator;
+            if (offset >= partLen) {
+                offset -= partLen;
+                continue;
+            }
+            if (count == MQTT_TX_MAX_IOV || len == (size_t)MQTT_TX_COALESCE_BYTES) {
+                full = true;
+                break;
+            }
+            size_t n = partLen - offset;
+            if (n > (size_t)MQTT_TX_COALESCE_BYTES - len) n = (size_t)MQTT_TX_COALESCE_BYTES - len;
+            iov[count].iov_base = (void*)(base + offset);
+            iov[count].iov_len = n;
+            count++;
+            len += n;
+            offset = 0;
+        }
+    }
+    if (count == 0) return 0;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    int sent = ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        return -1;
+    }
+    consume((size_t)sent);
+    return sent;
+}
@@ -0,0 +1,64 @@
+#ifndef CLIENT_TX_QUEUE_H
+#define CLIENT_TX_QUEUE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <deque>
+#include "../../include/config.h"
+#include "SharedPayload.h"
+
+// Cola de salida acotada por slot de cliente.
+// push() sólo encola una referencia a la trama (un broadcast a N clientes comparte
+// un único buffer); flush() manda varios mensajes pendientes en un único sendmsg
+// no bloqueante con un iovec por tramo, sin copiarlos a un buffer intermedio.
+// Si el socket no acepta más datos el resto queda en cola para la próxima pasada.
+class ClientTxQueue {
+public:
+    enum OverflowPolicy {
+        DROP_OLDEST,   // descartar los mensajes más antiguos para hacer lugar
+        DISCONNECT     // marcar el cliente para desconexión
+    };
+
+    ClientTxQueue();
+
+    void clear();
+
+    // true (default): cada mensaje es una línea y se le agrega "\r\n".
+    // false: tramas binarias (MQTT) que se envían tal cual. Sólo con la cola vacía
+    void setLineFraming(bool enabled);
+
+    // Encolar un mensaje (con framing de líneas se agrega "\r\n" al enviarlo). false = desbordó con política DISCONNECT.
+    // Con DROP_OLDEST, si descartar los anteriores no hace lugar se descarta éste (cuenta en droppedMessages)
+    // raw: trama que ya trae su propio largo (MessagePack), sin terminador aunque la cola sea de líneas
+    bool push(const SharedPayload& message, OverflowPolicy policy, bool raw = false);
+
+    // Enviar lo que se pueda sin bloquear (hasta MQTT_TX_COALESCE_BYTES). Devuelve bytes escritos o -1 si el socket falló
+    int flush(WiFiClient& client);
+
+    bool empty() const { return messages.empty(); }
+    size_t depth() const { return messages.size(); }
+    size_t queuedBytes() const { return bytes; }
+    size_t highWaterMark() const { return maxDepth; }
+    unsigned long droppedMessages() const { return dropped; }
+    unsigned long overflows() const { return overflowCount; }
+
+private:
+    struct Entry {
+        SharedPayload payload;   // el buffer se libera al salir de la última cola
+        uint8_t terminator;      // 2 ("\r\n") o 0
+    };
+    std::deque<Entry> messages;
+    size_t bytes;        // bytes pendientes (incluye terminadores)
+    size_t frontOffset;  // bytes del primer mensaje ya enviados
+    size_t maxDepth;
+    unsigned long dropped;
+    unsigned long overflowCount;
+    size_t terminatorLength;   // de los mensajes que no son raw: 2 ("\r\n") o 0 (binario)
+
+    static size_t frameLength(const Entry& entry) { return entry.payload.length() + entry.terminator; }
+    bool wouldOverflow(size_t len) const;
+    void popFront();
+    void consume(size_t n);
+};
+
+#endif
@@ -0,0 +1,274 @@
+#include "CommandOutbox.h"
+
+CommandOutbox::CommandOutbox(unsigned long now)
+    : retries(now), sentCount(0), unconfirmedCount(0), retransmitCount(0), busyCount(0), ackCount(0),
+      duplicateAckCount(0), expiredCount(0), offlineQueuedCount(0),
+      offlineExpiredCount(0), offlineDroppedCount(0) {}
+
+void CommandOutbox::submit(uint32_t requestId, const String& moduleId, const String& frame, unsigned long now) {
+    ModuleQueue& queue = modules[moduleId];
+
+    // Cola llena: se descarta el más antiguo que todavía espera salir
+    if (queue.entries.size() - queue.inFlight >= (size_t)COMMAND_OFFLINE_QUEUE_MAX) {
+        uint32_t oldest = queue.entries[queue.inFlight].requestId;
+        offlineDroppedCount++;
+        remove(oldest, now);
+        dropped.push_back(oldest);
+    }
+
+    Entry entry;
+    entry.requestId = requestId;
+    entry.frame = frame;
+    entry.attempts = 0;
+    entry.expiresAt = now + COMMAND_OFFLINE_TTL_MS;
+    // remove() pudo borrar la cola si quedó vacía: volver a buscarla
+    ModuleQueue& target = modules[moduleId];
+    target.entries.push_back(entry);
+    owners[requestId] = moduleId;
+
+    if (target.offline) {
+        offlineQueuedCount++;
+        scheduleTtl(entry, now);
+    } else {
+        pump(moduleId, now);
+    }
+}
+
+void CommandOutbox::setAcknowledging(const String& moduleId, bool enabled, unsigned long now) {
+    auto mod = modules.find(moduleId);
+    if (!enabled) {
+        if (ackingModules.erase(moduleId) == 0 || mod == modules.end()) return;
+        // Firmware nuevo sin ack: lo que ya salió no se reenvía
+        ModuleQueue& queue = mod->second;
+        for (size_t i = 0; i < queue.inFlight; i++) owners.erase(queue.entries[i].requestId);
+        queue.entries.erase(queue.entries.begin(), queue.entries.begin() + queue.inFlight);
+        queue.inFlight = 0;
+        if (queue.entries.empty() && !queue.offline) modules.erase(mod);
+        return;
+    }
+    if (!ackingModules.insert(moduleId).second) return;
+    if (mod != modules.end() && !mod->second.offline) pump(moduleId, now);
+}
+
+bool CommandOutbox::acknowledge(const String& moduleId, uint32_t requestId, unsigned long now) {
+    // Un ack demuestra que el módulo sabe confirmar, aunque no lo haya declarado
+    if (moduleId.length() > 0) ackingModules.insert(moduleId);
+    if (!remove(requestId, now)) {
+        duplicateAckCount++;
+        return false;
+    }
+    ackCount++;
+    return true;
+}
+
+bool CommandOutbox::settle(uint32_t requestId, unsigned long now) {
+    return remove(requestId, now);
+}
+
+void CommandOutbox::suspend(const String& moduleId, unsigned long now) {
+    // La cola se crea aunque esté vacía: lo que llegue mientras tanto espera
+    ModuleQueue& queue = modules[moduleId];
+    if (queue.offline) return;
+    queue.offline = true;
+    // Los que estaban en vuelo vuelven a la cola; al reconectar salen con "dup"
+    queue.inFlight = 0;
+    for (const Entry& entry : queue.entries) scheduleTtl(entry, now);
+}
+
+void CommandOutbox::resume(const String& moduleId, unsigned long now) {
+    auto mod = modules.find(moduleId);
+    if (mod == modules.end() || !mod->second.offline) return;
+    mod->second.offline = false;
+    if (mod->second.entries.empty()) {
+        modules.erase(mod);
+        return;
+    }
+    // Sale en el orden original, respetando la ventana
+    pump(moduleId, now);
+}
+
+void CommandOutbox::scheduleTtl(const Entry& entry, unsigned long now) {
+    // Ya vencido (p.ej. estuvo en vuelo mucho tiempo): se revisa en el próximo tick
+    unsigned long when = (long)(entry.expiresAt - now) > 0 ? entry.expiresAt : now;
+    retries.schedule(RetryKey{entry.requestId, 0, true}, when);
+}
+
+bool CommandOutbox::remove(uint32_t requestId, unsigned long now) {
+    auto owner = owners.find(requestId);
+    if (owner == owners.end()) return false;
+    String moduleId = owner->second;
+    owners.erase(owner);
+
+    auto mod = modules.find(moduleId);
+    if (mod == modules.end()) return false;
+    ModuleQueue& queue = mod->second;
+    for (size_t i = 0; i < queue.entries.size(); i++) {
+        if (queue.entries[i].requestId != requestId) continue;
+        if (i < queue.inFlight) queue.inFlight--;
+        queue.entries.erase(queue.entries.begin() + i);
+        break;
+    }
+    if (queue.entries.empty()) {
+        // Un módulo sin conexión conserva su cola (vacía) hasta resume()
+        if (!queue.offline) modules.erase(mod);
+    } else {
+        // Se liberó lugar en la ventana: sale el siguiente en cola
+        pump(moduleId, now);
+    }
+    return true;
+}
+
+void CommandOutbox::pump(const String& moduleId, unsigned long now) {
+    auto mod = modules.find(moduleId);
+    if (mod == modules.end()) return;
+    ModuleQueue& queue = mod->second;
+    bool acking = acknowledging(moduleId);
+    while (!queue.offline && queue.inFlight < queue.entries.size() &&
+           queue.inFlight < (size_t)COMMAND_INFLIGHT_WINDOW) {
+        TransmitResult sent = transmit(moduleId, queue.entries[queue.inFlight], now);
+        if (sent == TRANSMIT_OFFLINE) {
+            suspend(moduleId, now);
+            return;
+        }
+        // Ocupado: queda primero en la cola, lo retoma poll()
+        if (sent == TRANSMIT_BUSY) return;
+        if (acking) {
+            queue.inFlight++;
+            continue;
+        }
+        // Sin ack: salió una vez y no se vuelve a mandar (el módulo no sabe filtrar "dup")
+        owners.erase(queue.entries[queue.inFlight].requestId);
+        queue.entries.erase(queue.entries.begin() + queue.inFlight);
+    }
+    if (queue.entries.empty() && !queue.offline) modules.erase(mod);
+}
+
+CommandOutbox::TransmitResult CommandOutbox::transmit(const String& moduleId, Entry& entry, unsigned long now) {
+    if (!transmitter) return TRANSMIT_OFFLINE;
+    bool redelivery = entry.attempts > 0;
+    TransmitResult result;
+    if (redelivery) {
+        // Misma trama con "dup":true al principio del objeto
+        String dup = "{\"dup\":true,";
+        dup.concat(entry.frame.c_str() + 1);
+        result = transmitter(moduleId, dup);
+    } else {
+        result = transmitter(moduleId, entry.frame);
+    }
+    if (result == TRANSMIT_BUSY) {
+        // No salió: mismo intento más tarde, sin contar como envío
+        busyCount++;
+        retries.schedule(RetryKey{entry.requestId, entry.attempts, false}, now + COMMAND_BUSY_RETRY_MS);
+        return result;
+    }
+    if (result != TRANSMIT_OK) return result;
+    if (redelivery) retransmitCount++;
+    else sentCount++;
+    entry.attempts++;
+    if (acknowledging(moduleId)) {
+        retries.schedule(RetryKey{entry.requestId, entry.attempts, false}, now + backoff(entry.attempts));
+    } else {
+        unconfirmedCount++;
+    }
+    return TRANSMIT_OK;
+}
+
+unsigned long CommandOutbox::backoff(uint8_t attempts) {
+    unsigned long delay = COMMAND_RETRY_INITIAL_MS;
+    for (uint8_t i = 1; i < attempts && delay < COMMAND_RETRY_MAX_MS; i++) delay *= 2;
+    return delay < COMMAND_RETRY_MAX_MS ? delay : COMMAND_RETRY_MAX_MS;
+}
+
+void CommandOutbox::poll(unsigned long now, std::vector<uint32_t>& abandoned) {
+    if (!dropped.empty()) {
+        abandoned.insert(abandoned.end(), dropped.begin(), dropped.end());
+        dropped.clear();
+    }
+    if (retries.advance(now, expired) == 0) return;
+    for (const auto& timer : expired) {
+        auto owner = owners.find(timer.key.requestId);
+        if (owner == owners.end()) continue;   // ya confirmado o cancelado
+        String moduleId = owner->second;
+        ModuleQueue& queue = modules[moduleId];
+
+        // TTL: sólo cuenta si el módulo sigue sin conexión
+        if (timer.key.ttl) {
+            if (!queue.offline) continue;
+            for (const Entry& entry : queue.entries) {
+                if (entry.requestId != timer.key.requestId) continue;
+                if ((long)(now - entry.expiresAt) >= 0) {
+                    offlineExpiredCount++;
+                    remove(timer.key.requestId, now);
+                    abandoned.push_back(timer.key.requestId);
+                }
+                break;
+            }
+            continue;
+        }
+
+        if (queue.offline) continue;   // se reenvía al reconectar
+        Entry* entry = nullptr;
+        for (size_t i = 0; i < queue.inFlight; i++) {
+            if (queue.entries[i].requestId == timer.key.requestId) {
+                entry = &queue.entries[i];
+                break;
+            }
+        }
+        if (!entry) {
+            // El primero en espera no entró en la cola de salida: volver a intentar
+            if (queue.inFlight < queue.entries.size() &&
+                queue.entries[queue.inFlight].requestId == timer.key.requestId) {
+                pump(moduleId, now);
+            }
+            continue;
+        }
+        if (entry->attempts != timer.key.attempt) continue;
+
+        if (entry->attempts >= COMMAND_MAX_ATTEMPTS) {
+            uint32_t requestId = entry->requestId;
+            expiredCount++;
+            remove(requestId, now);
+            abandoned.push_back(requestId);
+        } else if (transmit(moduleId, *entry, now) == TRANSMIT_OFFLINE) {
+            suspend(moduleId, now);
+        }
+    }
+    expired.clear();
+}
+
+size_t CommandOutbox::inFlight() const {
+    size_t total = 0;
+    for (const auto& pair : modules) total += pair.second.inFlight;
+    return total;
+}
+
+size_t CommandOutbox::queued() const {
+    size_t total = 0;
+    for (const auto& pair : modules) total += pair.second.entries.size() - pair.second.inFlight;
+    return total;
+}
+
+void CommandOutbox::toJSON(JsonObject out) const {
+    out["window"] = COMMAND_INFLIGHT_WINDOW;
+    out["in_flight"] = inFlight();
+    out["queued"] = queued();
+    out["sent"] = sentCount;
+    out["unconfirmed"] = unconfirmedCount;
+    out["retransmissions"] = retransmitCount;
+    out["busy"] = busyCount;
+    out["acks"] = ackCount;
+    out["duplicate_acks"] = duplicateAckCount;
+    out["expired"] = expiredCount;
+    out["offline_queued"] = offlineQueuedCount;
+    out["offline_expired"] = offlineExpiredCount;
+    out["offline_dropped"] = offlineDroppedCount;
+
+    JsonObject byModule = out.createNestedObject("by_module");
+    for (const auto& pair : modules) {
+        JsonObject mod = byModule.createNestedObject(pair.first);
+        mod["in_flight"] = pair.second.inFlight;
+        mod["queued"] = pair.second.entries.size() - pair.second.inFlight;
+        mod["offline"] = pair.second.offline;
+        mod["acks"] = acknowledging(pair.first);
+    }
+}
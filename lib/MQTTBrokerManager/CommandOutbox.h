@@ -0,0 +1,116 @@
+#ifndef COMMAND_OUTBOX_H
+#define COMMAND_OUTBOX_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+#include "../../include/config.h"
+#include "../TimerWheel/TimerWheel.h"
+
+// Entrega confirmada de comandos (estilo QoS 1) con ventana por módulo.
+// Hasta COMMAND_INFLIGHT_WINDOW comandos por módulo salen sin esperar confirmación
+// (pipelining); el resto espera en cola hasta que un "command_ack" (o la respuesta
+// correlacionada) libera lugar. Un comando sin confirmar se reenvía con "dup":true
+// y backoff exponencial; el módulo usa el request_id para no ejecutarlo dos veces.
+// Tras COMMAND_MAX_ATTEMPTS envíos sin confirmación se abandona.
+//
+// Todo eso sólo para los módulos que confirman: los que lo declararon en el
+// registro ("delivery": ["ack"]) o ya mandaron algún command_ack. Al resto (firmware
+// anterior) cada comando sale una sola vez, sin ventana ni "dup", como antes.
+//
+// Si la ruta está ocupada (cola de salida llena, TRANSMIT_BUSY) el comando no
+// cuenta como enviado: sigue en su lugar y se reintenta a COMMAND_BUSY_RETRY_MS.
+// Si el módulo no tiene conexión (TRANSMIT_OFFLINE) su cola queda
+// suspendida: los comandos esperan, en orden y como mucho COMMAND_OFFLINE_TTL_MS,
+// hasta que resume() (el módulo vuelve a registrarse) los vuelve a enviar.
+// La cola por módulo se limita a COMMAND_OFFLINE_QUEUE_MAX; al llenarse se
+// descarta el comando más antiguo que todavía no salió.
+class CommandOutbox {
+public:
+    enum TransmitResult {
+        TRANSMIT_OK,        // encolada en el socket del módulo
+        TRANSMIT_BUSY,      // hay ruta pero no entró (cola de salida llena): reintentar
+        TRANSMIT_OFFLINE    // no hubo a quién mandarla: suspender hasta resume()
+    };
+    // Envía la trama por la ruta actual del módulo
+    typedef std::function<TransmitResult(const String& moduleId, const String& frame)> Transmit;
+
+    explicit CommandOutbox(unsigned long now = 0);
+
+    void setTransmitter(Transmit transmit) { transmitter = transmit; }
+
+    // El módulo confirma con command_ack (declarado en el registro o visto un ack)
+    void setAcknowledging(const String& moduleId, bool enabled, unsigned long now);
+    bool acknowledging(const String& moduleId) const { return ackingModules.count(moduleId) > 0; }
+
+    // Encolar; sale enseguida si la ventana del módulo tiene lugar
+    void submit(uint32_t requestId, const String& moduleId, const String& frame, unsigned long now);
+    // "command_ack" de moduleId. false = desconocido (ack duplicado o de un comando ya cerrado)
+    bool acknowledge(const String& moduleId, uint32_t requestId, unsigned long now);
+    // Cerrar sin ack explícito: llegó la respuesta (confirma implícitamente)
+    bool settle(uint32_t requestId, unsigned long now);
+
+    // El módulo perdió / recuperó su conexión
+    void suspend(const String& moduleId, unsigned long now);
+    void resume(const String& moduleId, unsigned long now);
+
+    // Reenviar los vencidos. Los abandonados (sin confirmar, TTL vencido o
+    // desplazados por cola llena) se agregan a abandoned
+    void poll(unsigned long now, std::vector<uint32_t>& abandoned);
+    bool nextDeadline(unsigned long& when) const { return retries.nextDeadline(when); }
+    bool hasDropped() const { return !dropped.empty(); }
+
+    size_t inFlight() const;
+    size_t queued() const;
+    void toJSON(JsonObject out) const;
+
+private:
+    struct Entry {
+        uint32_t requestId;
+        String frame;
+        uint8_t attempts;   // envíos hechos (0 = nunca salió)
+        unsigned long expiresAt;   // vencimiento si el módulo sigue sin conexión
+    };
+    // Los primeros inFlight de entries ya salieron; el resto espera lugar en la ventana
+    struct ModuleQueue {
+        std::deque<Entry> entries;
+        size_t inFlight = 0;
+        bool offline = false;   // sin conexión: nada sale hasta resume()
+    };
+    struct RetryKey {
+        uint32_t requestId;
+        uint8_t attempt;    // attempts al programar; otro valor = evento obsoleto
+        bool ttl;           // false = reintento, true = revisar expiresAt (cola offline)
+    };
+
+    std::map<String, ModuleQueue> modules;
+    std::map<uint32_t, String> owners;   // requestId -> moduleId
+    TimerWheel<RetryKey> retries;
+    std::vector<TimerWheel<RetryKey>::Timer> expired;
+    Transmit transmitter;
+    std::vector<uint32_t> dropped;   // desplazados en submit(), se informan en poll()
+    std::set<String> ackingModules;
+
+    unsigned long sentCount;
+    unsigned long unconfirmedCount;   // enviados a módulos sin ack (una sola vez)
+    unsigned long retransmitCount;
+    unsigned long busyCount;          // envíos postergados por cola de salida llena
+    unsigned long ackCount;
+    unsigned long duplicateAckCount;
+    unsigned long expiredCount;
+    unsigned long offlineQueuedCount;
+    unsigned long offlineExpiredCount;
+    unsigned long offlineDroppedCount;
+
+    bool remove(uint32_t requestId, unsigned long now);
+    void pump(const String& moduleId, unsigned long now);
+    TransmitResult transmit(const String& moduleId, Entry& entry, unsigned long now);
+    void scheduleTtl(const Entry& entry, unsigned long now);
+    static unsigned long backoff(uint8_t attempts);
+};
+
+#endif
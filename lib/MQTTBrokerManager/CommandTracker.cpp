@@ -0,0 +1,168 @@
+#include "CommandTracker.h"
+#include <string.h>
+
+// Resultado de cada comando de módulo (sin el argumento: "enroll_user:Ana" -> enroll_user).
+// Sólo se usa para los módulos que no devuelven request_id
+static const struct {
+    const char* command;
+    const char* replyType;
+} REPLY_TYPES[] = {
+    { "scan_fingerprint",      "fingerprint_scan_result" },
+    { "enroll_user",           "fingerprint_enroll_result" },
+    { "delete_user",           "fingerprint_delete_result" },
+    { "list_all_fingerprints", "fingerprint_list" },
+    // Nombres de capacidad que manda la interfaz web
+    { "scan",                  "fingerprint_scan_result" },
+    { "enroll",                "fingerprint_enroll_result" },
+    { "delete",                "fingerprint_delete_result" },
+    { "list",                  "fingerprint_list" },
+};
+
+CommandTracker::CommandTracker(unsigned long now)
+    : deadlines(now), nextId(1), completedTotal(0), timeoutTotal(0), duplicateReplies(0) {}
+
+uint32_t CommandTracker::track(const String& moduleId, const String& command, unsigned long now,
+                               unsigned long timeoutMs, Callback onComplete) {
+    // Tabla llena: el pedido más antiguo se da por vencido
+    if (requests.size() >= (size_t)COMMAND_MAX_PENDING) {
+        finish(requests.begin(), false, false, JsonVariantConst(), now);
+    }
+
+    uint32_t id = nextId++;
+    if (nextId == 0) nextId = 1;
+
+    Pending& entry = requests[id];
+    entry.moduleId = moduleId;
+    entry.command = command;
+    entry.sentAt = now;
+    entry.deadline = now + timeoutMs;
+    entry.onComplete = onComplete;
+    deadlines.schedule(id, entry.deadline);
+    return id;
+}
+
+bool CommandTracker::complete(uint32_t requestId, JsonVariantConst reply, unsigned long now) {
+    auto it = requests.find(requestId);
+    if (it == requests.end()) {
+        duplicateReplies++;
+        return false;
+    }
+    echoingModules.insert(it->second.moduleId);
+    finish(it, true, true, reply, now);
+    return true;
+}
+
+bool CommandTracker::abandon(uint32_t requestId, unsigned long now) {
+    auto it = requests.find(requestId);
+    if (it == requests.end()) return false;
+    finish(it, false, false, JsonVariantConst(), now);
+    return true;
+}
+
+const char* CommandTracker::replyTypeFor(const String& command) {
+    int colon = command.indexOf(':');
+    String key = colon >= 0 ? command.substring(0, colon) : command;
+    for (const auto& entry : REPLY_TYPES) {
+        if (key == entry.command) return entry.replyType;
+    }
+    return nullptr;
+}
+
+bool CommandTracker::completeOldest(const String& moduleId, const char* replyType, JsonVariantConst reply,
+                                    unsigned long now) {
+    // Un módulo que devuelve request_id manda sin él sólo mensajes que no son respuestas
+    if (!replyType || echoingModules.count(moduleId)) return false;
+    for (auto it = requests.begin(); it != requests.end(); ++it) {
+        if (it->second.moduleId != moduleId) continue;
+        // Un evento espontáneo (publish, estado...) no es la respuesta de nadie
+        const char* expected = replyTypeFor(it->second.command);
+        if (expected && strcmp(expected, replyType) == 0) {
+            finish(it, true, false, reply, now);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandTracker::hasPending(const String& moduleId) const {
+    for (const auto& pair : requests) {
+        if (pair.second.moduleId == moduleId) return true;
+    }
+    return false;
+}
+
+void CommandTracker::expire(unsigned long now) {
+    if (deadlines.advance(now, expired) == 0) return;
+    for (const auto& timer : expired) {
+        // Los ya completados no se borran de la rueda: se descartan acá
+        auto it = requests.find(timer.key);
+        if (it != requests.end()) finish(it, false, false, JsonVariantConst(), now);
+    }
+    expired.clear();
+}
+
+void CommandTracker::finish(std::map<uint32_t, Pending>::iterator it, bool completed, bool correlated,
+                            JsonVariantConst reply, unsigned long now) {
+    // Sacar de la tabla antes del callback (puede enviar otro comando)
+    uint32_t id = it->first;
+    Pending entry = it->second;
+    requests.erase(it);
+
+    unsigned long rtt = now - entry.sentAt;
+    // "enroll_user:Ana" y "enroll_user:Luis" cuentan como el mismo comando
+    int colon = entry.command.indexOf(':');
+    String commandKey = colon >= 0 ? entry.command.substring(0, colon) : entry.command;
+    record(byModule[entry.moduleId], completed, rtt);
+    record(byCommand[commandKey], completed, rtt);
+    if (completed) completedTotal++;
+    else timeoutTotal++;
+
+    if (entry.onComplete) {
+        Result result;
+        result.requestId = id;
+        result.completed = completed;
+        result.correlated = correlated;
+        result.rttMs = completed ? rtt : 0;
+        result.moduleId = &entry.moduleId;
+        result.command = &entry.command;
+        result.reply = reply;
+        entry.onComplete(result);
+    }
+}
+
+void CommandTracker::record(LatencyStats& stats, bool completed, unsigned long rttMs) {
+    if (!completed) {
+        stats.timeouts++;
+        return;
+    }
+    if (stats.completed == 0 || rttMs < stats.minMs) stats.minMs = rttMs;
+    if (rttMs > stats.maxMs) stats.maxMs = rttMs;
+    stats.lastMs = rttMs;
+    stats.totalMs += rttMs;
+    stats.completed++;
+}
+
+void CommandTracker::statsToJSON(const LatencyStats& stats, JsonObject out) {
+    out["completed"] = stats.completed;
+    out["timeouts"] = stats.timeouts;
+    out["last_ms"] = stats.lastMs;
+    out["min_ms"] = stats.minMs;
+    out["max_ms"] = stats.maxMs;
+    out["avg_ms"] = stats.completed ? stats.totalMs / stats.completed : 0;
+}
+
+void CommandTracker::toJSON(JsonObject out) const {
+    out["pending"] = requests.size();
+    out["completed"] = completedTotal;
+    out["timeouts"] = timeoutTotal;
+    out["duplicate_replies"] = duplicateReplies;
+
+    JsonObject modules = out.createNestedObject("by_module");
+    for (const auto& pair : byModule) {
+        statsToJSON(pair.second, modules.createNestedObject(pair.first));
+    }
+    JsonObject commands = out.createNestedObject("by_command");
+    for (const auto& pair : byCommand) {
+        statsToJSON(pair.second, commands.createNestedObject(pair.first));
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef COMMAND_TRACKER_H
+#define COMMAND_TRACKER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+#include "../../include/config.h"
+#include "../TimerWheel/TimerWheel.h"
+
+// Tabla de comandos enviados a módulos que esperan respuesta.
+// Cada comando sale con un "request_id"; cuando llega la respuesta con el mismo
+// id (o, para módulos que nunca lo devolvieron, el primer mensaje del módulo con
+// el tipo de resultado de ese comando) se completa el pedido, se llama al callback y se registra el round-trip.
+// Los plazos vencen en una TimerWheel: el callback recibe completed = false.
+class CommandTracker {
+public:
+    struct Result {
+        uint32_t requestId;
+        bool completed;            // false = venció el plazo (o se desalojó)
+        bool correlated;           // true = llegó con su request_id (no por completeOldest)
+        unsigned long rttMs;       // sólo si completed
+        const String* moduleId;
+        const String* command;
+        JsonVariantConst reply;    // documento de respuesta; nulo si !completed
+    };
+    typedef std::function<void(const Result&)> Callback;
+
+    // Latencias acumuladas (por módulo y por comando)
+    struct LatencyStats {
+        unsigned long completed = 0;
+        unsigned long timeouts = 0;
+        unsigned long lastMs = 0;
+        unsigned long minMs = 0;
+        unsigned long maxMs = 0;
+        unsigned long totalMs = 0;
+    };
+
+    explicit CommandTracker(unsigned long now = 0);
+
+    // Registrar un comando enviado; devuelve su request_id (nunca 0)
+    uint32_t track(const String& moduleId, const String& command, unsigned long now,
+                   unsigned long timeoutMs, Callback onComplete);
+
+    // Respuesta con request_id explícito. false si no había pedido pendiente
+    bool complete(uint32_t requestId, JsonVariantConst reply, unsigned long now);
+    // Respuesta sin request_id: completa el pedido más antiguo del módulo cuyo
+    // comando contesta con replyType (ver REPLY_TYPES). Nada si el módulo ya
+    // devolvió algún request_id o si el tipo no es el resultado de un pendiente
+    bool completeOldest(const String& moduleId, const char* replyType, JsonVariantConst reply,
+                        unsigned long now);
+    // Tipo del mensaje con que el módulo contesta a command; nullptr = desconocido
+    static const char* replyTypeFor(const String& command);
+
+    // Cerrar como vencido antes del plazo (p.ej. la entrega se abandonó)
+    bool abandon(uint32_t requestId, unsigned long now);
+
+    // Vencer los pedidos cuyo plazo pasó
+    void expire(unsigned long now);
+    bool nextDeadline(unsigned long& when) const { return deadlines.nextDeadline(when); }
+
+    bool hasPending(const String& moduleId) const;
+    size_t pending() const { return requests.size(); }
+    unsigned long completedCount() const { return completedTotal; }
+    unsigned long timeoutCount() const { return timeoutTotal; }
+    unsigned long duplicateCount() const { return duplicateReplies; }
+
+    void toJSON(JsonObject out) const;
+
+private:
+    struct Pending {
+        String moduleId;
+        String command;
+        unsigned long sentAt;
+        unsigned long deadline;
+        Callback onComplete;
+    };
+
+    // Ordenado por id = orden de envío (completeOldest toma el primero del módulo)
+    std::map<uint32_t, Pending> requests;
+    TimerWheel<uint32_t> deadlines;
+    std::vector<TimerWheel<uint32_t>::Timer> expired;
+    uint32_t nextId;
+    unsigned long completedTotal;
+    unsigned long timeoutTotal;
+    unsigned long duplicateReplies;   // request_id ya cerrado (reenvío respondido dos veces)
+    std::set<String> echoingModules;   // ya devolvieron un request_id: sin heurística
+    std::map<String, LatencyStats> byModule;
+    std::map<String, LatencyStats> byCommand;
+
+    void finish(std::map<uint32_t, Pending>::iterator it, bool completed, bool correlated,
+                JsonVariantConst reply, unsigned long now);
+    static void record(LatencyStats& stats, bool completed, unsigned long rttMs);
+    static void statsToJSON(const LatencyStats& stats, JsonObject out);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "JsonDocumentPool.h"
+
+JsonDocumentPool::JsonDocumentPool() : used(0), peak(0), acquired(0), heapFallbacks(0) {
+    for (int i = 0; i < JSON_POOL_DOCUMENTS; i++) {
+        documents[i] = new DynamicJsonDocument(JSON_POOL_DOC_CAPACITY);
+        leased[i] = false;
+    }
+}
+
+JsonDocumentPool::~JsonDocumentPool() {
+    for (int i = 0; i < JSON_POOL_DOCUMENTS; i++) {
+        delete documents[i];
+    }
+}
+
+int JsonDocumentPool::take(size_t capacity) {
+    acquired++;
+    if (capacity <= (size_t)JSON_POOL_DOC_CAPACITY) {
+        for (int i = 0; i < JSON_POOL_DOCUMENTS; i++) {
+            // capacity() == 0 si la reserva inicial falló: no usar ese slot
+            if (!leased[i] && documents[i]->capacity() > 0) {
+                leased[i] = true;
+                used++;
+                if (used > peak) peak = used;
+                return i;
+            }
+        }
+    }
+    heapFallbacks++;
+    return -1;
+}
+
+void JsonDocumentPool::give(int slot) {
+    documents[slot]->clear();
+    leased[slot] = false;
+    used--;
+}
+
+JsonDocumentPool::Lease::Lease(JsonDocumentPool* pool, size_t capacity)
+    : pool(pool), slot(-1), document(nullptr) {
+    if (pool) slot = pool->take(capacity);
+    if (slot >= 0) {
+        document = pool->documents[slot];
+    } else {
+        document = new DynamicJsonDocument(capacity);
+    }
+}
+
+JsonDocumentPool::Lease::~Lease() {
+    if (slot >= 0) {
+        pool->give(slot);
+    } else {
+        delete document;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef JSON_DOCUMENT_POOL_H
+#define JSON_DOCUMENT_POOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "../../include/config.h"
+
+// Documentos JSON reservados una sola vez al arrancar y reutilizados por mensaje.
+// Un DynamicJsonDocument por mensaje hace malloc/free del tamaño del documento
+// en cada trama; tras horas de uptime eso fragmenta el heap del ESP32-C3.
+//
+// Uso:
+//   JsonDocumentPool::Lease lease(pool, 256);
+//   JsonDocument& doc = *lease;
+// Al salir del scope el documento se limpia y vuelve al pool. Si no quedan
+// libres (o se pide más capacidad que la del slot) se usa un documento del heap
+// y se cuenta como fallback.
+class JsonDocumentPool {
+public:
+    class Lease {
+    public:
+        Lease(JsonDocumentPool* pool, size_t capacity);
+        Lease(JsonDocumentPool& pool, size_t capacity) : Lease(&pool, capacity) {}
+        ~Lease();
+
+        JsonDocument& operator*() { return *document; }
+        JsonDocument* operator->() { return document; }
+        bool pooled() const { return slot >= 0; }
+
+    private:
+        JsonDocumentPool* pool;
+        int slot;
+        JsonDocument* document;
+
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+    };
+
+    JsonDocumentPool();
+    ~JsonDocumentPool();
+
+    size_t capacity() const { return JSON_POOL_DOC_CAPACITY; }
+    int inUse() const { return used; }
+    int peakInUse() const { return peak; }
+    unsigned long acquisitions() const { return acquired; }
+    unsigned long fallbacks() const { return heapFallbacks; }
+
+private:
+    DynamicJsonDocument* documents[JSON_POOL_DOCUMENTS];
+    bool leased[JSON_POOL_DOCUMENTS];
+    int used;
+    int peak;
+    unsigned long acquired;
+    unsigned long heapFallbacks;
+
+    int take(size_t capacity);
+    void give(int slot);
+
+    JsonDocumentPool(const JsonDocumentPool&);
+    JsonDocumentPool& operator=(const JsonDocumentPool&);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "Lzss.h"
+#include <string.h>
+
+void Lzss::insert(const uint8_t* input, size_t length, size_t pos) {
+    if (pos + MIN_MATCH > length) return;
+    size_t h = hash(input + pos);
+    prev[pos % WINDOW] = head[h];
+    head[h] = (uint16_t)(pos + 1);
+}
+
+size_t Lzss::compress(const uint8_t* input, size_t length, uint8_t* out, size_t capacity) {
+    if (length == 0 || length > MAX_INPUT) return 0;
+    memset(head, 0, sizeof(head));
+
+    size_t outPos = 0;
+    size_t flagPos = 0;
+    int flagBit = 8;   // 8 = abrir un grupo nuevo
+    size_t pos = 0;
+    while (pos < length) {
+        if (flagBit == 8) {
+            if (outPos >= capacity) return 0;
+            flagPos = outPos++;
+            out[flagPos] = 0;
+            flagBit = 0;
+        }
+
+        // Referencia más larga entre los últimos candidatos con el mismo hash
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        if (pos + MIN_MATCH <= length) {
+            size_t maxLength = length - pos < MAX_MATCH ? length - pos : MAX_MATCH;
+            uint16_t candidate = head[hash(input + pos)];
+            for (int chain = 0; candidate != 0 && chain < MAX_CHAIN; chain++) {
+                size_t start = candidate - 1;
+                size_t distance = pos - start;
+                // Más atrás que la ventana: prev[] de ahí ya se reutilizó
+                if (distance > WINDOW) break;
+                size_t n = 0;
+                while (n < maxLength && input[start + n] == input[pos + n]) n++;
+                if (n > bestLength) {
+                    bestLength = n;
+                    bestDistance = distance;
+                    if (n == maxLength) break;
+                }
+                candidate = prev[start % WINDOW];
+            }
+        }
+
+        size_t advance;
+        if (bestLength >= MIN_MATCH) {
+            if (outPos + 2 > capacity) return 0;
+            uint16_t token = (uint16_t)(((bestDistance - 1) << 6) | (bestLength - MIN_MATCH));
+            out[outPos++] = (uint8_t)(token >> 8);
+            out[outPos++] = (uint8_t)token;
+            advance = bestLength;
+        } else {
+            if (outPos >= capacity) return 0;
+            out[flagPos] |= (uint8_t)(1 << flagBit);
+            out[outPos++] = input[pos];
+            advance = 1;
+        }
+        flagBit++;
+        for (size_t end = pos + advance; pos < end; pos++) insert(input, length, pos);
+    }
+    return outPos;
+}
+
+bool Lzss::expand(const uint8_t* input, size_t length, uint8_t* out, size_t expectedLength) {
+    size_t inPos = 0;
+    size_t outPos = 0;
+    while (outPos < expectedLength) {
+        if (inPos >= length) return false;
+        uint8_t flags = input[inPos++];
+        for (int bit = 0; bit < 8 && outPos < expectedLength; bit++) {
+            if (flags & (1 << bit)) {
+                if (inPos >= length) return false;
+                out[outPos++] = input[inPos++];
+                continue;
+            }
+            if (inPos + 2 > length) return false;
+            uint16_t token = (uint16_t)((input[inPos] << 8) | input[inPos + 1]);
+            inPos += 2;
+            size_t distance = (size_t)(token >> 6) + 1;
+            size_t n = (size_t)(token & 0x3F) + MIN_MATCH;
+            if (distance > outPos || n > expectedLength - outPos) return false;
+            // Byte a byte: la copia puede solaparse con lo que va escribiendo
+            for (; n > 0; n--, outPos++) out[outPos] = out[outPos - distance];
+        }
+    }
+    // Sobrantes = stream corrupto o largo declarado incorrecto
+    return inPos == length;
+}
@@ -0,0 +1,43 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compresor LZSS para tramas grandes (listas de dispositivos y de huellas):
+// JSON muy repetitivo que en un AP de 2.4 GHz cargado cuesta tiempo de aire.
+// Formato: grupos de un byte de banderas (bit 0 primero) y hasta 8 elementos.
+//   bandera 1: un byte literal
+//   bandera 0: referencia de 2 bytes big-endian (distancia-1) << 6 | (largo-MIN_MATCH),
+//              copia "largo" bytes desde "distancia" atrás en lo ya expandido
+// No depende de Arduino ni de config.h: el cliente de ejemplo compila el mismo archivo.
+class Lzss {
+public:
+    static const size_t WINDOW = 1024;             // distancia máxima de una referencia
+    static const size_t MIN_MATCH = 3;
+    static const size_t MAX_MATCH = MIN_MATCH + 63;
+    static const size_t MAX_INPUT = 0xFFFE;        // posiciones en uint16_t
+
+    // Comprime input en out; 0 si no entra en capacity (o input vacío / > MAX_INPUT)
+    size_t compress(const uint8_t* input, size_t length, uint8_t* out, size_t capacity);
+
+    // Expande exactamente expectedLength bytes en out; false si el stream es inválido
+    static bool expand(const uint8_t* input, size_t length, uint8_t* out, size_t expectedLength);
+
+private:
+    static const size_t HASH_SIZE = 1024;
+    static const int MAX_CHAIN = 16;   // candidatos revisados por posición
+
+    // Posición + 1 (0 = ninguna) de la última aparición de cada hash de 3 bytes,
+    // y de la anterior con el mismo hash, indexada por posición % WINDOW
+    uint16_t head[HASH_SIZE];
+    uint16_t prev[WINDOW];
+
+    static size_t hash(const uint8_t* p) {
+        uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+        return (v * 2654435761u) >> 22;   // 10 bits altos: HASH_SIZE entradas
+    }
+    void insert(const uint8_t* input, size_t length, size_t pos);
+};
+
+#endif
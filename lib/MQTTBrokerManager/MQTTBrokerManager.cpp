@@ -1,15 +1,45 @@
 #include "MQTTBrokerManager.h"
 #include "WiFiManager.h"
 #include "DeviceManager.h"
+#include "../Logger/Logger.h"
+#include <memory>
+#include <new>
+#include <utility>
 
-// Constructor: inicializar mqttServer y arrays
+// Sockets que lwIP permite abrir en total (sdkconfig de arduino-esp32)
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+static const int LWIP_SOCKET_BUDGET = CONFIG_LWIP_MAX_SOCKETS;
+#else
+static const int LWIP_SOCKET_BUDGET = 64;   // build nativo: el límite es el del sistema
+#endif
+
+// Constructor: inicializar arrays (el listener y los sockets son de BrokerIo)
 MQTTBrokerManager::MQTTBrokerManager(WiFiManager* wifiMgr, DeviceManager* deviceMgr)
-    : mqttServer(MQTT_PORT), wifiManager(wifiMgr), deviceManager(deviceMgr) {
+    : wifiManager(wifiMgr), deviceManager(deviceMgr), pingTimers(millis()), commandTracker(millis()), commandOutbox(millis()) {
     // Inicializar arrays
     for (int i = 0; i < MAX_CLIENTS; ++i) {
         clientConnected[i] = false;
         lastHeartbeatSent[i] = 0;
+        slotGeneration[i] = 0;
+        clientProtocol[i] = PROTOCOL_PENDING;
+        mqttSessionOpen[i] = false;
+        mqttKeepAlive[i] = 0;
+        lastRxAt[i] = 0;
+        answersPings[i] = false;
+        pongPending[i] = false;
+        clientPacked[i] = false;
+        packedOffered[i] = false;
+        clientCompressed[i] = false;
+        compressionOffered[i] = false;
     }
+    // Con sockets de sobra queda MAX_CLIENTS; si no, lo que entre
+    maxClients = clientSocketBudget() < MAX_CLIENTS ? clientSocketBudget() : MAX_CLIENTS;
+    if (maxClients < 1) maxClients = 1;
+    txOverflowPolicy = MQTT_TX_DISCONNECT_ON_OVERFLOW ? ClientTxQueue::DISCONNECT : ClientTxQueue::DROP_OLDEST;
+    rateLimitPolicy = RATE_LIMIT_DISCONNECT_ON_FLOOD ? ClientRateLimiter::DISCONNECT : ClientRateLimiter::DROP;
+    commandOutbox.setTransmitter([this](const String& moduleId, const String& frame) {
+        return transmitCommand(moduleId, frame);
+    });
 }
 
 void MQTTBrokerManager::setDeviceManager(DeviceManager* deviceMgr) {
@@ -17,41 +47,103 @@ void MQTTBrokerManager::setDeviceManager(DeviceManager* deviceMgr) {
 }
 
 void MQTTBrokerManager::initialize() {
-    Serial.println("📡 Inicializando MQTT Broker Manager...");
+    LOG_I("📡 Inicializando MQTT Broker Manager...");
     
-    // Inicializar servidor MQTT
-    mqttServer.begin();
-    Serial.print("✅ Servidor MQTT iniciado en puerto ");
-    Serial.println(MQTT_PORT);
+    // Inicializar servidor MQTT y la tarea de E/S
+    io.begin(maxClients, txOverflowPolicy);
+    LOG_I("✅ Servidor MQTT iniciado en puerto %d", MQTT_PORT);
+    if (!io.start()) {
+        LOG_W("⚠️ No se pudo crear la tarea de E/S: sockets atendidos en loop()");
+    } else if (io.threaded()) {
+        LOG_I("🧵 E/S del broker en tarea propia (rings de %d/%d tramas)", BROKER_IO_INBOUND_DEPTH,
+              BROKER_IO_OUTBOUND_DEPTH);
+    }
+    if (maxClients < MAX_CLIENTS) {
+        LOG_W("⚠️ Clientes limitados a %d: CONFIG_LWIP_MAX_SOCKETS=%d y %d reservados", maxClients,
+              LWIP_SOCKET_BUDGET, LWIP_RESERVED_SOCKETS);
+    }
 }
 
-void MQTTBrokerManager::handleNewConnections() {
-    WiFiClient newClient = mqttServer.available();
-    
-    if (newClient) {
-        // Buscar slot disponible
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!clientConnected[i]) {
-                mqttClients[i] = newClient;
-                clientConnected[i] = true;
-                lastHeartbeatSent[i] = millis();
-                
-                Serial.print("Nuevo cliente conectado en slot ");
-                Serial.println(i);
-                
-                // Enviar mensaje de bienvenida
-                sendWelcomeMessage(i);
-                break;
-            }
-        }
+int MQTTBrokerManager::clientSocketBudget() {
+    return LWIP_SOCKET_BUDGET - LWIP_RESERVED_SOCKETS;
+}
+
+bool MQTTBrokerManager::setMaxClients(int limit) {
+    if (limit < 1 || limit > MAX_CLIENTS) {
+        LOG_W("[MQTTBrokerManager] max_clients %d fuera de rango (1..%d)", limit, MAX_CLIENTS);
+        return false;
+    }
+    if (limit > clientSocketBudget()) {
+        LOG_W("[MQTTBrokerManager] max_clients %d no entra en lwIP (%d sockets, %d reservados)", limit,
+              LWIP_SOCKET_BUDGET, LWIP_RESERVED_SOCKETS);
+        return false;
     }
+    maxClients = limit;
+    // Los slots libres los administra la tarea de E/S
+    io.setMaxClients(limit);
+    LOG_I("[MQTTBrokerManager] max_clients = %d", maxClients);
+    return true;
+}
+
+void MQTTBrokerManager::onClientConnected(int i, uint32_t generation, const String& ip) {
+    clientConnected[i] = true;
+    slotGeneration[i] = generation;
+    clientIp[i] = ip;
+    lastHeartbeatSent[i] = millis();
+    pingTimers.schedule(PingTimer{i, generation}, lastHeartbeatSent[i] + CLIENT_PING_INTERVAL);
+    rateLimiters[i].reset(lastHeartbeatSent[i]);
+    lastRxAt[i] = lastHeartbeatSent[i];
+    answersPings[i] = false;
+    pongPending[i] = false;
+
+    // El protocolo lo decide la tarea con el primer byte: la bienvenida JSON
+    // se manda recién entonces (un cliente MQTT no la entendería)
+    clientProtocol[i] = PROTOCOL_PENDING;
+    mqttSessionOpen[i] = false;
+    clientPacked[i] = false;
+    packedOffered[i] = false;
+    clientCompressed[i] = false;
+    compressionOffered[i] = false;
+
+    LOG_I("Nuevo cliente conectado en slot %d (%s)", i, ip.c_str());
+}
+
+void MQTTBrokerManager::onClientClosed(int i, BrokerIo::CloseReason reason) {
+    switch (reason) {
+        case BrokerIo::CLOSE_PEER:
+            LOG_I("Cliente %d desconectado", i);
+            break;
+        case BrokerIo::CLOSE_WRITE_ERROR:
+            LOG_W("⚠️ Error de escritura en cliente %d", i);
+            break;
+        case BrokerIo::CLOSE_TX_OVERFLOW:
+            LOG_W("🔌 Cliente %d desconectado por cola de salida saturada", i);
+            break;
+        case BrokerIo::CLOSE_TX_STALLED:
+            LOG_W("🔌 Cliente %d desconectado: cola de salida sin drenar", i);
+            stalledEvictions++;
+            break;
+        case BrokerIo::CLOSE_MALFORMED:
+            LOG_W("⚠️ Remaining length inválido del cliente MQTT %d -> desconectando", i);
+            break;
+    }
+    // El socket ya lo cerró la tarea: sólo falta el estado de loop()
+    resetClient(i);
 }
 
 // sendWelcomeMessage: usar DynamicJsonDocument y enviar string
 void MQTTBrokerManager::sendWelcomeMessage(int clientIndex) {
-    DynamicJsonDocument welcome(256);
+    JsonDocumentPool::Lease welcomeLease(jsonPool, 256);
+    JsonDocument& welcome = *welcomeLease;
     welcome["type"] = "welcome";
     welcome["message"] = "Welcome to embedded broker";
+    // Codificaciones que se pueden pedir en el registro ("encodings")
+    JsonArray encodings = welcome.createNestedArray("encodings");
+    encodings.add("json");
+    if (msgpackNegotiation) encodings.add("msgpack");
+    JsonArray compression = welcome.createNestedArray("compression");
+    compression.add("none");
+    if (compressionNegotiation) compression.add("lzss");
     String out;
     serializeJson(welcome, out);
     sendToClient(clientIndex, out);
@@ -59,7 +151,8 @@ void MQTTBrokerManager::sendWelcomeMessage(int clientIndex) {
 
 // sendAuthSuccessMessage: usar DynamicJsonDocument local y enviar
 void MQTTBrokerManager::sendAuthSuccessMessage(int clientIndex, const String& macAddress, const String& apiKey) {
-    DynamicJsonDocument authSuccess(256);
+    JsonDocumentPool::Lease authSuccessLease(jsonPool, 256);
+    JsonDocument& authSuccess = *authSuccessLease;
     authSuccess["type"] = "auth_success";
     authSuccess["mac_address"] = macAddress;
     authSuccess["api_key"] = apiKey;
@@ -68,11 +161,12 @@ void MQTTBrokerManager::sendAuthSuccessMessage(int clientIndex, const String& ma
 
     // Enviar al cliente si está conectado
     if (clientIndex >= 0 && clientIndex < MAX_CLIENTS && clientConnected[clientIndex]) {
-        mqttClients[clientIndex].println(authStr);
+        enqueueToClient(clientIndex, authStr);
     }
 
     // Construir y enviar registration response también con DynamicJsonDocument
-    DynamicJsonDocument regResponse(256);
+    JsonDocumentPool::Lease regResponseLease(jsonPool, 256);
+    JsonDocument& regResponse = *regResponseLease;
     regResponse["type"] = "registration_response";
     regResponse["status"] = "success";
     regResponse["mac_address"] = macAddress;
@@ -80,20 +174,22 @@ void MQTTBrokerManager::sendAuthSuccessMessage(int clientIndex, const String& ma
     serializeJson(regResponse, regStr);
 
     if (clientIndex >= 0 && clientIndex < MAX_CLIENTS && clientConnected[clientIndex]) {
-        mqttClients[clientIndex].println(regStr);
+        enqueueToClient(clientIndex, regStr);
     }
 }
 
 String MQTTBrokerManager::getClientIP(int clientIndex) {
     if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return String("NA");
     if (!clientConnected[clientIndex]) return String("NA");
-    return mqttClients[clientIndex].remoteIP().toString();
+    return clientIp[clientIndex];
 }
 
 void MQTTBrokerManager::sendToAllClients(const String& message) {
+    SharedPayload shared(message);   // un solo buffer para todos los destinatarios
+    FrameVariants variants;
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clientConnected[i]) {
-            mqttClients[i].println(message);
+            enqueueToClient(i, shared, &variants);
         }
     }
 }
@@ -101,138 +197,765 @@ void MQTTBrokerManager::sendToAllClients(const String& message) {
 void MQTTBrokerManager::sendToClient(int clientIndex, const String& payload) {
     if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return;
     if (!clientConnected[clientIndex]) return;
-    mqttClients[clientIndex].println(payload);
+    enqueueToClient(clientIndex, payload);
 }
 
-void MQTTBrokerManager::processClientMessages() {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientConnected[i] && mqttClients[i].available()) {
-            String message = mqttClients[i].readStringUntil('\n');
-            message.trim();
-            
-            if (message.length() > 0) {
-                processMessage(i, message);
-            }
+// Todo envío pasa a la tarea de E/S, que lo encola en el slot y hace la escritura real
+bool MQTTBrokerManager::enqueueToClient(int clientIndex, const String& payload) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS || !clientConnected[clientIndex]) return false;
+    if (clientProtocol[clientIndex] == PROTOCOL_MQTT) return false;
+    SharedPayload shared(payload);
+    if (shared.empty() && payload.length() > 0) {
+        txAllocFailures++;
+        LOG_W("⚠️ Sin memoria para la trama de cliente %d (%u bytes): descartada", clientIndex, (unsigned)payload.length());
+        return false;
+    }
+    return enqueueToClient(clientIndex, shared);
+}
+
+bool MQTTBrokerManager::enqueueToClient(int clientIndex, const SharedPayload& payload, FrameVariants* variants) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS || !clientConnected[clientIndex]) return false;
+    // Mensajes JSON (comandos, broadcasts...): un cliente MQTT binario no los entiende
+    if (clientProtocol[clientIndex] == PROTOCOL_MQTT) return false;
+    // Todas vienen de un texto no vacío: vacía = falló la reserva (broadcast, publish...)
+    if (payload.empty()) {
+        txAllocFailures++;
+        return false;
+    }
+    FrameVariants local;
+    FrameVariants& v = variants ? *variants : local;
+    // Las tramas cortas no se comprimen: expandirlas cuesta más de lo que ahorran en el aire
+    if (clientCompressed[clientIndex] && payload.length() >= (size_t)COMPRESSION_THRESHOLD_BYTES) {
+        if (!v.compressTried) {
+            v.compressTried = true;
+            compressFrame(payload, v.compressed);
         }
-        
-        // Verificar si el cliente sigue conectado
-        if (clientConnected[i] && !mqttClients[i].connected()) {
-            Serial.print("Cliente ");
-            Serial.print(i);
-            Serial.println(" desconectado");
-            clientConnected[i] = false;
-            lastHeartbeatSent[i] = 0;
+        if (!v.compressed.empty()) {
+            compressedFramesSent++;
+            compressedBytesIn += payload.length();
+            compressedBytesOut += v.compressed.length();
+            return pushFrame(clientIndex, v.compressed, false, true);
+        }
+    }
+    if (clientPacked[clientIndex]) {
+        if (!v.packTried) {
+            v.packTried = true;
+            packFrame(payload, v.packed);
+        }
+        // Lo que no entra en una trama MessagePack sale como línea JSON (el módulo acepta ambas)
+        if (!v.packed.empty()) {
+            packedFramesSent++;
+            return pushFrame(clientIndex, v.packed, false, true);
         }
     }
+    return pushFrame(clientIndex, payload, false);
 }
 
-void MQTTBrokerManager::processMessage(int clientIndex, String payload) {
-    Serial.print("[MQTTBrokerManager] Cliente ");
-    Serial.print(clientIndex);
-    Serial.print(" envió: ");
-    Serial.println(payload);
+// Trama armada desde un documento: MessagePack directo para los clientes que lo negociaron
+bool MQTTBrokerManager::sendDocument(int clientIndex, const JsonDocument& doc) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS || !clientConnected[clientIndex]) return false;
+    if (clientProtocol[clientIndex] == PROTOCOL_MQTT) return false;
+    if (clientCompressed[clientIndex] && measureJson(doc) >= (size_t)COMPRESSION_THRESHOLD_BYTES) {
+        String out;
+        serializeJson(doc, out);
+        return enqueueToClient(clientIndex, SharedPayload(out));
+    }
+    SharedPayload packed;
+    if (clientPacked[clientIndex] && packDocument(doc, packed)) {
+        packedFramesSent++;
+        return pushFrame(clientIndex, packed, false, true);
+    }
+    String out;
+    serializeJson(doc, out);
+    return pushFrame(clientIndex, SharedPayload(out), false);
+}
 
-    DynamicJsonDocument doc(1024);
-    DeserializationError err = deserializeJson(doc, payload);
-    if (err) {
-        Serial.print("[MQTTBrokerManager] JSON parse error: ");
-        Serial.println(err.c_str());
+// 2 bytes de largo (big-endian) + MessagePack. false = no entra en MQTT_MAX_FRAME_SIZE
+bool MQTTBrokerManager::packDocument(const JsonDocument& doc, SharedPayload& out) {
+    if (measureMsgPack(doc) > (size_t)MQTT_MAX_FRAME_SIZE) return false;
+    size_t length = serializeMsgPack(doc, packScratch + 2, MQTT_MAX_FRAME_SIZE);
+    if (length == 0) return false;
+    packScratch[0] = (uint8_t)(length >> 8);
+    packScratch[1] = (uint8_t)length;
+    out = SharedPayload((const char*)packScratch, length + 2);
+    return !out.empty();   // sin heap: sale como línea JSON
+}
+
+// Mensajes que ya vienen serializados como texto (comandos guardados, broadcasts)
+bool MQTTBrokerManager::packFrame(const SharedPayload& json, SharedPayload& out) {
+    JsonDocumentPool::Lease docLease(jsonPool, MQTT_MAX_FRAME_SIZE + 256);
+    JsonDocument& doc = *docLease;
+    if (deserializeJson(doc, json.data(), json.length())) return false;
+    return packDocument(doc, out);
+}
+
+// 2 bytes de largo con el bit 0x80 + largo expandido (big-endian) + stream LZSS.
+// false = no achica o no entra en MQTT_MAX_FRAME_SIZE: sale como siempre
+bool MQTTBrokerManager::compressFrame(const SharedPayload& json, SharedPayload& out) {
+    if (json.length() > (size_t)COMPRESSION_MAX_INFLATED_BYTES) return false;
+    size_t streamLength = lzss.compress((const uint8_t*)json.data(), json.length(),
+                                        compressScratch + 4, MQTT_MAX_FRAME_SIZE - 2);
+    if (streamLength == 0) return false;
+    size_t bodyLength = 2 + streamLength;
+    // Contra la línea JSON con su "\r\n"
+    if (2 + bodyLength >= json.length() + 2) return false;
+    compressScratch[0] = (uint8_t)(0x80 | (bodyLength >> 8));
+    compressScratch[1] = (uint8_t)bodyLength;
+    compressScratch[2] = (uint8_t)(json.length() >> 8);
+    compressScratch[3] = (uint8_t)json.length();
+    out = SharedPayload((const char*)compressScratch, 2 + bodyLength);
+    return true;
+}
+
+// Cota del documento para un JSON más largo que una trama: un valor por coma o
+// apertura fuera de strings + el texto (los strings se copian), como en handleChunk
+static size_t documentCapacityFor(const String& json) {
+    size_t values = 1;
+    bool inString = false;
+    bool escaped = false;
+    for (size_t i = 0; i < json.length(); i++) {
+        char c = json[i];
+        if (inString) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == ',' || c == '[' || c == '{') {
+            values++;
+        }
+    }
+    return JSON_ARRAY_SIZE(values) + json.length();
+}
+
+// Trama LZSS de un módulo: se expande y se procesa como la línea JSON original
+void MQTTBrokerManager::expandFrame(int clientIndex, const String& body) {
+    compressedFramesReceived++;
+    size_t length = body.length() > 2 ? ((size_t)(uint8_t)body[0] << 8) | (uint8_t)body[1] : 0;
+    if (length == 0 || length > (size_t)COMPRESSION_MAX_INFLATED_BYTES) {
+        compressedFramesInvalid++;
+        LOG_W("⚠️ Trama comprimida de cliente %d: largo expandido %u fuera de rango", clientIndex, (unsigned)length);
+        return;
+    }
+    std::unique_ptr<uint8_t[]> inflated(new (std::nothrow) uint8_t[length]);
+    if (!inflated || !Lzss::expand((const uint8_t*)body.c_str() + 2, body.length() - 2, inflated.get(), length)) {
+        compressedFramesInvalid++;
+        LOG_W("⚠️ Trama comprimida de cliente %d inválida o sin memoria: descartada", clientIndex);
+        return;
+    }
+    String message;
+    if (!message.reserve(length)) {
+        compressedFramesInvalid++;
         return;
     }
+    message.concat((const char*)inflated.get(), length);
+    inflated.reset();
 
-    // Extraer tipo de mensaje de forma segura
-    String msgType = "";
-    if (doc.containsKey("type") && doc["type"].is<const char*>()) {
-        msgType = String((const char*)doc["type"]);
-    } else if (doc.containsKey("type")) {
-        String tmp; serializeJson(doc["type"], tmp); msgType = tmp;
-    }
-    Serial.print("[MQTTBrokerManager] 🔍 Tipo de mensaje identificado: '");
-    Serial.print(msgType);
-    Serial.println("'");
-
-    if (msgType == "module_registration") {
-        Serial.println("[MQTTBrokerManager] Dispatching module_registration -> DeviceManager::handleModuleRegistration");
-        if (deviceManager) deviceManager->handleModuleRegistration(clientIndex, (JsonDocument&)doc, &mqttClients[clientIndex]);
-    } else if (msgType == "mac_response" || msgType == "mac") {
-        Serial.println("[MQTTBrokerManager] Dispatching mac_response -> DeviceManager::handleMACResponse");
-        if (deviceManager) deviceManager->handleMACResponse(clientIndex, (JsonDocument&)doc);
-        // Si llegaron mac y module_id, marcar como conectado
-        if (doc.containsKey("mac_address") && doc["mac_address"].is<const char*>()) {
-            String mac = String((const char*)doc["mac_address"]);
-            String ip = mqttClients[clientIndex].remoteIP().toString();
-            if (deviceManager) deviceManager->markDeviceConnected(mac, clientIndex, ip);
-        }
-    } else if (msgType == "device_info" || msgType == "info_response") {
-        Serial.println("[MQTTBrokerManager] Dispatching device_info -> DeviceManager::handleDeviceInfoResponse");
-        if (deviceManager) deviceManager->handleDeviceInfoResponse(clientIndex, (JsonDocument&)doc);
-    } else if (msgType == "scan_response" || msgType == "device_scan") {
-        Serial.println("[MQTTBrokerManager] Dispatching scan_response -> DeviceManager::handleDeviceScanResponse");
-        if (deviceManager) deviceManager->handleDeviceScanResponse(clientIndex, (JsonDocument&)doc);
-    } else if (msgType == "heartbeat") {
-        Serial.println("[MQTTBrokerManager] Heartbeat recibido -> procesando");
-        if (doc.containsKey("module_id") && doc["module_id"].is<const char*>()) {
-            String mid = String((const char*)doc["module_id"]);
-            Serial.print("[MQTTBrokerManager] Heartbeat de module_id: ");
-            Serial.println(mid);
-            if (deviceManager) deviceManager->updateModuleHeartbeat(mid);
-
-            // Intentar resolver MAC a partir de moduleId y marcar conectado
-            if (deviceManager) {
-                String macFromModule = deviceManager->getMacByModuleId(mid);
-                if (macFromModule.length() > 0) {
-                    String ip = mqttClients[clientIndex].remoteIP().toString();
-                    deviceManager->markDeviceConnected(macFromModule, clientIndex, ip);
-                    deviceManager->reportScannedDevice(macFromModule, "", mid, clientIndex);
-                }
+    size_t capacity = documentCapacityFor(message);
+    if (capacity > (size_t)CHUNK_MAX_DOC_BYTES) {
+        compressedFramesInvalid++;
+        LOG_W("⚠️ Trama comprimida de cliente %d: %u bytes de documento superan CHUNK_MAX_DOC_BYTES",
+              clientIndex, (unsigned)capacity);
+        return;
+    }
+    processMessage(clientIndex, std::move(message), capacity < 1024 ? 1024 : capacity);
+}
+
+// Tras la respuesta que anunció "encoding" / "compression", que ya salió como JSON
+void MQTTBrokerManager::applyOfferedEncoding(int clientIndex) {
+    if (!packedOffered[clientIndex] && !compressionOffered[clientIndex]) return;
+    if (packedOffered[clientIndex] && !clientPacked[clientIndex]) {
+        clientPacked[clientIndex] = true;
+        LOG_I("Cliente %d usa MessagePack", clientIndex);
+    }
+    if (compressionOffered[clientIndex] && !clientCompressed[clientIndex]) {
+        clientCompressed[clientIndex] = true;
+        LOG_I("Cliente %d usa compresión LZSS (tramas de %d bytes o más)", clientIndex, COMPRESSION_THRESHOLD_BYTES);
+    }
+    packedOffered[clientIndex] = false;
+    compressionOffered[clientIndex] = false;
+    uint8_t formats = (clientPacked[clientIndex] ? BrokerIo::FRAME_PACKED : 0) |
+                      (clientCompressed[clientIndex] ? BrokerIo::FRAME_COMPRESSED : 0);
+    io.setInputFormats(clientIndex, slotGeneration[clientIndex], formats);
+}
+
+const char* MQTTBrokerManager::offerEncoding(int clientIndex, JsonVariantConst requested) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return "json";
+    if (clientPacked[clientIndex]) return "msgpack";
+    bool wantsPacked = false;
+    if (requested.is<JsonArrayConst>()) {
+        // Orden de preferencia del módulo: la primera que el broker soporta
+        for (JsonVariantConst encoding : requested.as<JsonArrayConst>()) {
+            const char* name = encoding | "";
+            if (strcmp(name, "json") == 0) break;
+            if (strcmp(name, "msgpack") == 0) {
+                wantsPacked = true;
+                break;
             }
         }
-        if (doc.containsKey("mac_address") && doc["mac_address"].is<const char*>()) {
-            String mac = String((const char*)doc["mac_address"]);
-            String ip = mqttClients[clientIndex].remoteIP().toString();
-            Serial.print("[MQTTBrokerManager] Heartbeat incluye MAC: ");
-            Serial.println(mac);
-            if (deviceManager) deviceManager->markDeviceConnected(mac, clientIndex, ip);
-            // Reportar también a scannedDevices
-            String mid = (doc.containsKey("module_id") && doc["module_id"].is<const char*>()) ? String((const char*)doc["module_id"]) : String("");
-            if (deviceManager) deviceManager->reportScannedDevice(mac, "", mid, clientIndex);
-        }
-    } else if (msgType == "ping_response") {
-        // Cliente respondió a ping: si incluye module_id o mac_address, marcar como conectado
-        Serial.println("[MQTTBrokerManager] ping_response recibido");
-        if (doc.containsKey("module_id") && doc["module_id"].is<const char*>()) {
-            String mid = String((const char*)doc["module_id"]);
-            if (deviceManager) deviceManager->updateModuleHeartbeat(mid);
-            if (deviceManager) {
-                String macFromModule = deviceManager->getMacByModuleId(mid);
-                if (macFromModule.length() > 0) {
-                    String ip = mqttClients[clientIndex].remoteIP().toString();
-                    deviceManager->markDeviceConnected(macFromModule, clientIndex, ip);
-                }
+    }
+    packedOffered[clientIndex] = wantsPacked && msgpackNegotiation;
+    return packedOffered[clientIndex] ? "msgpack" : "json";
+}
+
+const char* MQTTBrokerManager::offerDelivery(const String& moduleId, JsonVariantConst requested) {
+    bool acks = false;
+    if (requested.is<JsonArrayConst>()) {
+        for (JsonVariantConst mode : requested.as<JsonArrayConst>()) {
+            if (strcmp(mode | "", "ack") == 0) {
+                acks = true;
+                break;
+            }
+        }
+    }
+    // Se vuelve a evaluar en cada registro: un módulo reflasheado con firmware viejo deja de recibir "dup"
+    commandOutbox.setAcknowledging(moduleId, acks, millis());
+    return acks ? "ack" : "none";
+}
+
+const char* MQTTBrokerManager::offerCompression(int clientIndex, JsonVariantConst requested) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return "none";
+    if (clientCompressed[clientIndex]) return "lzss";
+    bool wantsLzss = false;
+    if (requested.is<JsonArrayConst>()) {
+        for (JsonVariantConst codec : requested.as<JsonArrayConst>()) {
+            if (strcmp(codec | "", "lzss") == 0) {
+                wantsLzss = true;
+                break;
+            }
+        }
+    }
+    compressionOffered[clientIndex] = wantsLzss && compressionNegotiation;
+    return compressionOffered[clientIndex] ? "lzss" : "none";
+}
+
+bool MQTTBrokerManager::enqueueMqttFrame(int clientIndex, const String& frame) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS || !clientConnected[clientIndex]) return false;
+    if (clientProtocol[clientIndex] != PROTOCOL_MQTT) return false;
+    return pushFrame(clientIndex, SharedPayload(frame), true);
+}
+
+bool MQTTBrokerManager::enqueueMqttFrame(int clientIndex, const SharedPayload& frame) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS || !clientConnected[clientIndex]) return false;
+    if (clientProtocol[clientIndex] != PROTOCOL_MQTT) return false;
+    return pushFrame(clientIndex, frame, true);
+}
+
+bool MQTTBrokerManager::pushFrame(int clientIndex, const SharedPayload& payload, bool binary, bool raw) {
+    if (!io.send(clientIndex, slotGeneration[clientIndex], payload, binary, raw)) {
+        LOG_W("⚠️ Ring de salida lleno: trama para cliente %d descartada", clientIndex);
+        return false;
+    }
+    return true;
+}
+
+// Próximo instante en que el slot puede quedar vencido (false = sin plazo)
+bool MQTTBrokerManager::livenessDeadline(int clientIndex, unsigned long& when) {
+    bool any = false;
+    auto earliest = [&](unsigned long t) {
+        if (!any || (long)(t - when) < 0) when = t;
+        any = true;
+    };
+    if (pongPending[clientIndex]) earliest(lastHeartbeatSent[clientIndex] + CLIENT_PONG_TIMEOUT_MS);
+    if (clientProtocol[clientIndex] == PROTOCOL_MQTT) {
+        // MQTT 3.1.1: 1.5 x keepalive sin recibir nada; keepalive 0 = sin límite
+        if (mqttKeepAlive[clientIndex] > 0) earliest(lastRxAt[clientIndex] + mqttKeepAlive[clientIndex] * 1500UL);
+    } else {
+        earliest(lastRxAt[clientIndex] + CLIENT_IDLE_TIMEOUT_MS);
+    }
+    if (chunkAssemblers[clientIndex].active()) earliest(chunkAssemblers[clientIndex].deadline());
+    return any;
+}
+
+// Slots muertos (ping sin respuesta, silencio) vuelven al pool. La cola que no
+// drena la corta la tarea de E/S y llega como CLOSE_TX_STALLED
+void MQTTBrokerManager::evictDeadClients() {
+    unsigned long now = millis();
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!clientConnected[i]) continue;
+        if (chunkAssemblers[i].expired(now)) {
+            // El emisor dejó de mandar trozos: liberar el buffer sin cortar la conexión
+            LOG_W("⚠️ Transferencia %lu de cliente %d vencida con %u bytes",
+                  (unsigned long)chunkAssemblers[i].transfer(), i, (unsigned)chunkAssemblers[i].bufferedBytes());
+            chunkAssemblers[i].reset();
+            chunkTransfersExpired++;
+        }
+        const char* reason = nullptr;
+        if (pongPending[i] && now - lastHeartbeatSent[i] >= CLIENT_PONG_TIMEOUT_MS) {
+            reason = "sin respuesta al ping";
+            pongEvictions++;
+        } else if (clientProtocol[i] == PROTOCOL_MQTT) {
+            if (mqttKeepAlive[i] > 0 && now - lastRxAt[i] >= mqttKeepAlive[i] * 1500UL) {
+                reason = "keepalive MQTT vencido";
+                idleEvictions++;
             }
+        } else if (now - lastRxAt[i] >= CLIENT_IDLE_TIMEOUT_MS) {
+            reason = "inactivo";
+            idleEvictions++;
+        }
+        if (reason) {
+            LOG_W("🔌 Cliente %d desconectado: %s", i, reason);
+            disconnectClient(i);
+        }
+    }
+}
+
+void MQTTBrokerManager::setTxOverflowPolicy(ClientTxQueue::OverflowPolicy policy) {
+    txOverflowPolicy = policy;
+    io.setTxOverflowPolicy(policy);
+}
+
+void MQTTBrokerManager::setRateLimitPolicy(ClientRateLimiter::Policy policy) {
+    rateLimitPolicy = policy;
+}
+
+void MQTTBrokerManager::processClientMessages() {
+    bool anyDispatched = false;
+    rxBacklog = false;
+    io.clearWakeup();
+    // Tope por pasada: web, consola y timers no esperan a que se vacíe el ring
+    for (int handled = 0; ; handled++) {
+        if (handled == BROKER_IO_INBOUND_DEPTH) {
+            rxBacklog = true;
+            break;
+        }
+        BrokerIo::Event* event = io.nextEvent();
+        if (!event) break;
+
+        int i = event->slot;
+        // Eventos de una conexión que loop() ya cerró (o de antes de reusar el slot): se descartan
+        bool current = i >= 0 && i < MAX_CLIENTS && clientConnected[i] && slotGeneration[i] == event->generation;
+        switch (event->kind) {
+            case BrokerIo::Event::CONNECTED:
+                onClientConnected(i, event->generation, event->data);
+                break;
+            case BrokerIo::Event::REFUSED:
+                LOG_W("⛔ Conexión rechazada: %d/%d clientes", getConnectedClientsCount(), maxClients);
+                break;
+            case BrokerIo::Event::PROTOCOL:
+                if (current) setClientProtocol(i, event->value == BrokerIo::PROTOCOL_MQTT ? PROTOCOL_MQTT : PROTOCOL_JSON);
+                break;
+            case BrokerIo::Event::FRAME:
+                if (current) {
+                    dispatchFrame(i, *event);
+                    anyDispatched = true;
+                }
+                break;
+            case BrokerIo::Event::OVERSIZED:
+                if (current) LOG_W("⚠️ Trama demasiado grande descartada del cliente %d (máx %d bytes)", i, MQTT_MAX_FRAME_SIZE);
+                break;
+            case BrokerIo::Event::CLOSED:
+                if (current) onClientClosed(i, (BrokerIo::CloseReason)event->value);
+                break;
         }
-        if (doc.containsKey("mac_address") && doc["mac_address"].is<const char*>()) {
-            String mac = String((const char*)doc["mac_address"]);
-            String ip = mqttClients[clientIndex].remoteIP().toString();
-            if (deviceManager) deviceManager->markDeviceConnected(mac, clientIndex, ip);
+        io.releaseEvent();
+    }
+
+    // Registrar el peor bloque contiguo visto tras procesar tráfico
+    if (anyDispatched) sampleHeap();
+}
+
+void MQTTBrokerManager::dispatchFrame(int i, BrokerIo::Event& event) {
+    // Cualquier trama cuenta como señal de vida (y como respuesta al ping)
+    lastRxAt[i] = millis();
+    pongPending[i] = false;
+
+    if (clientProtocol[i] == PROTOCOL_MQTT) {
+        MqttPacket packet;
+        packet.type = (MqttPacketType)event.value;
+        packet.flags = event.flags;
+        packet.body = (const uint8_t*)event.data.c_str();
+        packet.length = event.data.length();
+        // + cabecera fija (tipo y remaining length)
+        if (admitFrame(i, packet.length + 2)) processMqttPacket(i, packet);
+    } else if (admitFrame(i, event.data.length())) {
+        if (event.flags & BrokerIo::FRAME_COMPRESSED) {
+            expandFrame(i, event.data);
+            return;
         }
+        bool packed = (event.flags & BrokerIo::FRAME_PACKED) != 0;
+        if (packed) packedFramesReceived++;
+        processMessage(i, std::move(event.data), 1024, packed);
+    }
+}
+
+// Token buckets del slot, antes de gastar nada en la trama
+bool MQTTBrokerManager::admitFrame(int clientIndex, size_t frameBytes) {
+    ClientRateLimiter& limiter = rateLimiters[clientIndex];
+    if (limiter.admit(frameBytes, millis())) return true;
+
+    throttledFrames++;
+    if (limiter.throttleStarted()) {
+        LOG_W("🚦 Cliente %d excede %d msg/s o %d B/s: descartando", clientIndex,
+              RATE_LIMIT_MESSAGES_PER_SEC, RATE_LIMIT_BYTES_PER_SEC);
+    }
+    if (rateLimitPolicy == ClientRateLimiter::DISCONNECT && limiter.floodDetected()) {
+        LOG_W("🚦 Cliente %d sigue inundando tras %d descartes -> desconectando", clientIndex,
+              RATE_LIMIT_DISCONNECT_AFTER);
+        disconnectClient(clientIndex);
+    }
+    return false;
+}
+
+// Cierre pedido por loop(): la tarea entrega lo encolado, cierra el socket y libera el slot
+void MQTTBrokerManager::disconnectClient(int clientIndex) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return;
+    if (clientConnected[clientIndex]) io.close(clientIndex, slotGeneration[clientIndex]);
+    resetClient(clientIndex);
+}
+
+// Olvidar todo el estado de loop() asociado al slot
+void MQTTBrokerManager::resetClient(int clientIndex) {
+    clientConnected[clientIndex] = false;   // también invalida el ping pendiente
+    clientIp[clientIndex] = "";
+    lastHeartbeatSent[clientIndex] = 0;
+    clientProtocol[clientIndex] = PROTOCOL_PENDING;
+    mqttSessionOpen[clientIndex] = false;
+    mqttKeepAlive[clientIndex] = 0;
+    mqttClientId[clientIndex] = "";
+    answersPings[clientIndex] = false;
+    pongPending[clientIndex] = false;
+    clientPacked[clientIndex] = false;
+    packedOffered[clientIndex] = false;
+    clientCompressed[clientIndex] = false;
+    compressionOffered[clientIndex] = false;
+    chunkAssemblers[clientIndex].reset();
+    unbindClient(clientIndex);
+    clearSubscriptions(clientIndex);
+}
+
+void MQTTBrokerManager::setClientProtocol(int clientIndex, ClientProtocol protocol) {
+    clientProtocol[clientIndex] = protocol;
+    if (protocol == PROTOCOL_MQTT) {
+        LOG_I("Cliente %d usa MQTT 3.1.1 binario", clientIndex);
+    } else if (protocol == PROTOCOL_JSON) {
+        sendWelcomeMessage(clientIndex);
+    }
+}
+
+void MQTTBrokerManager::bindModuleToClient(const String& moduleId, int clientIndex) {
+    if (moduleId.length() == 0 || clientIndex < 0 || clientIndex >= MAX_CLIENTS) return;
+    auto it = moduleClientIndex.find(moduleId);
+    if (it == moduleClientIndex.end() || it->second != clientIndex) {
+        moduleClientIndex[moduleId] = clientIndex;
+        LOG_I("[MQTTBrokerManager] Ruta de comandos: %s -> cliente %d", moduleId.c_str(), clientIndex);
+    }
+    // Con la ruta ya puesta sale lo que quedó esperando (no-op si no había nada)
+    commandOutbox.resume(moduleId, millis());
+}
+
+void MQTTBrokerManager::unbindClient(int clientIndex) {
+    for (auto it = moduleClientIndex.begin(); it != moduleClientIndex.end(); ) {
+        if (it->second == clientIndex) {
+            // Sus comandos esperan la reconexión en vez de reenviarse al vacío
+            commandOutbox.suspend(it->first, millis());
+            // La sesión guarda las suscripciones del slot para un session_resume
+            sessions.detach(it->first, clientSubscriptions[clientIndex], millis());
+            it = moduleClientIndex.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int MQTTBrokerManager::getClientIndexForModule(const String& moduleId) {
+    auto it = moduleClientIndex.find(moduleId);
+    if (it == moduleClientIndex.end()) return -1;
+    if (!clientConnected[it->second]) {
+        moduleClientIndex.erase(it);
+        return -1;
+    }
+    return it->second;
+}
+
+void MQTTBrokerManager::setCommandBroadcastFallback(bool enabled) {
+    commandBroadcastFallback = enabled;
+}
+
+void MQTTBrokerManager::processMessage(int clientIndex, String payload, size_t docCapacity, bool packed) {
+    if (packed) {
+        LOG_D("[MQTTBrokerManager] Cliente %d envió %u bytes MessagePack", clientIndex, payload.length());
     } else {
-        Serial.println("[MQTTBrokerManager] Tipo no manejado localmente -> forwarding/raw handling");
+        LOG_D("[MQTTBrokerManager] Cliente %d envió: %s", clientIndex, payload.c_str());
     }
 
+    JsonDocumentPool::Lease docLease(jsonPool, docCapacity);
+    JsonDocument& doc = *docLease;
+    DeserializationError err = packed ? deserializeMsgPack(doc, payload.c_str(), payload.length())
+                                      : deserializeJson(doc, payload);
+    if (err) {
+        LOG_W("[MQTTBrokerManager] JSON parse error: %s", err.c_str());
+        return;
+    }
+
+    // Tipo y campos comunes se leen una sola vez; los handlers reciben los punteros ya extraídos
+    MessageFields fields;
+    extractMessageFields(doc, fields);
+    LOG_D("[MQTTBrokerManager] 🔍 Tipo de mensaje identificado: '%s'", fields.typeName);
+
+    switch (fields.type) {
+        case MessageType::ModuleRegistration:
+            LOG_D("[MQTTBrokerManager] Dispatching module_registration -> DeviceManager::handleModuleRegistration");
+            if (deviceManager) deviceManager->handleModuleRegistration(clientIndex, (JsonDocument&)doc, clientIp[clientIndex]);
+            applyOfferedEncoding(clientIndex);   // registration_response ya salió en JSON
+            if (fields.hasModuleId()) {
+                String mid(fields.moduleId);
+                if (deviceManager && deviceManager->isModuleRegistered(mid)) bindModuleToClient(mid, clientIndex);
+            }
+            break;
+        case MessageType::MacResponse:
+            handleMacResponse(clientIndex, doc, fields);
+            break;
+        case MessageType::DeviceInfo:
+            LOG_D("[MQTTBrokerManager] Dispatching device_info -> DeviceManager::handleDeviceInfoResponse");
+            if (deviceManager) deviceManager->handleDeviceInfoResponse(clientIndex, (JsonDocument&)doc);
+            break;
+        case MessageType::ScanResponse:
+            LOG_D("[MQTTBrokerManager] Dispatching scan_response -> DeviceManager::handleDeviceScanResponse");
+            if (deviceManager) deviceManager->handleDeviceScanResponse(clientIndex, (JsonDocument&)doc);
+            break;
+        case MessageType::Heartbeat:
+            handleModuleHeartbeat(clientIndex, fields);
+            break;
+        case MessageType::PingResponse:
+            handlePingResponse(clientIndex, fields);
+            break;
+        case MessageType::Publish:
+            handlePublish(clientIndex, (JsonDocument&)doc);
+            break;
+        case MessageType::Subscribe:
+            handleSubscribe(clientIndex, (JsonDocument&)doc);
+            break;
+        case MessageType::Unsubscribe:
+            handleUnsubscribe(clientIndex, (JsonDocument&)doc);
+            break;
+        case MessageType::CommandAck:
+            handleCommandAck(clientIndex, (JsonDocument&)doc, fields);
+            return;   // el ack no es la respuesta del comando
+        case MessageType::SessionResume:
+            handleSessionResume(clientIndex, (JsonDocument&)doc, fields);
+            return;
+        case MessageType::Chunk:
+            handleChunk(clientIndex, (JsonDocument&)doc);
+            return;
+        case MessageType::Unknown:
+        default:
+            LOG_D("[MQTTBrokerManager] Tipo no manejado localmente -> forwarding/raw handling");
+            break;
+    }
+
+    // ¿Es la respuesta a un comando pendiente?
+    correlateReply(doc, fields);
+
     // Guardar actions responses si vienen
-    if (doc.containsKey("module_id") && doc.containsKey("actions")) {
-        String mid = String((const char*)doc["module_id"]);
+    if (fields.hasModuleId() && fields.hasActions) {
+        String mid(fields.moduleId);
         String serializedActions;
         serializeJson(doc["actions"], serializedActions);
         actionsResponseBuffer[mid] = serializedActions;
-        Serial.println("[MQTTBrokerManager] Stored actionsResponseBuffer for " + mid);
+        LOG_D("[MQTTBrokerManager] Stored actionsResponseBuffer for %s", mid.c_str());
+    }
+}
+
+void MQTTBrokerManager::correlateReply(JsonDocument& doc, const MessageFields& fields) {
+    uint32_t requestId = doc["request_id"] | 0u;
+    if (requestId != 0) {
+        if (!commandTracker.complete(requestId, doc.as<JsonVariantConst>(), millis())) {
+            LOG_D("[MQTTBrokerManager] request_id %lu sin pedido pendiente (¿vencido?)", (unsigned long)requestId);
+        }
+        return;
+    }
+    // Módulos que nunca devolvieron request_id: un resultado del tipo que contesta
+    // el comando (p.ej. fingerprint_scan_result para scan_fingerprint) completa el
+    // pedido más antiguo de ese comando; cualquier otro mensaje no correlaciona.
+    // Es una suposición: no confirma la entrega (ver sendCommandWithReply)
+    if (fields.type == MessageType::Unknown && fields.hasModuleId() && fields.typeName) {
+        commandTracker.completeOldest(String(fields.moduleId), fields.typeName, doc.as<JsonVariantConst>(), millis());
+    }
+}
+
+void MQTTBrokerManager::handleCommandAck(int clientIndex, JsonDocument& doc, const MessageFields& fields) {
+    uint32_t requestId = doc["request_id"] | 0u;
+    if (requestId == 0) return;
+    String moduleId = fields.hasModuleId() ? String(fields.moduleId) : String("");
+    if (!commandOutbox.acknowledge(moduleId, requestId, millis())) {
+        LOG_D("[MQTTBrokerManager] command_ack duplicado de cliente %d (request_id %lu)", clientIndex, (unsigned long)requestId);
+    }
+}
+
+// Trozo de un mensaje que no entra en una trama; completo, se procesa como si
+// hubiera llegado entero
+void MQTTBrokerManager::handleChunk(int clientIndex, JsonDocument& doc) {
+    uint32_t transferId = doc["transfer_id"] | 0u;
+    uint32_t seq = doc["seq"] | 0u;
+    uint32_t totalLength = doc["total_len"] | 0u;
+    const char* data = doc["data"] | "";
+
+    ChunkAssembler& assembler = chunkAssemblers[clientIndex];
+    ChunkAssembler::Result result = assembler.add(transferId, seq, totalLength, data, strlen(data), millis());
+    if (result == ChunkAssembler::PENDING) return;
+    if (result == ChunkAssembler::REJECTED) {
+        chunkTransfersRejected++;
+        LOG_W("⚠️ Transferencia %lu de cliente %d descartada (%s, trozo %lu)",
+              (unsigned long)transferId, clientIndex, assembler.error(), (unsigned long)seq);
+        sendChunkResponse(clientIndex, transferId, assembler.error());
+        return;
+    }
+
+    // Documento a la medida del mensaje: un valor por coma/apertura + los strings copiados
+    size_t capacity = JSON_ARRAY_SIZE(assembler.valueCount()) + assembler.bufferedBytes();
+    if (capacity > (size_t)CHUNK_MAX_DOC_BYTES) {
+        chunkTransfersRejected++;
+        LOG_W("⚠️ Transferencia %lu de cliente %d: %u bytes de documento superan CHUNK_MAX_DOC_BYTES",
+              (unsigned long)transferId, clientIndex, (unsigned)capacity);
+        assembler.reset();
+        sendChunkResponse(clientIndex, transferId, "too_complex");
+        return;
+    }
+    chunkTransfersCompleted++;
+    LOG_D("[MQTTBrokerManager] Transferencia %lu de cliente %d completa: %u bytes en %lu trozos",
+          (unsigned long)transferId, clientIndex, (unsigned)assembler.bufferedBytes(), (unsigned long)seq + 1);
+    sendChunkResponse(clientIndex, transferId, nullptr);
+    processMessage(clientIndex, assembler.takeMessage(), capacity < 1024 ? 1024 : capacity);
+}
+
+void MQTTBrokerManager::sendChunkResponse(int clientIndex, uint32_t transferId, const char* error) {
+    JsonDocumentPool::Lease responseLease(jsonPool, 256);
+    JsonDocument& response = *responseLease;
+    response["type"] = "chunk_response";
+    response["transfer_id"] = transferId;
+    response["status"] = error ? "error" : "success";
+    if (error) response["error"] = error;
+    String responseStr;
+    serializeJson(response, responseStr);
+    enqueueToClient(clientIndex, responseStr);
+}
+
+String MQTTBrokerManager::openSession(const String& moduleId, const String& macAddress) {
+    return sessions.open(moduleId, macAddress, millis());
+}
+
+void MQTTBrokerManager::closeSession(const String& moduleId) {
+    sessions.close(moduleId);
+}
+
+// Reconexión corta: token de la sesión en lugar de module_registration completo
+void MQTTBrokerManager::handleSessionResume(int clientIndex, JsonDocument& doc, const MessageFields& fields) {
+    String moduleId = fields.hasModuleId() ? String(fields.moduleId) : String("");
+    String token = doc["session_token"] | "";
+
+    JsonDocumentPool::Lease responseLease(jsonPool, 256);
+    JsonDocument& response = *responseLease;
+    response["type"] = "session_response";
+    response["module_id"] = moduleId;
+
+    SessionStore::Session* session = sessions.resume(moduleId, token, millis());
+    String ip = clientIp[clientIndex];
+    if (session && !(deviceManager && deviceManager->resumeModule(moduleId, clientIndex, ip))) {
+        // El módulo o su MAC se dieron de baja mientras estaba desconectado
+        sessions.close(moduleId);
+        session = nullptr;
+    }
+    if (!session) {
+        LOG_W("🔑 session_resume rechazado para '%s' (cliente %d): debe registrarse", moduleId.c_str(), clientIndex);
+        response["status"] = "error";
+        response["message"] = "Sesión inválida o vencida: enviar module_registration";
+        String responseStr;
+        serializeJson(response, responseStr);
+        sendToClient(clientIndex, responseStr);
+        return;
+    }
+
+    // Suscripciones que tenía al caer la conexión
+    for (const String& filter : session->subscriptions) {
+        subscriptions.subscribe(filter, clientIndex);
+        clientSubscriptions[clientIndex].insert(filter);
+    }
+    LOG_I("🔑 Sesión de %s reanudada en cliente %d (%u suscripciones)", moduleId.c_str(), clientIndex,
+          (unsigned)session->subscriptions.size());
+
+    response["status"] = "success";
+    response["subscriptions"] = session->subscriptions.size();
+    response["encoding"] = offerEncoding(clientIndex, doc["encodings"]);
+    response["compression"] = offerCompression(clientIndex, doc["compression"]);
+    response["delivery"] = offerDelivery(moduleId, doc["delivery"]);
+    response["timestamp"] = millis();
+    String responseStr;
+    serializeJson(response, responseStr);
+    sendToClient(clientIndex, responseStr);
+    applyOfferedEncoding(clientIndex);
+
+    // Después de la respuesta: ruta de comandos y cola pendiente
+    bindModuleToClient(moduleId, clientIndex);
+}
+
+void MQTTBrokerManager::handleMacResponse(int clientIndex, JsonDocument& doc, const MessageFields& fields) {
+    LOG_D("[MQTTBrokerManager] Dispatching mac_response -> DeviceManager::handleMACResponse");
+    if (deviceManager) deviceManager->handleMACResponse(clientIndex, doc);
+    // Si llegaron mac y module_id, marcar como conectado
+    if (fields.hasMacAddress()) {
+        String ip = clientIp[clientIndex];
+        if (deviceManager) deviceManager->markDeviceConnected(String(fields.macAddress), clientIndex, ip);
+    }
+    // El auto-registro por MAC response también fija la ruta del módulo
+    if (fields.hasModuleId()) {
+        String mid(fields.moduleId);
+        if (deviceManager && deviceManager->isModuleRegistered(mid)) bindModuleToClient(mid, clientIndex);
+    }
+}
+
+void MQTTBrokerManager::handleModuleHeartbeat(int clientIndex, const MessageFields& fields) {
+    LOG_D("[MQTTBrokerManager] Heartbeat recibido -> procesando");
+    String mid = fields.hasModuleId() ? String(fields.moduleId) : String("");
+    if (fields.hasModuleId()) {
+        LOG_D("[MQTTBrokerManager] Heartbeat de module_id: %s", fields.moduleId);
+        if (deviceManager && deviceManager->updateModuleHeartbeat(mid)) bindModuleToClient(mid, clientIndex);
+
+        // Intentar resolver MAC a partir de moduleId y marcar conectado
+        if (deviceManager) {
+            String macFromModule = deviceManager->getMacByModuleId(mid);
+            if (macFromModule.length() > 0) {
+                String ip = clientIp[clientIndex];
+                deviceManager->markDeviceConnected(macFromModule, clientIndex, ip);
+                deviceManager->reportScannedDevice(macFromModule, "", mid, clientIndex);
+            }
+        }
+    }
+    if (fields.hasMacAddress()) {
+        String mac(fields.macAddress);
+        String ip = clientIp[clientIndex];
+        LOG_D("[MQTTBrokerManager] Heartbeat incluye MAC: %s", fields.macAddress);
+        if (deviceManager) deviceManager->markDeviceConnected(mac, clientIndex, ip);
+        // Reportar también a scannedDevices
+        if (deviceManager) deviceManager->reportScannedDevice(mac, "", mid, clientIndex);
+    }
+}
+
+void MQTTBrokerManager::handlePingResponse(int clientIndex, const MessageFields& fields) {
+    // Cliente respondió a ping: si incluye module_id o mac_address, marcar como conectado
+    LOG_D("[MQTTBrokerManager] ping_response recibido");
+    // Desde ahora un ping sin respuesta en CLIENT_PONG_TIMEOUT_MS libera el slot
+    answersPings[clientIndex] = true;
+    if (fields.hasModuleId()) {
+        String mid(fields.moduleId);
+        if (deviceManager && deviceManager->updateModuleHeartbeat(mid)) bindModuleToClient(mid, clientIndex);
+        if (deviceManager) {
+            String macFromModule = deviceManager->getMacByModuleId(mid);
+            if (macFromModule.length() > 0) {
+                String ip = clientIp[clientIndex];
+                deviceManager->markDeviceConnected(macFromModule, clientIndex, ip);
+            }
+        }
+    }
+    if (fields.hasMacAddress()) {
+        String ip = clientIp[clientIndex];
+        if (deviceManager) deviceManager->markDeviceConnected(String(fields.macAddress), clientIndex, ip);
     }
 }
 
 void MQTTBrokerManager::handleModuleRegistration(int clientIndex, JsonDocument& doc) {
     // Delegar al DeviceManager
-    deviceManager->handleModuleRegistration(clientIndex, doc, &mqttClients[clientIndex]);
+    deviceManager->handleModuleRegistration(clientIndex, doc, clientIp[clientIndex]);
 }
 
 void MQTTBrokerManager::handleHeartbeat(int clientIndex, JsonDocument& doc) {
@@ -240,32 +963,93 @@ void MQTTBrokerManager::handleHeartbeat(int clientIndex, JsonDocument& doc) {
     
     if (deviceManager->updateModuleHeartbeat(moduleId)) {
         // Responder heartbeat
-        DynamicJsonDocument response(256);
+        JsonDocumentPool::Lease responseLease(jsonPool, 256);
+        JsonDocument& response = *responseLease;
         response["type"] = "heartbeat_ack";
         response["timestamp"] = millis();
         
         String responseStr;
         serializeJson(response, responseStr);
-        mqttClients[clientIndex].println(responseStr);
+        enqueueToClient(clientIndex, responseStr);
     }
 }
 
 void MQTTBrokerManager::handlePublish(int clientIndex, JsonDocument& doc) {
-    String topic = doc["topic"];
-    String payload = doc["payload"];
-    
-    // Reenviar a todos los suscriptores del topic
-    forwardToSubscribers(topic, payload);
+    String topic = doc["topic"] | "";
+    if (!TopicTrie::isValidTopic(topic)) {
+        LOG_W("[MQTTBrokerManager] publish con topic inválido: '%s'", topic.c_str());
+        return;
+    }
+    publishesReceived++;
+
+    // "retain": true guarda el payload para los que se suscriban después
+    if (doc["retain"] | false) storeRetained(topic, doc["payload"]);
+
+    // Reenviar sólo a los suscriptores cuyo filtro coincide
+    forwardToSubscribers(topic, doc["payload"]);
+}
+
+// Acepta "topic": "a/b" o "topics": ["a/+", "b/#"]
+static void collectTopicFilters(JsonDocument& doc, std::vector<String>& filters) {
+    if (doc["topic"].is<const char*>()) filters.push_back(String((const char*)doc["topic"]));
+    if (doc["topics"].is<JsonArrayConst>()) {
+        for (JsonVariantConst v : doc["topics"].as<JsonArrayConst>()) {
+            if (v.is<const char*>()) filters.push_back(String(v.as<const char*>()));
+        }
+    }
 }
 
 void MQTTBrokerManager::handleSubscribe(int clientIndex, JsonDocument& doc) {
-    String topic = doc["topic"];
-    
-    // Agregar cliente a suscriptores (implementación simple)
-    Serial.print("Cliente ");
-    Serial.print(clientIndex);
-    Serial.print(" suscrito a: ");
-    Serial.println(topic);
+    std::vector<String> filters;
+    collectTopicFilters(doc, filters);
+
+    for (const String& filter : filters) {
+        bool ok = TopicTrie::isValidFilter(filter);
+        if (ok) {
+            subscriptions.subscribe(filter, clientIndex);
+            clientSubscriptions[clientIndex].insert(filter);
+        }
+
+        LOG_I("Cliente %d %s %s", clientIndex, ok ? "suscrito a:" : "filtro inválido:", filter.c_str());
+
+        JsonDocumentPool::Lease responseLease(jsonPool, 256);
+        JsonDocument& response = *responseLease;
+        response["type"] = "subscribe_response";
+        response["topic"] = filter;
+        response["status"] = ok ? "success" : "error";
+        String responseStr;
+        serializeJson(response, responseStr);
+        sendToClient(clientIndex, responseStr);
+
+        // Los retenidos van después de la confirmación
+        if (ok) deliverRetained(clientIndex, filter);
+    }
+}
+
+void MQTTBrokerManager::handleUnsubscribe(int clientIndex, JsonDocument& doc) {
+    std::vector<String> filters;
+    collectTopicFilters(doc, filters);
+
+    for (const String& filter : filters) {
+        bool removed = subscriptions.unsubscribe(filter, clientIndex);
+        clientSubscriptions[clientIndex].erase(filter);
+
+        JsonDocumentPool::Lease responseLease(jsonPool, 256);
+        JsonDocument& response = *responseLease;
+        response["type"] = "unsubscribe_response";
+        response["topic"] = filter;
+        response["status"] = removed ? "success" : "not_subscribed";
+        String responseStr;
+        serializeJson(response, responseStr);
+        sendToClient(clientIndex, responseStr);
+    }
+}
+
+void MQTTBrokerManager::clearSubscriptions(int clientIndex) {
+    for (const String& filter : clientSubscriptions[clientIndex]) {
+        subscriptions.unsubscribe(filter, clientIndex);
+    }
+    clientSubscriptions[clientIndex].clear();
 }
 
 void MQTTBrokerManager::handleConfiguration(int clientIndex, JsonDocument& doc) {
@@ -273,78 +1057,388 @@ void MQTTBrokerManager::handleConfiguration(int clientIndex, JsonDocument& doc)
     
     if (configType == "get_modules") {
         String responseStr = deviceManager->getModulesJSON();
-        mqttClients[clientIndex].println(responseStr);
+        enqueueToClient(clientIndex, responseStr);
     } else if (configType == "set_discovery") {
         bool discoveryMode = doc["value"];
         deviceManager->setDiscoveryMode(discoveryMode);
         
-        DynamicJsonDocument response(512);
+        JsonDocumentPool::Lease responseLease(jsonPool, 512);
+        JsonDocument& response = *responseLease;
         response["type"] = "configuration_response";
         response["status"] = "ok";
         String responseStr;
         serializeJson(response, responseStr);
-        mqttClients[clientIndex].println(responseStr);
+        enqueueToClient(clientIndex, responseStr);
     }
 }
 
 void MQTTBrokerManager::forwardMessage(int senderIndex, String message) {
-    // Reenviar mensaje a todos los demás clientes conectados
+    // Reenviar mensaje a todos los demás clientes conectados (misma trama compartida)
+    SharedPayload shared(message);
+    FrameVariants variants;
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (i != senderIndex && clientConnected[i]) {
-            mqttClients[i].println(message);
+            enqueueToClient(i, shared, &variants);
         }
     }
 }
 
-void MQTTBrokerManager::forwardToSubscribers(String topic, String message) {
-    // Crear mensaje de publicación
-    DynamicJsonDocument pubMessage(512);
+// Payload JSON como bytes MQTT: un string viaja como texto plano, sin comillas
+static void payloadToText(JsonVariantConst payload, String& out) {
+    if (payload.isNull()) return;
+    if (payload.is<const char*>()) {
+        out = payload.as<const char*>();
+    } else {
+        serializeJson(payload, out);
+    }
+}
+
+void MQTTBrokerManager::forwardToSubscribers(const String& topic, JsonVariantConst payload,
+                                             const uint8_t* raw, size_t rawLength) {
+    matchScratch.clear();
+    subscriptions.match(topic, matchScratch);
+    if (matchScratch.empty()) return;
+
+    // Cada formato se arma una sola vez, sólo si algún suscriptor lo usa, y todos
+    // los suscriptores de ese formato encolan el mismo buffer
+    SharedPayload jsonFrame;
+    FrameVariants jsonVariants;
+    SharedPayload mqttFrame;
+    for (int i : matchScratch) {
+        if (!clientConnected[i]) continue;
+        bool sent;
+        if (clientProtocol[i] == PROTOCOL_MQTT) {
+            if (mqttFrame.empty()) {
+                String frame;
+                if (raw) {
+                    mqttEncodePublish(frame, topic.c_str(), topic.length(), raw, rawLength);
+                } else {
+                    String text;
+                    payloadToText(payload, text);
+                    mqttEncodePublish(frame, topic.c_str(), topic.length(), (const uint8_t*)text.c_str(), text.length());
+                }
+                mqttFrame = SharedPayload(frame);
+            }
+            sent = enqueueMqttFrame(i, mqttFrame);
+        } else {
+            if (jsonFrame.empty()) {
+                String frame;
+                buildJsonPublish(topic, payload, raw, rawLength, frame);
+                jsonFrame = SharedPayload(frame);
+            }
+            sent = enqueueToClient(i, jsonFrame, &jsonVariants);
+        }
+        if (sent) publishesDelivered++;
+    }
+}
+
+void MQTTBrokerManager::storeRetained(const String& topic, JsonVariantConst payload,
+                                      const uint8_t* raw, size_t rawLength) {
+    bool ok;
+    if (raw) {
+        ok = retained.store(topic, raw, rawLength);
+    } else {
+        String text;
+        payloadToText(payload, text);
+        ok = retained.store(topic, (const uint8_t*)text.c_str(), text.length());
+    }
+    if (!ok) LOG_W("[MQTTBrokerManager] Retenido de '%s' no entra en RETAINED_MAX_BYTES", topic.c_str());
+}
+
+void MQTTBrokerManager::deliverRetained(int clientIndex, const String& filter) {
+    retained.forEachMatch(filter, [this, clientIndex](const String& topic, const String& payload) {
+        String frame;
+        bool sent;
+        if (clientProtocol[clientIndex] == PROTOCOL_MQTT) {
+            mqttEncodePublish(frame, topic.c_str(), topic.length(),
+                              (const uint8_t*)payload.c_str(), payload.length(), true);
+            sent = enqueueMqttFrame(clientIndex, frame);
+        } else {
+            buildJsonPublish(topic, JsonVariantConst(), (const uint8_t*)payload.c_str(),
+                             payload.length(), frame, true);
+            sent = enqueueToClient(clientIndex, frame);
+        }
+        if (sent) retainedDelivered++;
+    });
+}
+
+void MQTTBrokerManager::buildJsonPublish(const String& topic, JsonVariantConst payload,
+                                         const uint8_t* raw, size_t rawLength, String& out, bool retain) {
+    JsonDocumentPool::Lease pubMessageLease(jsonPool, MQTT_MAX_FRAME_SIZE + 256);
+    JsonDocument& pubMessage = *pubMessageLease;
     pubMessage["type"] = "publish";
     pubMessage["topic"] = topic;
-    pubMessage["message"] = message;
-    String pubMessageStr;
-    serializeJson(pubMessage, pubMessageStr);
-    
-    // Enviar a todos los clientes conectados (implementación simple)
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (clientConnected[i]) {
-            mqttClients[i].println(pubMessageStr);
+    if (raw) {
+        // Payload de un cliente MQTT: si es JSON válido va como valor, si no como texto
+        JsonDocumentPool::Lease payloadLease(jsonPool, MQTT_MAX_FRAME_SIZE + 256);
+        JsonDocument& payloadDoc = *payloadLease;
+        if (deserializeJson(payloadDoc, (const char*)raw, rawLength) == DeserializationError::Ok) {
+            pubMessage["payload"] = payloadDoc.as<JsonVariantConst>();
+        } else {
+            String text;
+            text.concat((const char*)raw, rawLength);
+            pubMessage["payload"] = text;
+        }
+    } else {
+        pubMessage["payload"] = payload;
+    }
+    if (retain) pubMessage["retain"] = true;   // valor guardado, no un publish en vivo
+    serializeJson(pubMessage, out);
+}
+
+void MQTTBrokerManager::processMqttPacket(int clientIndex, const MqttPacket& packet) {
+    mqttPacketsReceived++;
+    LOG_D("[MQTTBrokerManager] Cliente %d envió %s (%u bytes)", clientIndex,
+          mqttPacketTypeName(packet.type), (unsigned)packet.length);
+
+    // El primer paquete tiene que ser CONNECT (y sólo uno por conexión)
+    if (packet.type == MqttPacketType::Connect || !mqttSessionOpen[clientIndex]) {
+        handleMqttConnect(clientIndex, packet);
+        return;
+    }
+
+    switch (packet.type) {
+        case MqttPacketType::Publish:
+            handleMqttPublish(clientIndex, packet);
+            break;
+        case MqttPacketType::Subscribe:
+            handleMqttSubscribe(clientIndex, packet);
+            break;
+        case MqttPacketType::Unsubscribe:
+            handleMqttUnsubscribe(clientIndex, packet);
+            break;
+        case MqttPacketType::Pingreq: {
+            String frame;
+            mqttEncodePingresp(frame);
+            enqueueMqttFrame(clientIndex, frame);
+            break;
         }
+        case MqttPacketType::Disconnect:
+            LOG_I("Cliente %d cerró la sesión MQTT", clientIndex);
+            disconnectClient(clientIndex);
+            break;
+        default:
+            LOG_W("[MQTTBrokerManager] Paquete MQTT %s inesperado del cliente %d -> desconectando",
+                  mqttPacketTypeName(packet.type), clientIndex);
+            disconnectClient(clientIndex);
+            break;
     }
 }
 
+void MQTTBrokerManager::handleMqttConnect(int clientIndex, const MqttPacket& packet) {
+    MqttConnect connect;
+    if (mqttSessionOpen[clientIndex] || !mqttParseConnect(packet, connect)) {
+        LOG_W("[MQTTBrokerManager] CONNECT inválido o repetido del cliente %d -> desconectando", clientIndex);
+        disconnectClient(clientIndex);
+        return;
+    }
+
+    uint8_t returnCode = MQTT_CONNACK_ACCEPTED;
+    if (!connect.protocolName.equals("MQTT") || connect.protocolLevel != 4) {
+        returnCode = MQTT_CONNACK_BAD_PROTOCOL;
+    } else if (connect.clientId.length == 0 && !connect.cleanSession()) {
+        returnCode = MQTT_CONNACK_BAD_CLIENT_ID;
+    }
+
+    String frame;
+    mqttEncodeConnack(frame, false, returnCode);
+    enqueueMqttFrame(clientIndex, frame);
+
+    if (returnCode != MQTT_CONNACK_ACCEPTED) {
+        LOG_W("[MQTTBrokerManager] CONNECT rechazado del cliente %d (código %u)", clientIndex, returnCode);
+        // La tarea de E/S intenta entregar el CONNACK antes de cerrar
+        disconnectClient(clientIndex);
+        return;
+    }
+
+    mqttSessionOpen[clientIndex] = true;
+    mqttKeepAlive[clientIndex] = connect.keepAlive;
+    mqttClientId[clientIndex] = connect.clientId.toString();
+    LOG_I("Cliente %d conectado por MQTT (client id '%s', keepalive %us)", clientIndex,
+          mqttClientId[clientIndex].c_str(), (unsigned)connect.keepAlive);
+}
+
+void MQTTBrokerManager::handleMqttPublish(int clientIndex, const MqttPacket& packet) {
+    MqttPublish publish;
+    if (!mqttParsePublish(packet, publish)) {
+        LOG_W("[MQTTBrokerManager] PUBLISH mal formado del cliente %d -> desconectando", clientIndex);
+        disconnectClient(clientIndex);
+        return;
+    }
+    if (publish.qos == 2) {
+        // Sin PUBREC/PUBREL/PUBCOMP: mejor cortar que perder el mensaje en silencio
+        LOG_W("[MQTTBrokerManager] QoS 2 no soportado (cliente %d) -> desconectando", clientIndex);
+        disconnectClient(clientIndex);
+        return;
+    }
+
+    String topic = publish.topic.toString();
+    if (publish.qos == 1) {
+        String ack;
+        mqttEncodePuback(ack, publish.packetId);
+        enqueueMqttFrame(clientIndex, ack);
+    }
+    if (!TopicTrie::isValidTopic(topic)) {
+        LOG_W("[MQTTBrokerManager] publish con topic inválido: '%s'", topic.c_str());
+        return;
+    }
+    publishesReceived++;
+
+    if (publish.retain) storeRetained(topic, JsonVariantConst(), publish.payload, publish.payloadLength);
+
+    // Se reenvía con QoS 0 a todos los suscriptores (el broker concede QoS 0)
+    forwardToSubscribers(topic, JsonVariantConst(), publish.payload, publish.payloadLength);
+}
+
+void MQTTBrokerManager::handleMqttSubscribe(int clientIndex, const MqttPacket& packet) {
+    uint16_t packetId = 0;
+    std::vector<MqttTopicFilter> filters;
+    if (!mqttParseSubscribe(packet, packetId, filters)) {
+        LOG_W("[MQTTBrokerManager] SUBSCRIBE mal formado del cliente %d -> desconectando", clientIndex);
+        disconnectClient(clientIndex);
+        return;
+    }
+
+    std::vector<uint8_t> returnCodes;
+    returnCodes.reserve(filters.size());
+    for (const MqttTopicFilter& entry : filters) {
+        String filter = entry.filter.toString();
+        bool ok = TopicTrie::isValidFilter(filter);
+        if (ok) {
+            subscriptions.subscribe(filter, clientIndex);
+            clientSubscriptions[clientIndex].insert(filter);
+        }
+        LOG_I("Cliente %d %s %s", clientIndex, ok ? "suscrito a:" : "filtro inválido:", filter.c_str());
+        // QoS concedido: siempre 0
+        returnCodes.push_back(ok ? 0x00 : MQTT_SUBACK_FAILURE);
+    }
+
+    String frame;
+    mqttEncodeSuback(frame, packetId, returnCodes.data(), returnCodes.size());
+    enqueueMqttFrame(clientIndex, frame);
+
+    // Retenidos después del SUBACK, con el flag retain puesto
+    for (size_t i = 0; i < filters.size(); i++) {
+        if (returnCodes[i] != MQTT_SUBACK_FAILURE) deliverRetained(clientIndex, filters[i].filter.toString());
+    }
+}
+
+void MQTTBrokerManager::handleMqttUnsubscribe(int clientIndex, const MqttPacket& packet) {
+    uint16_t packetId = 0;
+    std::vector<MqttTopicFilter> filters;
+    if (!mqttParseUnsubscribe(packet, packetId, filters)) {
+        LOG_W("[MQTTBrokerManager] UNSUBSCRIBE mal formado del cliente %d -> desconectando", clientIndex);
+        disconnectClient(clientIndex);
+        return;
+    }
+
+    for (const MqttTopicFilter& entry : filters) {
+        String filter = entry.filter.toString();
+        subscriptions.unsubscribe(filter, clientIndex);
+        clientSubscriptions[clientIndex].erase(filter);
+    }
+
+    String frame;
+    mqttEncodeUnsuback(frame, packetId);
+    enqueueMqttFrame(clientIndex, frame);
+}
+
 void MQTTBrokerManager::checkModuleHeartbeats() {
-    deviceManager->checkModuleHeartbeats(mqttClients, clientConnected);
+    deviceManager->checkModuleHeartbeats(nullptr, clientConnected);
 }
 
 bool MQTTBrokerManager::sendCommandToModule(const String& moduleId, const String& command, JsonVariantConst params) {
-    Serial.println("🔧 DEBUG sendCommandToModule(+params): " + moduleId + " -> " + command);
+    // Módulo sin conexión: el comando puede esperar en cola hasta COMMAND_OFFLINE_TTL_MS
+    unsigned long timeoutMs = COMMAND_REPLY_TIMEOUT_MS;
+    if (getClientIndexForModule(moduleId) < 0) {
+        LOG_I("📥 %s sin conexión: '%s' queda en cola", moduleId.c_str(), command.c_str());
+        timeoutMs += COMMAND_OFFLINE_TTL_MS;
+    }
+    // Sin callback propio: sólo registrar el resultado (y el RTT en las estadísticas)
+    return sendCommandWithReply(moduleId, command, params, [](const CommandTracker::Result& result) {
+        if (result.completed) {
+            LOG_I("✅ %s respondió a '%s' en %lu ms", result.moduleId->c_str(), result.command->c_str(), result.rttMs);
+        } else {
+            LOG_W("⏱️ Sin respuesta de %s a '%s' (request_id %lu)", result.moduleId->c_str(),
+                  result.command->c_str(), (unsigned long)result.requestId);
+        }
+    }, timeoutMs) != 0;
+}
+
+uint32_t MQTTBrokerManager::sendCommandWithReply(const String& moduleId, const String& command, JsonVariantConst params,
+                                                 CommandTracker::Callback onComplete, unsigned long timeoutMs) {
+    LOG_D("🔧 sendCommandToModule(+params): %s -> %s", moduleId.c_str(), command.c_str());
 
     if (!deviceManager || !deviceManager->isModuleRegistered(moduleId)) {
-        Serial.println("❌ Módulo no encontrado: " + moduleId);
-        return false;
+        LOG_W("❌ Módulo no encontrado: %s", moduleId.c_str());
+        return 0;
     }
 
-    DynamicJsonDocument cmdMsg(1024);
-    cmdMsg["type"]      = "command";
-    cmdMsg["module_id"] = moduleId;
-    cmdMsg["command"]   = command;
-    cmdMsg["timestamp"] = millis();
+    // Sin ruta no se rechaza: el outbox lo guarda hasta que el módulo se vuelva a registrar
+    uint32_t requestId = commandTracker.track(moduleId, command, millis(), timeoutMs,
+        [this, onComplete](const CommandTracker::Result& result) {
+            // Sólo la respuesta con su request_id confirma la entrega; la que se
+            // atribuyó por heurística no (el reenvío sigue hasta el command_ack).
+            // Si sólo venció el plazo, el comando sigue en cola hasta entregarse o vencer su TTL
+            if (result.completed && result.correlated) commandOutbox.settle(result.requestId, millis());
+            if (onComplete) onComplete(result);
+        });
+
+    JsonDocumentPool::Lease cmdMsgLease(jsonPool, 1024);
+    JsonDocument& cmdMsg = *cmdMsgLease;
+    cmdMsg["type"]       = "command";
+    cmdMsg["module_id"]  = moduleId;
+    cmdMsg["command"]    = command;
+    cmdMsg["request_id"] = requestId;   // el módulo lo devuelve en la respuesta
+    cmdMsg["timestamp"]  = millis();
     if (!params.isNull()) {
         cmdMsg["params"] = params; // queda como objeto JSON
     }
     String cmdStr; serializeJson(cmdMsg, cmdStr);
 
-    // Por ahora se reenvía a todos los clientes (cada cliente filtra por module_id)
+    // Sale ya si la ventana del módulo tiene lugar; si no, cuando llegue un ack
+    commandOutbox.submit(requestId, moduleId, cmdStr, millis());
+    return requestId;
+}
+
+// Envío (o reenvío) por la ruta actual del módulo. TRANSMIT_OFFLINE = sin conexión:
+// el outbox suspende la cola del módulo hasta que se vuelva a registrar
+CommandOutbox::TransmitResult MQTTBrokerManager::transmitCommand(const String& moduleId, const String& frame) {
+    int target = getClientIndexForModule(moduleId);
+    if (target >= 0) {
+        // Ring o cola de salida llenos: el outbox lo retiene y reintenta (sin suspender)
+        if (!enqueueToClient(target, frame)) return CommandOutbox::TRANSMIT_BUSY;
+        LOG_I("📨 Comando enviado a cliente %d: %s", target, frame.c_str());
+        return CommandOutbox::TRANSMIT_OK;
+    }
+    // Registrado pero sin slot: espera en cola a que se vuelva a registrar. Un
+    // broadcast a los demás clientes no le llega y vaciaría la cola
+    if (!commandBroadcastFallback || (deviceManager && deviceManager->isModuleRegistered(moduleId))) {
+        return CommandOutbox::TRANSMIT_OFFLINE;
+    }
+
+    // Fallback: reenviar a todos (cada cliente filtra por module_id)
+    SharedPayload shared(frame);
+    FrameVariants variants;
     bool anySent = false;
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientConnected[i]) {
-            mqttClients[i].println(cmdStr);
+        if (clientConnected[i] && enqueueToClient(i, shared, &variants)) {
             anySent = true;
-            Serial.println("📨 Comando enviado a cliente " + String(i) + ": " + cmdStr);
+            LOG_D("📨 Comando (broadcast) enviado a cliente %d: %s", i, frame.c_str());
         }
     }
-    return anySent;
+    return anySent ? CommandOutbox::TRANSMIT_OK : CommandOutbox::TRANSMIT_OFFLINE;
+}
+
+void MQTTBrokerManager::retryCommands() {
+    unsigned long now = millis();
+    commandOutbox.poll(now, abandonedCommands);
+    for (uint32_t requestId : abandonedCommands) {
+        LOG_W("⏱️ Comando %lu no entregado (sin confirmar, TTL vencido o cola llena): se abandona", (unsigned long)requestId);
+        commandTracker.abandon(requestId, now);
+    }
+    abandonedCommands.clear();
+    commandTracker.expire(now);
 }
 
 // (Opcional) mantener el viejo para compatibilidad interna
@@ -364,31 +1458,64 @@ int MQTTBrokerManager::getConnectedClientsCount() {
     return connectedCount;
 }
 
+void MQTTBrokerManager::registerEvents(EventLoop& loop) {
+    loop.addSource("mqtt",
+        [this](EventLoop& l) { prepareEvents(l); },
+        [this]() {
+            // Sin tarea de E/S los sockets se atienden acá, antes y después de procesar
+            if (!io.threaded()) io.service();
+            processClientMessages();
+            sendHeartbeatToClients();
+            retryCommands();
+            evictDeadClients();
+            if (!io.threaded()) io.service();
+        });
+}
+
+// Qué tiene que despertar al broker en la próxima espera
+void MQTTBrokerManager::prepareEvents(EventLoop& loop) {
+    // Eventos de la tarea de E/S (o sus sockets, si corre dentro de loop())
+    io.prepare(loop);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!clientConnected[i]) continue;
+        unsigned long due;
+        if (livenessDeadline(i, due)) loop.wakeAt(due);
+    }
+    if (rxBacklog) loop.wakeNow();
+
+    unsigned long due;
+    if (pingTimers.nextDeadline(due)) loop.wakeAt(due);
+    if (commandTracker.nextDeadline(due)) loop.wakeAt(due);
+    if (commandOutbox.nextDeadline(due)) loop.wakeAt(due);
+    if (commandOutbox.hasDropped()) loop.wakeNow();
+}
+
 void MQTTBrokerManager::sendHeartbeatToClients() {
     unsigned long now = millis();
-    const unsigned long HEARTBEAT_INTERVAL = 15000; // 15 segundos
-    
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientConnected[i] && (now - lastHeartbeatSent[i]) > HEARTBEAT_INTERVAL) {
-            DynamicJsonDocument ping(128);
-            ping["type"] = "ping";
-            ping["timestamp"] = now;
-            ping["message"] = "keep-alive";
-            
-            String pingStr;
-            serializeJson(ping, pingStr);
-            
-            if (mqttClients[i].connected()) {
-                mqttClients[i].println(pingStr);
-                lastHeartbeatSent[i] = now;
-                Serial.println("📡 Ping enviado a cliente " + String(i));
-            } else {
-                Serial.println("⚠️ Cliente " + String(i) + " desconectado durante heartbeat");
-                clientConnected[i] = false;
-                lastHeartbeatSent[i] = 0;
-            }
-        }
+
+    // Sólo los slots cuyo ping venció desde la última pasada
+    if (pingTimers.advance(now, expiredPings) == 0) return;
+
+    for (const auto& timer : expiredPings) {
+        int i = timer.key.slot;
+        if (!clientConnected[i] || slotGeneration[i] != timer.key.generation) continue;
+        // Los clientes MQTT binarios mantienen la conexión con PINGREQ
+        if (clientProtocol[i] == PROTOCOL_MQTT) continue;
+
+        JsonDocumentPool::Lease pingLease(jsonPool, 128);
+        JsonDocument& ping = *pingLease;
+        ping["type"] = "ping";
+        ping["timestamp"] = now;
+        ping["message"] = "keep-alive";
+        
+        // Un socket caído lo informa la tarea de E/S (CLOSED) antes o después del ping
+        sendDocument(i, ping);
+        lastHeartbeatSent[i] = now;
+        pongPending[i] = answersPings[i];
+        pingTimers.schedule(PingTimer{i, slotGeneration[i]}, now + CLIENT_PING_INTERVAL);
+        LOG_D("📡 Ping enviado a cliente %d", i);
     }
+    expiredPings.clear();
 }
 
 // Implementación actualizada: serializar JsonDocument almacenado a String
@@ -397,4 +1524,144 @@ bool MQTTBrokerManager::getLastActionsResponse(const String& moduleId, String& o
     if (it == actionsResponseBuffer.end()) return false;
     outJson = it->second;
     return true;
-}
\ No newline at end of file
+}
+
+unsigned long MQTTBrokerManager::getOversizedFrameCount() {
+    unsigned long total = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        total += io.slotStats(i).oversizedFrames.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+int MQTTBrokerManager::getHeapFragmentationPercent() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap == 0) return 0;
+    return 100 - (int)((uint64_t)ESP.getMaxAllocHeap() * 100 / freeHeap);
+}
+
+void MQTTBrokerManager::sampleHeap() {
+    uint32_t largest = ESP.getMaxAllocHeap();
+    if (largest < minLargestFreeBlock) minLargestFreeBlock = largest;
+}
+
+String MQTTBrokerManager::getBrokerStatsJSON() {
+    DynamicJsonDocument response(6144);
+    response["connected_clients"] = getConnectedClientsCount();
+    response["max_clients"] = maxClients;
+    response["client_socket_budget"] = clientSocketBudget();
+    response["accepted_connections"] = io.acceptedConnections();
+    response["refused_connections"] = io.refusedConnections();
+    response["max_frame_size"] = MQTT_MAX_FRAME_SIZE;
+    response["oversized_frames"] = getOversizedFrameCount();
+    response["command_broadcast_fallback"] = commandBroadcastFallback;
+    response["subscriptions"] = subscriptions.filterCount();
+    response["publishes_received"] = publishesReceived;
+    response["publishes_delivered"] = publishesDelivered;
+    JsonObject retainedStats = response.createNestedObject("retained");
+    retained.toJSON(retainedStats);
+    retainedStats["delivered"] = retainedDelivered;
+    sessions.toJSON(response.createNestedObject("sessions"));
+    response["ping_timers"] = pingTimers.size();
+    response["mqtt_packets_received"] = mqttPacketsReceived;
+    response["throttled_frames"] = throttledFrames;
+    JsonObject msgpack = response.createNestedObject("msgpack");
+    msgpack["negotiation"] = msgpackNegotiation;
+    msgpack["frames_received"] = packedFramesReceived;
+    msgpack["frames_sent"] = packedFramesSent;
+    JsonObject compression = response.createNestedObject("compression");
+    compression["negotiation"] = compressionNegotiation;
+    compression["threshold_bytes"] = COMPRESSION_THRESHOLD_BYTES;
+    compression["frames_received"] = compressedFramesReceived;
+    compression["frames_invalid"] = compressedFramesInvalid;
+    compression["frames_sent"] = compressedFramesSent;
+    compression["bytes_before"] = compressedBytesIn;
+    compression["bytes_after"] = compressedBytesOut;
+    JsonObject chunks = response.createNestedObject("chunks");
+    chunks["max_transfer_bytes"] = CHUNK_MAX_TRANSFER_BYTES;
+    chunks["completed"] = chunkTransfersCompleted;
+    chunks["rejected"] = chunkTransfersRejected;
+    chunks["expired"] = chunkTransfersExpired;
+    JsonObject evictions = response.createNestedObject("evictions");
+    evictions["idle"] = idleEvictions;
+    evictions["pong_timeout"] = pongEvictions;
+    evictions["tx_stalled"] = stalledEvictions;
+    JsonObject rateLimit = response.createNestedObject("rate_limit");
+    rateLimit["messages_per_sec"] = RATE_LIMIT_MESSAGES_PER_SEC;
+    rateLimit["message_burst"] = RATE_LIMIT_MESSAGE_BURST;
+    rateLimit["bytes_per_sec"] = RATE_LIMIT_BYTES_PER_SEC;
+    rateLimit["byte_burst"] = RATE_LIMIT_BYTE_BURST;
+    rateLimit["policy"] = (rateLimitPolicy == ClientRateLimiter::DISCONNECT) ? "disconnect" : "drop";
+    JsonObject ioStats = response.createNestedObject("io");
+    ioStats["task"] = io.threaded();
+    ioStats["inbound_depth"] = BROKER_IO_INBOUND_DEPTH;
+    ioStats["outbound_depth"] = BROKER_IO_OUTBOUND_DEPTH;
+    ioStats["inbound_pending"] = io.pendingEvents();
+    ioStats["outbound_pending"] = io.pendingCommands();
+    ioStats["outbound_dropped"] = io.droppedCommands();
+    ioStats["alloc_failed"] = txAllocFailures + io.emptyFrames();
+    ioStats["inbound_full"] = io.stalledReads();
+    response["tx_overflow_policy"] = (txOverflowPolicy == ClientTxQueue::DISCONNECT) ? "disconnect" : "drop_oldest";
+
+    JsonObject heap = response.createNestedObject("heap");
+    heap["free"] = ESP.getFreeHeap();
+    heap["min_free"] = ESP.getMinFreeHeap();
+    heap["largest_free_block"] = ESP.getMaxAllocHeap();
+    heap["min_largest_free_block"] = (minLargestFreeBlock == UINT32_MAX) ? ESP.getMaxAllocHeap() : minLargestFreeBlock;
+    heap["fragmentation_pct"] = getHeapFragmentationPercent();
+
+    JsonObject pool = response.createNestedObject("json_pool");
+    pool["documents"] = JSON_POOL_DOCUMENTS;
+    pool["capacity"] = jsonPool.capacity();
+    pool["in_use"] = jsonPool.inUse();
+    pool["peak_in_use"] = jsonPool.peakInUse();
+    pool["acquisitions"] = jsonPool.acquisitions();
+    pool["heap_fallbacks"] = jsonPool.fallbacks();
+
+    JsonObject commands = response.createNestedObject("commands");
+    commandTracker.toJSON(commands);
+    commandOutbox.toJSON(commands.createNestedObject("delivery"));
+
+    JsonObject routes = response.createNestedObject("module_routes");
+    for (const auto& pair : moduleClientIndex) {
+        routes[pair.first] = pair.second;
+    }
+
+    JsonArray slots = response.createNestedArray("slots");
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        JsonObject slot = slots.createNestedObject();
+        slot["index"] = i;
+        slot["connected"] = clientConnected[i];
+        slot["protocol"] = clientProtocol[i] == PROTOCOL_MQTT ? "mqtt" :
+                           clientProtocol[i] == PROTOCOL_JSON ? "json" : "pending";
+        if (clientProtocol[i] == PROTOCOL_JSON) {
+            slot["encoding"] = clientPacked[i] ? "msgpack" : "json";
+            slot["compression"] = clientCompressed[i] ? "lzss" : "none";
+        }
+        if (clientProtocol[i] == PROTOCOL_MQTT) {
+            slot["mqtt_client_id"] = mqttClientId[i];
+            slot["keepalive"] = mqttKeepAlive[i];
+        }
+        const BrokerIo::SlotStats& ioSlot = io.slotStats(i);
+        slot["rx_buffered"] = ioSlot.rxBuffered.load(std::memory_order_relaxed);
+        slot["oversized_frames"] = ioSlot.oversizedFrames.load(std::memory_order_relaxed);
+        slot["subscriptions"] = clientSubscriptions[i].size();
+        slot["tx_queue_depth"] = ioSlot.txDepth.load(std::memory_order_relaxed);
+        slot["tx_queue_bytes"] = ioSlot.txBytes.load(std::memory_order_relaxed);
+        slot["tx_queue_high_water"] = ioSlot.txHighWater.load(std::memory_order_relaxed);
+        slot["tx_dropped"] = ioSlot.txDropped.load(std::memory_order_relaxed);
+        slot["tx_overflows"] = ioSlot.txOverflows.load(std::memory_order_relaxed);
+        slot["throttled_messages"] = rateLimiters[i].throttledMessages();
+        slot["throttled_bytes"] = rateLimiters[i].throttledBytes();
+        if (chunkAssemblers[i].active()) slot["chunk_buffered"] = chunkAssemblers[i].bufferedBytes();
+        if (clientConnected[i]) {
+            slot["idle_ms"] = millis() - lastRxAt[i];
+            slot["answers_pings"] = answersPings[i];
+        }
+    }
+
+    response["success"] = true;
+    String responseStr;
+    serializeJson(response, responseStr);
+    return responseStr;
+}
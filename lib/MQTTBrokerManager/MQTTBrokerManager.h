@@ -4,8 +4,26 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <map>
+#include <set>
+#include <vector>
 #include <WiFi.h>
 #include "../../include/config.h"
+#include "BrokerIo.h"
+#include "TopicTrie.h"
+#include "RetainedStore.h"
+#include "SessionStore.h"
+#include "ChunkAssembler.h"
+#include "Lzss.h"
+#include "ClientTxQueue.h"
+#include "SharedPayload.h"
+#include "ClientRateLimiter.h"
+#include "MessageTypes.h"
+#include "JsonDocumentPool.h"
+#include "MqttCodec.h"
+#include "CommandTracker.h"
+#include "CommandOutbox.h"
+#include "../TimerWheel/TimerWheel.h"
+#include "../EventLoop/EventLoop.h"
 
 // Forward declarations to avoid circular includes
 class WiFiManager;
@@ -20,21 +38,51 @@ public:
     // Inicialización y loop-related
     void initialize();
     void setDeviceManager(DeviceManager* devMgr);
-    void handleNewConnections();
+    // Conexiones, tramas y cierres que subió la tarea de E/S
     void processClientMessages();
     void sendHeartbeatToClients();
     void checkModuleHeartbeats();
+    // Tope de clientes simultáneos (1..MAX_CLIENTS, y que entre en los sockets de
+    // lwIP). Bajarlo no corta a nadie: los slots altos se liberan al desconectarse
+    bool setMaxClients(int limit);
+    int getMaxClients() const { return maxClients; }
+    static int clientSocketBudget();
     int getConnectedClientsCount();
     String getClientIP(int clientIndex);
+    // Registrar sockets y timers del broker en el loop de eventos
+    void registerEvents(EventLoop& loop);
 
     // Envíos y utilidades
     void sendAuthSuccessMessage(int clientIndex, const String& macAddress, const String& apiKey);
     void sendToClient(int clientIndex, const String& payload);
     void sendToAllClients(const String& payload);
+    void setTxOverflowPolicy(ClientTxQueue::OverflowPolicy policy);
+    void setRateLimitPolicy(ClientRateLimiter::Policy policy);
 
     // Comandos a módulos (sobrecarga con params)
     void sendCommandToModule(const String& moduleId, const String& command);
     bool sendCommandToModule(const String& moduleId, const String& command, JsonVariantConst params);
+    // Igual, con request_id: onComplete se llama con la respuesta del módulo o al
+    // vencer timeoutMs. Devuelve el request_id (0 = no se pudo enviar)
+    uint32_t sendCommandWithReply(const String& moduleId, const String& command, JsonVariantConst params,
+                                  CommandTracker::Callback onComplete,
+                                  unsigned long timeoutMs = COMMAND_REPLY_TIMEOUT_MS);
+
+    // Sesiones reanudables: token para registration_response / baja del módulo
+    String openSession(const String& moduleId, const String& macAddress);
+    void closeSession(const String& moduleId);
+    // Codificación para el campo "encoding" de la respuesta al registro ("msgpack" o "json").
+    // El cambio vale desde la trama siguiente a esa respuesta
+    const char* offerEncoding(int clientIndex, JsonVariantConst requested);
+    // Lo mismo para "compression" ("lzss" o "none"): tramas de COMPRESSION_THRESHOLD_BYTES o más
+    const char* offerCompression(int clientIndex, JsonVariantConst requested);
+    // "delivery": "ack" si el módulo declara command_ack (ventana y reenvío con "dup");
+    // "none" = cada comando sale una sola vez, como con el firmware anterior
+    const char* offerDelivery(const String& moduleId, JsonVariantConst requested);
+
+    // Índice moduleId -> slot de cliente (ruteo dirigido de comandos)
+    int getClientIndexForModule(const String& moduleId);
+    void setCommandBroadcastFallback(bool enabled);
 
     // Obtener última respuesta de acciones (serializada en outJson)
     bool getLastActionsResponse(const String& moduleId, String& outJson);
@@ -42,31 +90,192 @@ public:
     // Exponer sendWelcomeMessage (usada internamente)
     void sendWelcomeMessage(int clientIndex);
 
+    // Métricas del broker
+    unsigned long getOversizedFrameCount();
+    String getBrokerStatsJSON();
+    // % del heap libre que no está en el bloque contiguo más grande (0 = sin fragmentación)
+    static int getHeapFragmentationPercent();
+
+    // Documentos JSON reutilizables (también los usa DeviceManager)
+    JsonDocumentPool& getJsonPool() { return jsonPool; }
+
 private:
     WiFiManager* wifiManager = nullptr;
     DeviceManager* deviceManager = nullptr;
     WebServerManager* webServerManager = nullptr;
 
-    // TCP server + clients
-    WiFiServer mqttServer; // inicializar en cpp ctor: mqttServer(MQTT_PORT)
-    WiFiClient mqttClients[MAX_CLIENTS];
+    // Sockets, framing y colas de salida (tarea propia o dentro de loop()).
+    // Lo de abajo es la vista de loop() de cada slot, armada con sus eventos
+    BrokerIo io;
     bool clientConnected[MAX_CLIENTS];
+    String clientIp[MAX_CLIENTS];
     unsigned long lastHeartbeatSent[MAX_CLIENTS];
 
+    // Vida de cada conexión: última trama recibida y ping sin contestar
+    // (la cola de salida trabada la detecta la tarea de E/S)
+    unsigned long lastRxAt[MAX_CLIENTS];
+    bool answersPings[MAX_CLIENTS];     // contestó algún ping: se le exige respuesta
+    bool pongPending[MAX_CLIENTS];
+    unsigned long idleEvictions = 0;
+    unsigned long pongEvictions = 0;
+    unsigned long stalledEvictions = 0;
+
+    int maxClients = MAX_CLIENTS;
+
+    // Próximo ping por slot. La generación la asigna BrokerIo en cada conexión;
+    // los eventos de una conexión anterior se descartan al vencer.
+    struct PingTimer {
+        int slot;
+        uint32_t generation;
+    };
+    TimerWheel<PingTimer> pingTimers;
+    std::vector<TimerWheel<PingTimer>::Timer> expiredPings;
+    uint32_t slotGeneration[MAX_CLIENTS];
+
+    // Protocolo de cada conexión, detectado con el primer byte recibido
+    enum ClientProtocol : uint8_t {
+        PROTOCOL_PENDING,   // todavía no llegó nada (la bienvenida JSON espera)
+        PROTOCOL_JSON,      // líneas JSON (módulos propios)
+        PROTOCOL_MQTT       // MQTT 3.1.1 binario (PubSubClient, mosquitto_pub...)
+    };
+    ClientProtocol clientProtocol[MAX_CLIENTS];
+    bool mqttSessionOpen[MAX_CLIENTS];             // CONNECT aceptado
+    uint16_t mqttKeepAlive[MAX_CLIENTS];           // segundos, tal como lo pidió el cliente
+    String mqttClientId[MAX_CLIENTS];
+    unsigned long mqttPacketsReceived = 0;
+    bool rxBacklog = false;   // quedaron eventos de E/S sin despachar (límite por pasada)
+    ClientTxQueue::OverflowPolicy txOverflowPolicy;
+    // Tráfico entrante por slot: se descarta antes de parsear lo que excede
+    ClientRateLimiter rateLimiters[MAX_CLIENTS];
+    ClientRateLimiter::Policy rateLimitPolicy;
+    unsigned long throttledFrames = 0;
+    // Mensajes fragmentados ("type":"chunk") en curso, uno por slot
+    ChunkAssembler chunkAssemblers[MAX_CLIENTS];
+    unsigned long chunkTransfersCompleted = 0;
+    unsigned long chunkTransfersRejected = 0;
+    unsigned long chunkTransfersExpired = 0;
+    // MessagePack negociado por slot (offered: acordado, vale después de la respuesta en curso)
+    bool msgpackNegotiation = MSGPACK_NEGOTIATION;
+    bool clientPacked[MAX_CLIENTS];
+    bool packedOffered[MAX_CLIENTS];
+    uint8_t packScratch[2 + MQTT_MAX_FRAME_SIZE];
+    unsigned long packedFramesReceived = 0;
+    unsigned long packedFramesSent = 0;
+    unsigned long txAllocFailures = 0;   // tramas descartadas porque no hubo heap para copiarlas
+    // Compresión LZSS negociada por slot, igual que la codificación
+    bool compressionNegotiation = COMPRESSION_NEGOTIATION;
+    bool clientCompressed[MAX_CLIENTS];
+    bool compressionOffered[MAX_CLIENTS];
+    Lzss lzss;
+    uint8_t compressScratch[2 + MQTT_MAX_FRAME_SIZE];
+    unsigned long compressedFramesReceived = 0;
+    unsigned long compressedFramesInvalid = 0;
+    unsigned long compressedFramesSent = 0;
+    unsigned long compressedBytesIn = 0;    // JSON de las tramas enviadas comprimidas
+    unsigned long compressedBytesOut = 0;   // lo que ocuparon en el cable
+
+    // moduleId -> índice de slot; se actualiza en registro, heartbeats y desconexiones
+    std::map<String, int> moduleClientIndex;
+    bool commandBroadcastFallback = COMMAND_BROADCAST_FALLBACK;
+
+    // Suscripciones: árbol de filtros + filtros por slot (para limpiar al desconectar)
+    TopicTrie subscriptions;
+    std::set<String> clientSubscriptions[MAX_CLIENTS];
+    std::vector<int> matchScratch;
+    unsigned long publishesReceived = 0;
+    unsigned long publishesDelivered = 0;
+    // Último valor por topic (publish con retain), para los que se suscriben después
+    RetainedStore retained;
+    unsigned long retainedDelivered = 0;
+    // Módulos que pueden volver con "session_resume" sin registrarse de nuevo
+    SessionStore sessions;
+
+    // Documentos JSON preasignados + peor bloque contiguo observado desde el arranque
+    JsonDocumentPool jsonPool;
+    uint32_t minLargestFreeBlock = UINT32_MAX;
+
     // Buffer de respuestas (serializadas) en lugar de JsonDocument
     std::map<String, String> actionsResponseBuffer;
 
+    // Comandos esperando respuesta (request_id -> callback, plazo y RTT)
+    CommandTracker commandTracker;
+    // Entrega confirmada: ventana por módulo y reenvíos
+    CommandOutbox commandOutbox;
+    std::vector<uint32_t> abandonedCommands;
+
+    // Versiones de una trama para los clientes que negociaron otro formato; en un
+    // fan-out cada una se arma una vez (si algún destinatario la usa) y se comparte
+    struct FrameVariants {
+        SharedPayload packed;
+        SharedPayload compressed;
+        bool packTried = false;
+        bool compressTried = false;
+    };
+
     // Métodos privados
-    void processMessage(int clientIndex, String message);
+    // docCapacity: más grande para los mensajes rearmados de trozos. packed: MessagePack
+    void processMessage(int clientIndex, String message, size_t docCapacity = 1024, bool packed = false);
     void forwardMessage(int senderIndex, String message);
-    void forwardToSubscribers(String topic, String payload);
+    void correlateReply(JsonDocument& doc, const MessageFields& fields);
+    CommandOutbox::TransmitResult transmitCommand(const String& moduleId, const String& frame);
+    void retryCommands();
+    // Origen JSON: payload. Origen MQTT: raw/rawLength (bytes tal cual llegaron)
+    void forwardToSubscribers(const String& topic, JsonVariantConst payload,
+                              const uint8_t* raw = nullptr, size_t rawLength = 0);
+    void buildJsonPublish(const String& topic, JsonVariantConst payload,
+                          const uint8_t* raw, size_t rawLength, String& out, bool retain = false);
+    void storeRetained(const String& topic, JsonVariantConst payload,
+                       const uint8_t* raw = nullptr, size_t rawLength = 0);
+    void deliverRetained(int clientIndex, const String& filter);
+    void clearSubscriptions(int clientIndex);
+    // Las variantes con String copian la trama una vez; para N destinatarios
+    // conviene armar un SharedPayload y encolar la misma referencia en cada uno
+    bool enqueueToClient(int clientIndex, const String& payload);
+    bool enqueueToClient(int clientIndex, const SharedPayload& payload, FrameVariants* variants = nullptr);
+    bool sendDocument(int clientIndex, const JsonDocument& doc);
+    bool packDocument(const JsonDocument& doc, SharedPayload& out);
+    bool packFrame(const SharedPayload& json, SharedPayload& out);
+    bool compressFrame(const SharedPayload& json, SharedPayload& out);
+    void expandFrame(int clientIndex, const String& body);
+    void applyOfferedEncoding(int clientIndex);
+    bool enqueueMqttFrame(int clientIndex, const String& frame);
+    bool enqueueMqttFrame(int clientIndex, const SharedPayload& frame);
+    bool pushFrame(int clientIndex, const SharedPayload& frame, bool binary, bool raw = false);
+    void onClientConnected(int clientIndex, uint32_t generation, const String& ip);
+    void onClientClosed(int clientIndex, BrokerIo::CloseReason reason);
+    void dispatchFrame(int clientIndex, BrokerIo::Event& event);
+    void setClientProtocol(int clientIndex, ClientProtocol protocol);
+    void bindModuleToClient(const String& moduleId, int clientIndex);
+    void unbindClient(int clientIndex);
+    void disconnectClient(int clientIndex);
+    void resetClient(int clientIndex);
+    bool admitFrame(int clientIndex, size_t frameBytes);
+    void evictDeadClients();
+    bool livenessDeadline(int clientIndex, unsigned long& when);
+    void sampleHeap();
+    void prepareEvents(EventLoop& loop);
 
     // Handlers de mensajes específicos
     void handleModuleRegistration(int clientIndex, JsonDocument& doc);
     void handleHeartbeat(int clientIndex, JsonDocument& doc);
+    void handleMacResponse(int clientIndex, JsonDocument& doc, const MessageFields& fields);
+    void handleModuleHeartbeat(int clientIndex, const MessageFields& fields);
+    void handlePingResponse(int clientIndex, const MessageFields& fields);
+    void handleCommandAck(int clientIndex, JsonDocument& doc, const MessageFields& fields);
+    void handleSessionResume(int clientIndex, JsonDocument& doc, const MessageFields& fields);
+    void handleChunk(int clientIndex, JsonDocument& doc);
+    void sendChunkResponse(int clientIndex, uint32_t transferId, const char* error);
     void handlePublish(int clientIndex, JsonDocument& doc);
     void handleSubscribe(int clientIndex, JsonDocument& doc);
+    void handleUnsubscribe(int clientIndex, JsonDocument& doc);
     void handleConfiguration(int clientIndex, JsonDocument& doc);
+
+    // Clientes MQTT binarios
+    void processMqttPacket(int clientIndex, const MqttPacket& packet);
+    void handleMqttConnect(int clientIndex, const MqttPacket& packet);
+    void handleMqttPublish(int clientIndex, const MqttPacket& packet);
+    void handleMqttSubscribe(int clientIndex, const MqttPacket& packet);
+    void handleMqttUnsubscribe(int clientIndex, const MqttPacket& packet);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "MessageTypes.h"
+
+struct MessageTypeName {
+    MessageType type;
+    const char* name;
+};
+
+static const MessageTypeName MESSAGE_TYPE_NAMES[] = {
+    { MessageType::Unknown,            "unknown" },
+    { MessageType::ModuleRegistration, "module_registration" },
+    { MessageType::MacResponse,        "mac_response" },
+    { MessageType::DeviceInfo,         "device_info" },
+    { MessageType::ScanResponse,       "scan_response" },
+    { MessageType::Heartbeat,          "heartbeat" },
+    { MessageType::PingResponse,       "ping_response" },
+    { MessageType::Publish,            "publish" },
+    { MessageType::Subscribe,          "subscribe" },
+    { MessageType::Unsubscribe,        "unsubscribe" },
+    { MessageType::CommandAck,         "command_ack" },
+    { MessageType::SessionResume,      "session_resume" },
+    { MessageType::Chunk,              "chunk" }
+};
+
+static inline MessageType confirm(const char* type, const char* expected, MessageType result) {
+    return strcmp(type, expected) == 0 ? result : MessageType::Unknown;
+}
+
+MessageType classifyMessageType(const char* type) {
+    if (type == nullptr) return MessageType::Unknown;
+    switch (messageTypeHash(type)) {
+        case messageTypeHash("module_registration"): return confirm(type, "module_registration", MessageType::ModuleRegistration);
+        case messageTypeHash("mac_response"):        return confirm(type, "mac_response", MessageType::MacResponse);
+        case messageTypeHash("mac"):                 return confirm(type, "mac", MessageType::MacResponse);
+        case messageTypeHash("device_info"):         return confirm(type, "device_info", MessageType::DeviceInfo);
+        case messageTypeHash("info_response"):       return confirm(type, "info_response", MessageType::DeviceInfo);
+        case messageTypeHash("scan_response"):       return confirm(type, "scan_response", MessageType::ScanResponse);
+        case messageTypeHash("device_scan"):         return confirm(type, "device_scan", MessageType::ScanResponse);
+        case messageTypeHash("heartbeat"):           return confirm(type, "heartbeat", MessageType::Heartbeat);
+        case messageTypeHash("ping_response"):       return confirm(type, "ping_response", MessageType::PingResponse);
+        case messageTypeHash("publish"):             return confirm(type, "publish", MessageType::Publish);
+        case messageTypeHash("subscribe"):           return confirm(type, "subscribe", MessageType::Subscribe);
+        case messageTypeHash("unsubscribe"):         return confirm(type, "unsubscribe", MessageType::Unsubscribe);
+        case messageTypeHash("command_ack"):         return confirm(type, "command_ack", MessageType::CommandAck);
+        case messageTypeHash("session_resume"):      return confirm(type, "session_resume", MessageType::SessionResume);
+        case messageTypeHash("chunk"):               return confirm(type, "chunk", MessageType::Chunk);
+        default:                                     return MessageType::Unknown;
+    }
+}
+
+const char* messageTypeName(MessageType type) {
+    size_t index = (size_t)type;
+    if (index >= sizeof(MESSAGE_TYPE_NAMES) / sizeof(MESSAGE_TYPE_NAMES[0])) return "unknown";
+    return MESSAGE_TYPE_NAMES[index].name;
+}
+
+void extractMessageFields(const JsonDocument& doc, MessageFields& fields) {
+    JsonVariantConst type = doc["type"];
+    fields.typeName = type.is<const char*>() ? type.as<const char*>() : "";
+    fields.type = classifyMessageType(fields.typeName);
+
+    JsonVariantConst moduleId = doc["module_id"];
+    fields.moduleId = moduleId.is<const char*>() ? moduleId.as<const char*>() : nullptr;
+
+    JsonVariantConst macAddress = doc["mac_address"];
+    fields.macAddress = macAddress.is<const char*>() ? macAddress.as<const char*>() : nullptr;
+
+    fields.hasActions = !doc["actions"].isNull();
+}
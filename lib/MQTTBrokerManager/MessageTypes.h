@@ -0,0 +1,52 @@
+#ifndef MESSAGE_TYPES_H
+#define MESSAGE_TYPES_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <stdint.h>
+#include <string.h>
+
+// Tipos de mensaje que el broker procesa localmente.
+// Los alias ("mac", "info_response", "device_scan") mapean al mismo handler.
+enum class MessageType : uint8_t {
+    Unknown = 0,
+    ModuleRegistration,
+    MacResponse,
+    DeviceInfo,
+    ScanResponse,
+    Heartbeat,
+    PingResponse,
+    Publish,
+    Subscribe,
+    Unsubscribe,
+    CommandAck,
+    SessionResume,
+    Chunk
+};
+
+// FNV-1a de 32 bits. constexpr para poder usarlo como etiqueta de switch:
+// dos tipos con el mismo hash darían "duplicate case value" al compilar.
+constexpr uint32_t messageTypeHash(const char* s, uint32_t h = 2166136261u) {
+    return *s ? messageTypeHash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+// Hash + comparación final contra el nombre (un topic desconocido que colisione no se confunde)
+MessageType classifyMessageType(const char* type);
+const char* messageTypeName(MessageType type);
+
+// Campos comunes extraídos una sola vez del documento.
+// Los punteros apuntan dentro del JsonDocument: válidos mientras éste viva.
+struct MessageFields {
+    MessageType type = MessageType::Unknown;
+    const char* typeName = nullptr;    // tal como llegó ("" si no es string)
+    const char* moduleId = nullptr;    // nullptr si falta o no es string
+    const char* macAddress = nullptr;
+    bool hasActions = false;
+
+    bool hasModuleId() const { return moduleId != nullptr; }
+    bool hasMacAddress() const { return macAddress != nullptr; }
+};
+
+void extractMessageFields(const JsonDocument& doc, MessageFields& fields);
+
+#endif
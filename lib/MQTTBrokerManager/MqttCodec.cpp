@@ -0,0 +1,205 @@
+#include "MqttCodec.h"
+#include <string.h>
+
+void MqttLengthDecoder::reset() {
+    value = 0;
+    multiplier = 1;
+    used = 0;
+    state = NEED_MORE;
+}
+
+MqttLengthDecoder::Status MqttLengthDecoder::feed(uint8_t byte) {
+    if (state != NEED_MORE) return state;
+    value += (uint32_t)(byte & 0x7F) * multiplier;
+    used++;
+    if ((byte & 0x80) == 0) {
+        state = DONE;
+    } else if (used == 4) {
+        // Un quinto byte de largo no existe en MQTT 3.1.1
+        state = MALFORMED;
+    } else {
+        multiplier *= 128;
+    }
+    return state;
+}
+
+bool MqttView::equals(const char* text) const {
+    size_t len = strlen(text);
+    return len == length && (len == 0 || memcmp(data, text, len) == 0);
+}
+
+String MqttView::toString() const {
+    String out;
+    if (length > 0) out.concat((const char*)data, length);
+    return out;
+}
+
+// Cursor sobre el cuerpo del paquete; cada lectura verifica que queden bytes
+struct MqttReader {
+    const uint8_t* p;
+    size_t left;
+
+    MqttReader(const MqttPacket& packet) : p(packet.body), left(packet.length) {}
+
+    bool u8(uint8_t& out) {
+        if (left < 1) return false;
+        out = *p++;
+        left--;
+        return true;
+    }
+
+    bool u16(uint16_t& out) {
+        if (left < 2) return false;
+        out = (uint16_t)((p[0] << 8) | p[1]);
+        p += 2;
+        left -= 2;
+        return true;
+    }
+
+    bool view(MqttView& out) {
+        uint16_t len;
+        if (!u16(len) || left < len) return false;
+        out.data = p;
+        out.length = len;
+        p += len;
+        left -= len;
+        return true;
+    }
+};
+
+bool mqttParseConnect(const MqttPacket& packet, MqttConnect& out) {
+    if (packet.type != MqttPacketType::Connect || packet.flags != 0) return false;
+    MqttReader r(packet);
+    if (!r.view(out.protocolName) || !r.u8(out.protocolLevel) ||
+        !r.u8(out.connectFlags) || !r.u16(out.keepAlive) || !r.view(out.clientId)) {
+        return false;
+    }
+    if (out.connectFlags & 0x01) return false;   // bit reservado
+
+    // Will, usuario y contraseña: el broker no los usa, pero deben estar completos
+    MqttView skipped;
+    if (out.connectFlags & 0x04) {
+        if (!r.view(skipped) || !r.view(skipped)) return false;
+    }
+    if ((out.connectFlags & 0x80) && !r.view(skipped)) return false;
+    if ((out.connectFlags & 0x40) && !r.view(skipped)) return false;
+    return true;
+}
+
+bool mqttParsePublish(const MqttPacket& packet, MqttPublish& out) {
+    if (packet.type != MqttPacketType::Publish) return false;
+    out.retain = (packet.flags & 0x01) != 0;
+    out.qos = (packet.flags >> 1) & 0x03;
+    out.dup = (packet.flags & 0x08) != 0;
+    if (out.qos == 3) return false;
+
+    MqttReader r(packet);
+    if (!r.view(out.topic)) return false;
+    out.packetId = 0;
+    if (out.qos > 0 && !r.u16(out.packetId)) return false;
+    out.payload = r.p;
+    out.payloadLength = r.left;
+    return true;
+}
+
+static bool parseFilterList(const MqttPacket& packet, bool withQos, uint16_t& packetId,
+                            std::vector<MqttTopicFilter>& out) {
+    if (packet.flags != 0x02) return false;
+    MqttReader r(packet);
+    if (!r.u16(packetId)) return false;
+    while (r.left > 0) {
+        MqttTopicFilter entry;
+        if (!r.view(entry.filter)) return false;
+        if (withQos && (!r.u8(entry.qos) || entry.qos > 2)) return false;
+        out.push_back(entry);
+    }
+    return !out.empty();
+}
+
+bool mqttParseSubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<MqttTopicFilter>& out) {
+    if (packet.type != MqttPacketType::Subscribe) return false;
+    return parseFilterList(packet, true, packetId, out);
+}
+
+bool mqttParseUnsubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<MqttTopicFilter>& out) {
+    if (packet.type != MqttPacketType::Unsubscribe) return false;
+    return parseFilterList(packet, false, packetId, out);
+}
+
+size_t mqttEncodeRemainingLength(uint32_t length, uint8_t* out) {
+    size_t n = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        if (length > 0) byte |= 0x80;
+        out[n++] = byte;
+    } while (length > 0 && n < 4);
+    return n;
+}
+
+// Primer byte + remaining length
+static void appendFixedHeader(String& out, MqttPacketType type, uint8_t flags, uint32_t length) {
+    uint8_t header[5];
+    header[0] = (uint8_t)(((uint8_t)type << 4) | (flags & 0x0F));
+    size_t n = 1 + mqttEncodeRemainingLength(length, &header[1]);
+    out.concat((const char*)header, n);
+}
+
+static void appendU16(String& out, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)(value & 0xFF) };
+    out.concat((const char*)bytes, 2);
+}
+
+void mqttEncodeConnack(String& out, bool sessionPresent, uint8_t returnCode) {
+    appendFixedHeader(out, MqttPacketType::Connack, 0, 2);
+    uint8_t body[2] = { (uint8_t)(sessionPresent ? 0x01 : 0x00), returnCode };
+    out.concat((const char*)body, 2);
+}
+
+void mqttEncodePublish(String& out, const char* topic, size_t topicLength,
+                       const uint8_t* payload, size_t payloadLength, bool retain) {
+    // QoS 0: sin packet id
+    out.reserve(out.length() + 5 + 2 + topicLength + payloadLength);
+    appendFixedHeader(out, MqttPacketType::Publish, retain ? 0x01 : 0x00,
+                      (uint32_t)(2 + topicLength + payloadLength));
+    appendU16(out, (uint16_t)topicLength);
+    if (topicLength > 0) out.concat(topic, topicLength);
+    if (payloadLength > 0) out.concat((const char*)payload, payloadLength);
+}
+
+void mqttEncodePuback(String& out, uint16_t packetId) {
+    appendFixedHeader(out, MqttPacketType::Puback, 0, 2);
+    appendU16(out, packetId);
+}
+
+void mqttEncodeSuback(String& out, uint16_t packetId, const uint8_t* returnCodes, size_t count) {
+    appendFixedHeader(out, MqttPacketType::Suback, 0, (uint32_t)(2 + count));
+    appendU16(out, packetId);
+    out.concat((const char*)returnCodes, count);
+}
+
+void mqttEncodeUnsuback(String& out, uint16_t packetId) {
+    appendFixedHeader(out, MqttPacketType::Unsuback, 0, 2);
+    appendU16(out, packetId);
+}
+
+void mqttEncodePingresp(String& out) {
+    appendFixedHeader(out, MqttPacketType::Pingresp, 0, 0);
+}
+
+const char* mqttPacketTypeName(MqttPacketType type) {
+    switch (type) {
+        case MqttPacketType::Connect:     return "CONNECT";
+        case MqttPacketType::Connack:     return "CONNACK";
+        case MqttPacketType::Publish:     return "PUBLISH";
+        case MqttPacketType::Puback:      return "PUBACK";
+        case MqttPacketType::Subscribe:   return "SUBSCRIBE";
+        case MqttPacketType::Suback:      return "SUBACK";
+        case MqttPacketType::Unsubscribe: return "UNSUBSCRIBE";
+        case MqttPacketType::Unsuback:    return "UNSUBACK";
+        case MqttPacketType::Pingreq:     return "PINGREQ";
+        case MqttPacketType::Pingresp:    return "PINGRESP";
+        case MqttPacketType::Disconnect:  return "DISCONNECT";
+        default:                          return "RESERVED";
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Codec del protocolo binario MQTT 3.1.1 (sólo lo que usa el broker):
+// CONNECT/CONNACK, PUBLISH/PUBACK, SUBSCRIBE/SUBACK, UNSUBSCRIBE/UNSUBACK,
+// PINGREQ/PINGRESP y DISCONNECT.
+//
+// El parseo es sin copias: los campos de texto y el payload son vistas
+// (puntero + largo) dentro del cuerpo del paquete, válidas mientras éste viva.
+// Los encoders agregan la trama a un String (la cola de salida guarda Strings).
+
+enum class MqttPacketType : uint8_t {
+    Reserved = 0,
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Subscribe = 8,
+    Suback = 9,
+    Unsubscribe = 10,
+    Unsuback = 11,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14
+};
+
+// Primer byte de todo cliente MQTT (CONNECT, flags 0). Una línea JSON empieza con '{'
+const uint8_t MQTT_CONNECT_HEADER = 0x10;
+
+// Códigos de retorno de CONNACK
+const uint8_t MQTT_CONNACK_ACCEPTED = 0x00;
+const uint8_t MQTT_CONNACK_BAD_PROTOCOL = 0x01;
+const uint8_t MQTT_CONNACK_BAD_CLIENT_ID = 0x02;
+const uint8_t MQTT_CONNACK_SERVER_UNAVAILABLE = 0x03;
+
+// Código de SUBACK para un filtro rechazado
+const uint8_t MQTT_SUBACK_FAILURE = 0x80;
+
+// Decodificador incremental del "remaining length" (1 a 4 bytes, 7 bits por byte).
+// Se le pasan los bytes a medida que llegan; conserva el estado entre lecturas
+// parciales del socket.
+class MqttLengthDecoder {
+public:
+    enum Status { NEED_MORE, DONE, MALFORMED };
+
+    MqttLengthDecoder() { reset(); }
+
+    void reset();
+    Status feed(uint8_t byte);
+
+    Status status() const { return state; }
+    uint32_t length() const { return value; }
+    size_t bytesUsed() const { return used; }
+
+private:
+    uint32_t value;
+    uint32_t multiplier;
+    size_t used;
+    Status state;
+};
+
+// Vista de un string MQTT (UTF-8 con prefijo de largo) dentro del paquete
+struct MqttView {
+    const uint8_t* data = nullptr;
+    uint16_t length = 0;
+
+    bool equals(const char* text) const;
+    String toString() const;
+};
+
+// Paquete completo ya separado del stream
+struct MqttPacket {
+    MqttPacketType type = MqttPacketType::Reserved;
+    uint8_t flags = 0;              // nibble bajo del primer byte
+    const uint8_t* body = nullptr;  // variable header + payload
+    uint32_t length = 0;
+};
+
+struct MqttConnect {
+    MqttView protocolName;
+    uint8_t protocolLevel = 0;
+    uint8_t connectFlags = 0;
+    uint16_t keepAlive = 0;         // segundos
+    MqttView clientId;
+
+    bool cleanSession() const { return (connectFlags & 0x02) != 0; }
+};
+
+struct MqttPublish {
+    MqttView topic;
+    uint8_t qos = 0;
+    bool retain = false;
+    bool dup = false;
+    uint16_t packetId = 0;          // sólo QoS > 0
+    const uint8_t* payload = nullptr;
+    size_t payloadLength = 0;
+};
+
+struct MqttTopicFilter {
+    MqttView filter;
+    uint8_t qos = 0;                // sólo SUBSCRIBE
+};
+
+// Parsers: false si el paquete está mal formado (el broker desconecta)
+bool mqttParseConnect(const MqttPacket& packet, MqttConnect& out);
+bool mqttParsePublish(const MqttPacket& packet, MqttPublish& out);
+bool mqttParseSubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<MqttTopicFilter>& out);
+bool mqttParseUnsubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<MqttTopicFilter>& out);
+
+// Encoders
+size_t mqttEncodeRemainingLength(uint32_t length, uint8_t* out);
+void mqttEncodeConnack(String& out, bool sessionPresent, uint8_t returnCode);
+void mqttEncodePublish(String& out, const char* topic, size_t topicLength,
+                       const uint8_t* payload, size_t payloadLength, bool retain = false);
+void mqttEncodePuback(String& out, uint16_t packetId);
+void mqttEncodeSuback(String& out, uint16_t packetId, const uint8_t* returnCodes, size_t count);
+void mqttEncodeUnsuback(String& out, uint16_t packetId);
+void mqttEncodePingresp(String& out);
+
+const char* mqttPacketTypeName(MqttPacketType type);
+
+#endif
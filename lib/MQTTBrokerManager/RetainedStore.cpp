@@ -0,0 +1,52 @@
+#include "RetainedStore.h"
+
+RetainedStore::RetainedStore()
+    : usedBytes(0), storedCount(0), evictedCount(0), rejectedCount(0) {}
+
+size_t RetainedStore::cost(const String& topic, size_t payloadLength) {
+    return topic.length() + payloadLength + RETAINED_ENTRY_OVERHEAD;
+}
+
+bool RetainedStore::store(const String& topic, const uint8_t* payload, size_t length) {
+    auto existing = entries.find(topic);
+    if (existing != entries.end()) erase(existing);
+    if (length == 0) return true;
+
+    size_t needed = cost(topic, length);
+    if (needed > (size_t)RETAINED_MAX_BYTES) {
+        rejectedCount++;
+        return false;
+    }
+    // Desalojar desde el menos usado hasta que entre
+    while (usedBytes + needed > (size_t)RETAINED_MAX_BYTES && !lru.empty()) {
+        erase(entries.find(lru.back()));
+        evictedCount++;
+    }
+
+    lru.push_front(topic);
+    Entry& entry = entries[topic];
+    entry.payload.concat((const char*)payload, length);
+    entry.recency = lru.begin();
+    usedBytes += needed;
+    storedCount++;
+    return true;
+}
+
+void RetainedStore::touch(Entry& entry) {
+    lru.splice(lru.begin(), lru, entry.recency);
+}
+
+void RetainedStore::erase(std::map<String, Entry>::iterator it) {
+    usedBytes -= cost(it->first, it->second.payload.length());
+    lru.erase(it->second.recency);
+    entries.erase(it);
+}
+
+void RetainedStore::toJSON(JsonObject out) const {
+    out["topics"] = entries.size();
+    out["bytes"] = usedBytes;
+    out["max_bytes"] = RETAINED_MAX_BYTES;
+    out["stored"] = storedCount;
+    out["evicted"] = evictedCount;
+    out["rejected"] = rejectedCount;
+}
@@ -0,0 +1,56 @@
+#ifndef RETAINED_STORE_H
+#define RETAINED_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <list>
+#include <map>
+#include "../../include/config.h"
+#include "TopicTrie.h"
+
+// Último payload retenido por topic, para entregarlo a quien se suscribe después.
+// El payload se guarda tal como viaja por MQTT (bytes); el suscriptor JSON lo
+// recibe convertido igual que un publish en vivo.
+// Tope global RETAINED_MAX_BYTES: al pasarse se desaloja el topic usado (publicado
+// o entregado) hace más tiempo.
+class RetainedStore {
+public:
+    RetainedStore();
+
+    // Guardar o reemplazar; un payload vacío borra el retenido (como en MQTT).
+    // false si no entra ni vaciando el store
+    bool store(const String& topic, const uint8_t* payload, size_t length);
+
+    // visit(topic, payload) por cada retenido que coincide con el filtro
+    template <typename Visit>
+    void forEachMatch(const String& filter, Visit visit) {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (!TopicTrie::matches(filter, it->first)) continue;
+            touch(it->second);
+            visit(it->first, it->second.payload);
+        }
+    }
+
+    size_t count() const { return entries.size(); }
+    size_t bytes() const { return usedBytes; }
+    void toJSON(JsonObject out) const;
+
+private:
+    struct Entry {
+        String payload;
+        std::list<String>::iterator recency;   // posición en lru
+    };
+
+    std::map<String, Entry> entries;
+    std::list<String> lru;   // frente = más reciente
+    size_t usedBytes;
+    unsigned long storedCount;
+    unsigned long evictedCount;
+    unsigned long rejectedCount;
+
+    static size_t cost(const String& topic, size_t payloadLength);
+    void touch(Entry& entry);
+    void erase(std::map<String, Entry>::iterator it);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "SessionStore.h"
+
+SessionStore::SessionStore()
+    : openedCount(0), resumedCount(0), rejectedCount(0), expiredCount(0) {}
+
+String SessionStore::newToken() {
+    // 128 bits del RNG de hardware, en hex
+    char hex[33];
+    for (int i = 0; i < 4; i++) snprintf(hex + i * 8, 9, "%08lx", (unsigned long)esp_random());
+    return String(hex);
+}
+
+// Comparación en tiempo constante: no revela cuántos caracteres coinciden
+bool SessionStore::tokenEquals(const String& a, const String& b) {
+    if (a.length() != b.length() || a.length() == 0) return false;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < a.length(); i++) diff |= (uint8_t)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+bool SessionStore::expired(const Session& session, unsigned long now) const {
+    return !session.attached && now - session.detachedAt >= SESSION_TTL_MS;
+}
+
+void SessionStore::prune(unsigned long now) {
+    for (auto it = sessions.begin(); it != sessions.end(); ) {
+        if (expired(it->second, now)) {
+            expiredCount++;
+            it = sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Tabla llena: sale la desconectada hace más tiempo
+    while (sessions.size() >= (size_t)SESSION_MAX) {
+        auto oldest = sessions.end();
+        for (auto it = sessions.begin(); it != sessions.end(); ++it) {
+            if (it->second.attached) continue;
+            if (oldest == sessions.end() || now - it->second.detachedAt > now - oldest->second.detachedAt) oldest = it;
+        }
+        if (oldest == sessions.end()) break;   // todas conectadas: se permite pasar el tope
+        expiredCount++;
+        sessions.erase(oldest);
+    }
+}
+
+String SessionStore::open(const String& moduleId, const String& macAddress, unsigned long now) {
+    sessions.erase(moduleId);
+    prune(now);
+    Session& session = sessions[moduleId];
+    session.token = newToken();
+    session.macAddress = macAddress;
+    openedCount++;
+    return session.token;
+}
+
+SessionStore::Session* SessionStore::resume(const String& moduleId, const String& token, unsigned long now) {
+    auto it = sessions.find(moduleId);
+    if (it == sessions.end() || !tokenEquals(it->second.token, token)) {
+        rejectedCount++;
+        return nullptr;
+    }
+    if (expired(it->second, now)) {
+        expiredCount++;
+        sessions.erase(it);
+        return nullptr;
+    }
+    it->second.attached = true;
+    resumedCount++;
+    return &it->second;
+}
+
+void SessionStore::detach(const String& moduleId, const std::set<String>& subscriptions, unsigned long now) {
+    auto it = sessions.find(moduleId);
+    if (it == sessions.end() || !it->second.attached) return;
+    it->second.subscriptions = subscriptions;
+    it->second.attached = false;
+    it->second.detachedAt = now;
+}
+
+void SessionStore::close(const String& moduleId) {
+    sessions.erase(moduleId);
+}
+
+void SessionStore::toJSON(JsonObject out) const {
+    out["sessions"] = sessions.size();
+    out["ttl_ms"] = SESSION_TTL_MS;
+    out["opened"] = openedCount;
+    out["resumed"] = resumedCount;
+    out["rejected"] = rejectedCount;
+    out["expired"] = expiredCount;
+}
@@ -0,0 +1,51 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <map>
+#include <set>
+#include "../../include/config.h"
+
+// Sesiones de módulos que sobreviven a la conexión TCP (no a un reinicio).
+// Un registro exitoso abre la sesión y entrega un token; al caer la conexión se
+// guardan las suscripciones del slot. Si el módulo vuelve antes de SESSION_TTL_MS
+// con "session_resume" + token, recupera registro, suscripciones y cola de
+// comandos sin repetir module_registration.
+class SessionStore {
+public:
+    struct Session {
+        String token;
+        String macAddress;
+        std::set<String> subscriptions;   // guardadas al desconectarse
+        bool attached = true;             // con conexión (no vence)
+        unsigned long detachedAt = 0;
+    };
+
+    SessionStore();
+
+    // Nueva sesión para el módulo (reemplaza la anterior); devuelve el token
+    String open(const String& moduleId, const String& macAddress, unsigned long now);
+    // Token válido y sin vencer: marca la sesión como conectada. nullptr si no
+    Session* resume(const String& moduleId, const String& token, unsigned long now);
+    // El módulo perdió la conexión: guardar sus suscripciones y empezar a contar el TTL
+    void detach(const String& moduleId, const std::set<String>& subscriptions, unsigned long now);
+    void close(const String& moduleId);
+
+    size_t count() const { return sessions.size(); }
+    void toJSON(JsonObject out) const;
+
+private:
+    std::map<String, Session> sessions;   // moduleId -> sesión
+    unsigned long openedCount;
+    unsigned long resumedCount;
+    unsigned long rejectedCount;
+    unsigned long expiredCount;
+
+    static String newToken();
+    static bool tokenEquals(const String& a, const String& b);
+    bool expired(const Session& session, unsigned long now) const;
+    void prune(unsigned long now);
+};
+
+#endif
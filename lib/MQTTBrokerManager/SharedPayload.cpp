@@ -0,0 +1,43 @@
+#include "SharedPayload.h"
+#include <new>
+#include <string.h>
+
+SharedPayload::Block* SharedPayload::allocate(const char* data, size_t length) {
+    // bytes[1] ya cuenta el '\0'
+    void* memory = ::operator new(sizeof(Block) + length, std::nothrow);
+    if (!memory) return nullptr;
+    Block* created = new (memory) Block;
+    created->refs.store(1, std::memory_order_relaxed);
+    created->length = length;
+    if (length > 0) memcpy(created->bytes, data, length);
+    created->bytes[length] = '\0';
+    return created;
+}
+
+void SharedPayload::release() {
+    if (!block) return;
+    // acq_rel: quien libera ve todas las escrituras hechas con las otras referencias
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        block->~Block();
+        ::operator delete(block);
+    }
+    block = nullptr;
+}
+
+SharedPayload& SharedPayload::operator=(const SharedPayload& other) {
+    if (block != other.block) {
+        release();
+        block = other.block;
+        retain();
+    }
+    return *this;
+}
+
+SharedPayload& SharedPayload::operator=(SharedPayload&& other) {
+    if (this != &other) {
+        release();
+        block = other.block;
+        other.block = nullptr;
+    }
+    return *this;
+}
@@ -0,0 +1,48 @@
+#ifndef SHARED_PAYLOAD_H
+#define SHARED_PAYLOAD_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Trama ya serializada, inmutable y con contador de referencias.
+// Un broadcast o un publish se arma una vez y cada destinatario encola una
+// referencia (copiar un SharedPayload no copia bytes); el buffer se libera
+// cuando la última cola de salida termina de escribirlo.
+//
+// Bloque único en el heap: contador + largo + bytes (+ '\0' para logs).
+// Las referencias cruzan de loop() a la tarea de E/S, por eso el contador es
+// atómico (en el C3 el RMW lo emula ESP-IDF con una sección crítica corta).
+class SharedPayload {
+public:
+    SharedPayload() : block(nullptr) {}
+    explicit SharedPayload(const String& text) : block(allocate(text.c_str(), text.length())) {}
+    SharedPayload(const char* data, size_t length) : block(allocate(data, length)) {}
+
+    SharedPayload(const SharedPayload& other) : block(other.block) { retain(); }
+    SharedPayload(SharedPayload&& other) : block(other.block) { other.block = nullptr; }
+    SharedPayload& operator=(const SharedPayload& other);
+    SharedPayload& operator=(SharedPayload&& other);
+    ~SharedPayload() { release(); }
+
+    const char* data() const { return block ? block->bytes : ""; }
+    size_t length() const { return block ? block->length : 0; }
+    bool empty() const { return length() == 0; }
+    // Referencias vivas (0 = vacío); sólo para estadísticas y pruebas
+    uint32_t useCount() const { return block ? block->refs.load(std::memory_order_relaxed) : 0; }
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs;
+        size_t length;
+        char bytes[1];
+    };
+    Block* block;
+
+    static Block* allocate(const char* data, size_t length);
+    void retain() {
+        if (block) block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release();
+};
+
+#endif
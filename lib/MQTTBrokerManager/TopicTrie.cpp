@@ -0,0 +1,139 @@
+#include "TopicTrie.h"
+
+TopicTrie::TopicTrie() : filters(0) {}
+
+void TopicTrie::split(const String& topic, std::vector<String>& levels) {
+    levels.clear();
+    int start = 0;
+    while (true) {
+        int slash = topic.indexOf('/', start);
+        if (slash < 0) {
+            levels.push_back(topic.substring(start));
+            return;
+        }
+        levels.push_back(topic.substring(start, slash));
+        start = slash + 1;
+    }
+}
+
+bool TopicTrie::isValidFilter(const String& filter) {
+    if (filter.length() == 0) return false;
+    std::vector<String> levels;
+    split(filter, levels);
+    for (size_t i = 0; i < levels.size(); i++) {
+        const String& level = levels[i];
+        if (level == "#") {
+            if (i != levels.size() - 1) return false;
+        } else if (level == "+") {
+            continue;
+        } else if (level.indexOf('#') >= 0 || level.indexOf('+') >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TopicTrie::isValidTopic(const String& topic) {
+    return topic.length() > 0 && topic.indexOf('#') < 0 && topic.indexOf('+') < 0;
+}
+
+bool TopicTrie::matches(const String& filter, const String& topic) {
+    std::vector<String> f, t;
+    split(filter, f);
+    split(topic, t);
+    // Los comodines del primer nivel no coinciden con topics de sistema ($...)
+    if (t[0].startsWith("$") && (f[0] == "+" || f[0] == "#")) return false;
+    size_t i = 0;
+    for (; i < f.size(); i++) {
+        if (f[i] == "#") return true;
+        if (i >= t.size()) return false;
+        if (f[i] != "+" && f[i] != t[i]) return false;
+    }
+    return i == t.size();
+}
+
+bool TopicTrie::subscribe(const String& filter, int clientIndex) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return false;
+    std::vector<String> levels;
+    split(filter, levels);
+
+    Node* node = &root;
+    for (const String& level : levels) {
+        std::unique_ptr<Node>& child = node->children[level];
+        if (!child) child.reset(new Node());
+        node = child.get();
+    }
+    if (node->subscribers.test(clientIndex)) return false;
+    node->subscribers.set(clientIndex);
+    filters++;
+    return true;
+}
+
+bool TopicTrie::unsubscribe(const String& filter, int clientIndex) {
+    if (clientIndex < 0 || clientIndex >= MAX_CLIENTS) return false;
+    std::vector<String> levels;
+    split(filter, levels);
+    return removeFrom(&root, levels, 0, clientIndex);
+}
+
+// Quita la suscripción y poda los nodos que quedan vacíos
+bool TopicTrie::removeFrom(Node* node, const std::vector<String>& levels, size_t depth, int clientIndex) {
+    if (depth == levels.size()) {
+        if (!node->subscribers.test(clientIndex)) return false;
+        node->subscribers.reset(clientIndex);
+        filters--;
+        return true;
+    }
+    auto it = node->children.find(levels[depth]);
+    if (it == node->children.end()) return false;
+    bool removed = removeFrom(it->second.get(), levels, depth + 1, clientIndex);
+    if (removed && it->second->children.empty() && it->second->subscribers.none()) {
+        node->children.erase(it);
+    }
+    return removed;
+}
+
+void TopicTrie::collect(const SubscriberSet& set, SubscriberSet& seen, std::vector<int>& out) {
+    if (set.none()) return;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (set.test(i) && !seen.test(i)) {
+            seen.set(i);
+            out.push_back(i);
+        }
+    }
+}
+
+void TopicTrie::matchLevel(const Node* node, const std::vector<String>& levels, size_t depth,
+                           SubscriberSet& seen, std::vector<int>& out) const {
+    bool systemTopic = (depth == 0 && levels[0].startsWith("$"));
+
+    // '#' coincide con el nivel actual y todos los siguientes ("a/#" también coincide con "a")
+    if (!systemTopic) {
+        auto hash = node->children.find("#");
+        if (hash != node->children.end()) collect(hash->second->subscribers, seen, out);
+    }
+
+    if (depth == levels.size()) {
+        collect(node->subscribers, seen, out);
+        return;
+    }
+
+    auto exact = node->children.find(levels[depth]);
+    if (exact != node->children.end()) {
+        matchLevel(exact->second.get(), levels, depth + 1, seen, out);
+    }
+    if (!systemTopic) {
+        auto plus = node->children.find("+");
+        if (plus != node->children.end()) {
+            matchLevel(plus->second.get(), levels, depth + 1, seen, out);
+        }
+    }
+}
+
+void TopicTrie::match(const String& topic, std::vector<int>& out) const {
+    if (filters == 0) return;
+    std::vector<String> levels;
+    split(topic, levels);
+    SubscriberSet seen;
+    matchLevel(&root, levels, 0, seen, out);
+}
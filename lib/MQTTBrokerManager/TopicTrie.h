@@ -0,0 +1,54 @@
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+
+#include <Arduino.h>
+#include <bitset>
+#include <map>
+#include <memory>
+#include <vector>
+#include "../../include/config.h"
+
+// Árbol de suscripciones por niveles de topic ("a/b/c").
+// Cada nodo guarda el conjunto de slots suscritos a ese filtro exacto;
+// match() recorre sólo las ramas que pueden coincidir (nivel literal, '+' y '#'),
+// así el costo depende de los filtros que coinciden y no de los clientes conectados.
+class TopicTrie {
+public:
+    typedef std::bitset<MAX_CLIENTS> SubscriberSet;
+
+    TopicTrie();
+
+    // Filtros MQTT: '+' ocupa un nivel completo, '#' sólo como último nivel
+    static bool isValidFilter(const String& filter);
+    // Topics de publicación: sin comodines
+    static bool isValidTopic(const String& topic);
+    // ¿El topic coincide con el filtro? (usado p.ej. al revisar retenidos)
+    static bool matches(const String& filter, const String& topic);
+
+    // true si la suscripción es nueva
+    bool subscribe(const String& filter, int clientIndex);
+    // true si existía
+    bool unsubscribe(const String& filter, int clientIndex);
+
+    // Agrega a out (sin duplicados) los slots suscritos a filtros que coinciden con topic
+    void match(const String& topic, std::vector<int>& out) const;
+
+    size_t filterCount() const { return filters; }
+
+private:
+    struct Node {
+        std::map<String, std::unique_ptr<Node>> children;
+        SubscriberSet subscribers;
+    };
+
+    Node root;
+    size_t filters;
+
+    static void split(const String& topic, std::vector<String>& levels);
+    static void collect(const SubscriberSet& set, SubscriberSet& seen, std::vector<int>& out);
+    void matchLevel(const Node* node, const std::vector<String>& levels, size_t depth,
+                    SubscriberSet& seen, std::vector<int>& out) const;
+    bool removeFrom(Node* node, const std::vector<String>& levels, size_t depth, int clientIndex);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <vector>
+#include "../../include/config.h"
+
+// Rueda de temporización "hashed": Slots cubetas de tickMs cada una.
+// schedule() es O(1) y advance() sólo recorre las cubetas cuyos ticks pasaron
+// desde la última llamada, así cada pasada de loop() hace trabajo proporcional
+// a los eventos vencidos y no a la cantidad de módulos/clientes.
+//
+// Los plazos más largos que una vuelta (Slots * tickMs) quedan en su cubeta
+// y se revisan una vez por vuelta hasta vencer. No hay cancelación: el dueño
+// descarta eventos obsoletos al recibirlos (p.ej. comparando una generación
+// guardada en la clave), lo que evita tocar la rueda en cada heartbeat.
+template <typename Key, size_t Slots = TIMER_WHEEL_SLOTS>
+class TimerWheel {
+    static_assert(Slots >= 2 && (Slots & (Slots - 1)) == 0, "TimerWheel: Slots debe ser potencia de 2");
+
+public:
+    struct Timer {
+        Key key;
+        unsigned long deadline;
+    };
+
+    explicit TimerWheel(unsigned long now = 0, unsigned long tickMs = TIMER_WHEEL_TICK_MS)
+        : tickMs(tickMs), cursor(0), cursorTime(now), pending(0) {}
+
+    void schedule(const Key& key, unsigned long deadline) {
+        long delta = (long)(deadline - cursorTime);
+        // Nunca en la cubeta actual (ya procesada): como mínimo el próximo tick
+        unsigned long ticks = (delta <= 0) ? 1 : ((unsigned long)delta + tickMs - 1) / tickMs;
+        if (ticks == 0) ticks = 1;
+        buckets[(cursor + ticks) & (Slots - 1)].push_back(Timer{key, deadline});
+        pending++;
+    }
+
+    // Mueve a expired los eventos vencidos en los ticks transcurridos. Devuelve cuántos
+    size_t advance(unsigned long now, std::vector<Timer>& expired) {
+        unsigned long ticks = (now - cursorTime) / tickMs;
+        if (ticks == 0) return 0;
+
+        size_t before = expired.size();
+        size_t visits = ticks < Slots ? ticks : Slots;
+        size_t start = cursor;
+        for (size_t v = 1; v <= visits; v++) {
+            collect(buckets[(start + v) & (Slots - 1)], now, expired);
+        }
+        cursor = (start + ticks) & (Slots - 1);
+        cursorTime += ticks * tickMs;
+        return expired.size() - before;
+    }
+
+    // Momento del próximo tick con eventos (para el timeout de espera del loop).
+    // Puede adelantarse al vencimiento real si la cubeta tiene plazos de otra vuelta
+    bool nextDeadline(unsigned long& when) const {
+        if (pending == 0) return false;
+        for (size_t v = 1; v <= Slots; v++) {
+            if (!buckets[(cursor + v) & (Slots - 1)].empty()) {
+                when = cursorTime + v * tickMs;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const { return pending; }
+    unsigned long resolution() const { return tickMs; }
+
+private:
+    std::vector<Timer> buckets[Slots];
+    unsigned long tickMs;
+    size_t cursor;             // cubeta del último tick procesado
+    unsigned long cursorTime;  // millis() correspondiente a cursor
+    size_t pending;
+
+    void collect(std::vector<Timer>& bucket, unsigned long now, std::vector<Timer>& expired) {
+        size_t i = 0;
+        while (i < bucket.size()) {
+            if ((long)(now - bucket[i].deadline) >= 0) {
+                expired.push_back(bucket[i]);
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                pending--;
+            } else {
+                i++;
+            }
+        }
+    }
+};
+
+#endif
@@ -2,9 +2,41 @@
 #include "WiFiManager.h"
 #include "DeviceManager.h"
 #include "MQTTBrokerManager.h"
+#ifdef NATIVE_BUILD
+#include <sys/socket.h>
+#include <netinet/in.h>
+#else
+#include <lwip/sockets.h>
+#endif
+
+#ifndef LWIP_SOCKET_OFFSET
+#define LWIP_SOCKET_OFFSET 0
+#endif
+#ifndef CONFIG_LWIP_MAX_SOCKETS
+#define CONFIG_LWIP_MAX_SOCKETS 16
+#endif
+
+// El socket que escucha en el puerto (SO_ACCEPTCONN + getsockname); -1 si todavía no hay
+int DeferringWebServer::listenerFd() {
+    if (listenFd >= 0) return listenFd;
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+        int listening = 0;
+        socklen_t optLen = sizeof(listening);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optLen) != 0 || !listening) continue;
+        // sin_port está en el mismo lugar para IPv4 e IPv6
+        struct sockaddr_storage addr;
+        socklen_t addrLen = sizeof(addr);
+        if (getsockname(fd, (struct sockaddr*)&addr, &addrLen) != 0) continue;
+        if (ntohs(((struct sockaddr_in*)&addr)->sin_port) == port) {
+            listenFd = fd;
+            break;
+        }
+    }
+    return listenFd;
+}
 
 WebServerManager::WebServerManager(WiFiManager* wifiMgr, DeviceManager* deviceMgr) 
-    : webServer(80), wifiManager(wifiMgr), deviceManager(deviceMgr), mqttBrokerManager(nullptr) {
+    : webServer(80), wifiManager(wifiMgr), deviceManager(deviceMgr), mqttBrokerManager(nullptr), parkedRequests(0) {
 }
 
 // Nuevo setter para inyectar MQTTBrokerManager después de la construcción
@@ -23,6 +55,21 @@ void WebServerManager::handleClient() {
     webServer.handleClient();
 }
 
+void WebServerManager::registerEvents(EventLoop& loop) {
+    loop.addSource("web",
+        [this](EventLoop& l) {
+            // Sin conexión en curso sólo hay que esperar un accept: el listener en select()
+            int fd = webServer.listenerFd();
+            if (fd >= 0 && !webServer.busy()) {
+                l.watchReadable(fd);
+                return;
+            }
+            // Leyendo un pedido (o sin listener encontrado): consultar seguido
+            l.wakeAfter(EVENT_LOOP_INTERACTIVE_POLL_MS);
+        },
+        [this]() { handleClient(); });
+}
+
 void WebServerManager::setupRoutes() {
     // Rutas principales
     webServer.on("/", HTTP_GET, [this]() { handleRoot(); });
@@ -49,6 +96,15 @@ void WebServerManager::setupRoutes() {
         webServer.send(200, "application/json", responseStr);
     });
 
+    // Métricas del broker TCP (tramas descartadas, buffers por slot, etc.)
+    webServer.on("/api/broker/stats", HTTP_GET, [this]() {
+        if (!mqttBrokerManager) {
+            webServer.send(503, "application/json", "{\"success\":false,\"message\":\"broker no disponible\"}");
+            return;
+        }
+        webServer.send(200, "application/json", mqttBrokerManager->getBrokerStatsJSON());
+    });
+
     // --- NUEVO: Endpoint para desregistrar módulo ---
     webServer.on("/api/modules/deregister", HTTP_POST, [this]() {
         DynamicJsonDocument response(512);
@@ -231,6 +287,7 @@ void WebServerManager::handleModuleAction() {
     String moduleId = doc["moduleId"] | "";
     String action   = doc["action"]   | "";
     JsonVariant params = doc["params"]; // puede ser null
+    unsigned long waitMs = doc["wait_ms"] | 0UL; // > 0: responder con el resultado del módulo
 
     if (moduleId == "" || action == "") {
         webServer.send(400, "application/json", "{\"success\":false,\"message\":\"moduleId o acción faltante\"}");
@@ -243,6 +300,11 @@ void WebServerManager::handleModuleAction() {
     Serial.print  ("  params: ");
     serializeJson(params, Serial); Serial.println();
 
+    if (waitMs > 0 && mqttBrokerManager) {
+        handleModuleActionWait(moduleId, action, params, waitMs);
+        return;
+    }
+
     bool ok = false;
     if (mqttBrokerManager) {
         // >>> Reenvío REAL al broker, con params <<<
@@ -258,6 +320,65 @@ void WebServerManager::handleModuleAction() {
     webServer.send(200, "application/json", respStr);
 }
 
+// Modo sincrónico: no se responde ahora. La conexión queda abierta (copia del
+// WiFiClient) y el callback del comando escribe la respuesta cuando llega la del
+// módulo, o 504 al vencer wait_ms. Se suelta del WebServer para que no la retenga
+// en HC_WAIT_CLOSE (2 s sin atender otras peticiones).
+void WebServerManager::handleModuleActionWait(const String& moduleId, const String& action,
+                                              JsonVariantConst params, unsigned long waitMs) {
+    if (waitMs > WEB_ACTION_MAX_WAIT_MS) waitMs = WEB_ACTION_MAX_WAIT_MS;
+    if (parkedRequests >= WEB_MAX_PARKED_REQUESTS) {
+        webServer.send(503, "application/json", "{\"success\":false,\"message\":\"Demasiadas acciones esperando respuesta\"}");
+        return;
+    }
+
+    WiFiClient client = webServer.client();
+    uint32_t requestId = mqttBrokerManager->sendCommandWithReply(moduleId, action, params,
+        [this, client, moduleId, action, waitMs](const CommandTracker::Result& result) mutable {
+            parkedRequests--;
+            size_t replySize = result.completed ? measureJson(result.reply) : 0;
+            DynamicJsonDocument resp(384 + replySize * 2);
+            resp["success"] = result.completed;
+            resp["moduleId"] = moduleId;
+            resp["action"] = action;
+            resp["request_id"] = result.requestId;
+            if (result.completed) {
+                resp["message"] = "Respuesta del módulo recibida";
+                resp["rtt_ms"] = result.rttMs;
+                resp["response"] = result.reply;
+            } else {
+                resp["message"] = "El módulo no respondió en " + String(waitMs) + " ms (el comando fue enviado)";
+            }
+            String body;
+            serializeJson(resp, body);
+            sendParkedResponse(client, result.completed ? 200 : 504, body);
+        }, waitMs);
+
+    if (requestId == 0) {
+        webServer.send(200, "application/json",
+                       "{\"success\":false,\"message\":\"No se pudo enviar la acción (broker no disponible)\"}");
+        return;
+    }
+    parkedRequests++;
+    webServer.detachClient();
+    Serial.println("[WebServer] Acción " + action + " esperando respuesta (request_id " + String(requestId) + ")");
+}
+
+void WebServerManager::sendParkedResponse(WiFiClient& client, int code, const String& body) {
+    if (!client.connected()) {
+        Serial.println("[WebServer] El cliente HTTP cerró antes de la respuesta del módulo");
+        client.stop();
+        return;
+    }
+    String head = "HTTP/1.1 " + String(code) + (code == 200 ? " OK" : " Gateway Timeout") + "\r\n";
+    head += "Content-Type: application/json\r\n";
+    head += "Content-Length: " + String(body.length()) + "\r\n";
+    head += "Connection: close\r\n\r\n";
+    client.print(head);
+    client.print(body);
+    client.stop();
+}
+
 void WebServerManager::handleRoot() {
     webServer.send(200, "text/html", getAdminHTML());
 }
@@ -271,6 +392,8 @@ void WebServerManager::handleSystemInfo() {
     response["ap_ip"] = wifiManager->getAPIP();
     response["uptime"] = millis();
     response["free_heap"] = ESP.getFreeHeap();
+    response["largest_free_block"] = ESP.getMaxAllocHeap();
+    response["heap_fragmentation_pct"] = MQTTBrokerManager::getHeapFragmentationPercent();
     response["connected_clients"] = wifiManager->getConnectedClients();
     response["registered_modules"] = deviceManager->getRegisteredModulesCount();
     response["authorized_devices"] = deviceManager->getAuthorizedDevicesCount();
@@ -7,6 +7,7 @@
 #include <map>
 
 #include "../../include/config.h"
+#include "../EventLoop/EventLoop.h"
 #include "../../src/web_interface.h"
 
 // Forward declarations
@@ -16,6 +17,26 @@ class MQTTBrokerManager; // <-- add forward declaration for MQTTBrokerManager
 
 struct AuthorizedDevice; // Forward declaration
 
+// WebServer del core con salida para respuestas diferidas. Un handler que vuelve
+// sin send() deja la conexión en HC_WAIT_CLOSE hasta HTTP_MAX_CLOSE_WAIT (2 s) y
+// mientras tanto handleClient() no acepta ninguna otra. detachClient() suelta la
+// conexión en curso (la copia del WiFiClient sigue abierta) y el servidor pasa
+// enseguida a la próxima.
+// listenerFd(): el socket lwIP del WiFiServer interno (que no lo expone), para
+// esperarlo en select() en vez de consultar por intervalo
+class DeferringWebServer : public WebServer {
+public:
+    explicit DeferringWebServer(int port) : WebServer(port), port(port), listenFd(-1) {}
+    void detachClient() { _currentClient = WiFiClient(); }
+    // Hay una conexión en curso (leyendo el pedido o esperando el cierre)
+    bool busy() const { return _currentStatus != HC_NONE; }
+    int listenerFd();
+
+private:
+    int port;
+    int listenFd;
+};
+
 class WebServerManager {
 public:
     // Ajustado: constructor con 2 parámetros para coincidir con implementación y uso en main.cpp
@@ -24,6 +45,8 @@ public:
     // Métodos públicos
     void initialize();
     void handleClient();
+    // Listener HTTP (y la conexión en curso) como fuente del loop de eventos
+    void registerEvents(EventLoop& loop);
 
     // Nuevo: inyectar MQTTBrokerManager después de la creación
     void setMQTTBrokerManager(MQTTBrokerManager* mgr);
@@ -35,7 +58,10 @@ private:
     MQTTBrokerManager* mqttBrokerManager; // forward-declared pointer, ok in header
     
     // Servidor web
-    WebServer webServer;
+    DeferringWebServer webServer;
+
+    // /api/modules/action con wait_ms esperando la respuesta del módulo
+    int parkedRequests;
     
     // Credenciales
     const String ADMIN_USER = "admin";
@@ -47,6 +73,9 @@ private:
     // Handlers de rutas
     void handleRoot();
     void handleModuleAction();
+    void handleModuleActionWait(const String& moduleId, const String& action,
+                                JsonVariantConst params, unsigned long waitMs);
+    void sendParkedResponse(WiFiClient& client, int code, const String& body);
     void handleAdmin();
     void handleSystemInfo();
     void handleLogin();
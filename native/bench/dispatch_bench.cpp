@@ -0,0 +1,51 @@
+// Microbenchmark del despacho por tipo de mensaje (MQTTBrokerManager::processMessage).
+// Compara la cadena anterior de comparaciones String == contra classifyMessageType().
+//   pio run -e bench_dispatch && .pio/build/bench_dispatch/program
+#include <Arduino.h>
+#include <chrono>
+#include <cstdio>
+#include "MessageTypes.h"
+
+static const int ITERATIONS = 1000000;
+
+// Réplica del despacho anterior: String temporal + hasta 15 comparaciones
+static int legacyDispatch(const char* type) {
+    String msgType = String(type);
+    if (msgType == "module_registration") return 1;
+    else if (msgType == "mac_response" || msgType == "mac") return 2;
+    else if (msgType == "device_info" || msgType == "info_response") return 3;
+    else if (msgType == "scan_response" || msgType == "device_scan") return 4;
+    else if (msgType == "heartbeat") return 5;
+    else if (msgType == "ping_response") return 6;
+    else if (msgType == "publish") return 7;
+    else if (msgType == "subscribe") return 8;
+    else if (msgType == "unsubscribe") return 9;
+    return 0;
+}
+
+template <typename F>
+static double nsPerCall(const char* type, F dispatch) {
+    volatile int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink = sink + dispatch(type);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+int main() {
+    const char* types[] = {
+        "module_registration", "mac_response", "mac", "device_info", "info_response",
+        "scan_response", "device_scan", "heartbeat", "ping_response",
+        "publish", "subscribe", "unsubscribe", "command_response"
+    };
+
+    printf("%-22s %12s %12s %8s\n", "type", "legacy ns", "table ns", "speedup");
+    for (const char* type : types) {
+        double legacy = nsPerCall(type, legacyDispatch);
+        double table = nsPerCall(type, [](const char* t) { return (int)classifyMessageType(t); });
+        printf("%-22s %12.1f %12.1f %7.1fx\n", type, legacy, table, legacy / table);
+    }
+    return 0;
+}
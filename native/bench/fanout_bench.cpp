@@ -0,0 +1,191 @@
+// Benchmark del fan-out de una trama a N clientes (broadcast / publish a N suscriptores).
+// Compara la ruta anterior (un String por destinatario: copia al ring de salida,
+// copia a la cola del slot y copia al scratch de coalescencia antes del send)
+// contra SharedPayload (se serializa una vez; cada cola guarda una referencia y
+// flush() manda con sendmsg apuntando al buffer compartido).
+// Los clientes son socketpairs locales; el otro extremo se vacía en cada pasada.
+//   pio run -e bench_fanout && .pio/build/bench_fanout/program
+#include <Arduino.h>
+#include <WiFi.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ClientTxQueue.h"
+#include "SharedPayload.h"
+
+// ---- Conteo de reservas de heap (todo lo que pasa por operator new) ----
+static size_t allocCount = 0;
+static size_t allocBytes = 0;
+
+void* operator new(size_t size) {
+    allocCount++;
+    allocBytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocCount++;
+    allocBytes += size;
+    return malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+
+static const int ROUNDS = 2000;
+
+struct Result {
+    double nsPerRound;
+    double allocsPerRound;
+    double heapBytesPerRound;
+    double copiedPerRound;   // bytes de la trama copiados en espacio de usuario
+};
+
+struct Peer {
+    int local;    // lado del broker
+    int remote;   // lado del "cliente", se vacía en cada pasada
+    WiFiClient client;
+};
+
+static void openPeers(std::vector<Peer>& peers, int count) {
+    peers.resize(count);
+    for (auto& p : peers) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        p.local = sv[0];
+        p.remote = sv[1];
+        p.client = WiFiClient(sv[0]);
+    }
+}
+
+static void drainPeers(std::vector<Peer>& peers, size_t& received) {
+    static char sink[16384];
+    for (auto& p : peers) {
+        ssize_t n;
+        while ((n = recv(p.remote, sink, sizeof(sink), MSG_DONTWAIT)) > 0) received += (size_t)n;
+    }
+}
+
+static void closePeers(std::vector<Peer>& peers) {
+    for (auto& p : peers) close(p.remote);
+    peers.clear();   // el WiFiClient cierra el lado local
+}
+
+// Ruta anterior: Command con String, std::deque<String> por slot y coalescencia en scratch
+struct LegacyCommand {
+    int slot;
+    String data;
+};
+
+static Result runLegacy(const String& frame, int clients, size_t& received) {
+    std::vector<Peer> peers;
+    openPeers(peers, clients);
+    std::vector<std::deque<String>> queues(clients);
+    std::vector<LegacyCommand> ring;
+    ring.reserve(clients);
+    static uint8_t scratch[MQTT_TX_COALESCE_BYTES];
+    size_t copied = 0;
+
+    allocCount = allocBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        // loop(): enqueueToClient(i, message) por destinatario -> copia al ring
+        for (int i = 0; i < clients; i++) {
+            ring.push_back(LegacyCommand{i, frame});
+            copied += frame.length();
+        }
+        // tarea de E/S: applyCommands() -> copia a la cola del slot
+        for (auto& cmd : ring) {
+            queues[cmd.slot].push_back(cmd.data);
+            copied += cmd.data.length();
+        }
+        ring.clear();
+        // flushSlot(): cuerpo + "\r\n" al scratch y un send
+        for (int i = 0; i < clients; i++) {
+            auto& q = queues[i];
+            while (!q.empty()) {
+                const String& m = q.front();
+                size_t len = 0;
+                for (size_t j = 0; j < m.length() + 2 && len < sizeof(scratch); j++) {
+                    scratch[len++] = (j < m.length()) ? (uint8_t)m[j] : (j == m.length() ? '\r' : '\n');
+                }
+                copied += len;
+                ::send(peers[i].local, scratch, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+                q.pop_front();
+            }
+        }
+        drainPeers(peers, received);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    Result res{ ns / ROUNDS, (double)allocCount / ROUNDS, (double)allocBytes / ROUNDS, (double)copied / ROUNDS };
+    closePeers(peers);
+    return res;
+}
+
+// Ruta actual: una SharedPayload por trama, ClientTxQueue real con sendmsg
+struct SharedCommand {
+    int slot;
+    SharedPayload data;
+};
+
+static Result runShared(const String& frame, int clients, size_t& received) {
+    std::vector<Peer> peers;
+    openPeers(peers, clients);
+    std::vector<ClientTxQueue> queues(clients);
+    std::vector<SharedCommand> ring;
+    ring.reserve(clients);
+    size_t copied = 0;
+
+    allocCount = allocBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        // sendToAllClients(): se copia una vez y se encola la referencia
+        SharedPayload shared(frame);
+        copied += frame.length();
+        for (int i = 0; i < clients; i++) ring.push_back(SharedCommand{i, shared});
+        for (auto& cmd : ring) queues[cmd.slot].push(cmd.data, ClientTxQueue::DROP_OLDEST);
+        ring.clear();
+        for (int i = 0; i < clients; i++) {
+            while (!queues[i].empty()) {
+                if (queues[i].flush(peers[i].client) <= 0) break;
+            }
+        }
+        drainPeers(peers, received);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    Result res{ ns / ROUNDS, (double)allocCount / ROUNDS, (double)allocBytes / ROUNDS, (double)copied / ROUNDS };
+    closePeers(peers);
+    return res;
+}
+
+int main() {
+    const int clientCounts[] = { 1, 4, 10, 32 };
+    const size_t frameSizes[] = { 150, 1024 };
+    printf("%6s %7s | %10s %8s %10s %10s | %10s %8s %10s %10s\n", "bytes", "clients",
+           "legacy ns", "allocs", "heap B", "copied B", "shared ns", "allocs", "heap B", "copied B");
+    for (size_t size : frameSizes) {
+        String frame;
+        // Mayor que el SSO del String nativo: cada copia va al heap, como en el ESP32
+        for (size_t i = 0; i < size; i++) frame += (char)('a' + i % 26);
+        for (int clients : clientCounts) {
+            size_t receivedLegacy = 0, receivedShared = 0;
+            Result legacy = runLegacy(frame, clients, receivedLegacy);
+            Result shared = runShared(frame, clients, receivedShared);
+            printf("%6zu %7d | %10.0f %8.1f %10.0f %10.0f | %10.0f %8.1f %10.0f %10.0f%s\n",
+                   size, clients,
+                   legacy.nsPerRound, legacy.allocsPerRound, legacy.heapBytesPerRound, legacy.copiedPerRound,
+                   shared.nsPerRound, shared.allocsPerRound, shared.heapBytesPerRound, shared.copiedPerRound,
+                   receivedLegacy == receivedShared ? "" : "  (bytes recibidos distintos!)");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Benchmark de la codificación MessagePack negociada contra líneas JSON.
+// Toma tramas grabadas del tráfico módulo <-> broker, las convierte a MessagePack
+// (2 bytes de largo + cuerpo, como las manda MQTTBrokerManager) y mide bytes en
+// el cable y tiempo de parseo con el mismo documento que usa processMessage().
+//   pio run -e bench_msgpack && .pio/build/bench_msgpack/program
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../../include/config.h"
+
+static const int ITERATIONS = 200000;
+
+// Tramas tal como salen de examples/fingerprint_client_project y del broker
+static const char* const FRAMES[] = {
+    "{\"type\":\"heartbeat\",\"module_id\":\"fingerprint_4b224f7c630\",\"timestamp\":1234567}",
+    "{\"type\":\"ping\",\"timestamp\":30015234,\"message\":\"keep-alive\"}",
+    "{\"type\":\"ping_response\",\"module_id\":\"fingerprint_4b224f7c630\",\"timestamp\":30015301}",
+    "{\"type\":\"command\",\"module_id\":\"fingerprint_4b224f7c630\",\"command\":\"scan_fingerprint\","
+        "\"params\":{\"timeout\":15000,\"security_level\":\"normal\",\"return_image\":false},\"request_id\":1234}",
+    "{\"type\":\"command_ack\",\"module_id\":\"fingerprint_4b224f7c630\",\"request_id\":1234}",
+    "{\"type\":\"fingerprint_scan_result\",\"module_id\":\"fingerprint_4b224f7c630\",\"success\":true,"
+        "\"user_id\":17,\"confidence\":142,\"message\":\"Huella reconocida\",\"request_id\":1234,\"timestamp\":30018112}",
+    "{\"type\":\"publish\",\"topic\":\"devices/fingerprint_4b224f7c630/events\",\"payload\":{\"event\":\"fingerprint_list\","
+        "\"module_id\":\"fingerprint_4b224f7c630\",\"timestamp\":1234567890,\"data\":{\"registered_ids\":[1,3,5,8,9,12,14,20],"
+        "\"registered_names\":[\"Juan\",\"María\",\"Pedro\",\"Sin nombre\",\"Ana\",\"Luis\",\"Sofía\",\"Marta\"],"
+        "\"total_count\":8,\"success\":true}}}"
+};
+
+struct Frame {
+    const char* name;
+    String json;
+    std::vector<uint8_t> packed;   // con los 2 bytes de largo
+};
+
+template <typename F>
+static double nsPerParse(F parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (parse()) {
+            printf("error de parseo\n");
+            return 0;
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+int main() {
+    DynamicJsonDocument doc(JSON_POOL_DOC_CAPACITY);
+    std::vector<Frame> frames;
+    for (const char* text : FRAMES) {
+        Frame frame;
+        frame.json = text;
+        deserializeJson(doc, frame.json);
+        frame.name = strdup(doc["type"] | "?");
+        size_t length = measureMsgPack(doc);
+        frame.packed.resize(length + 2);
+        frame.packed[0] = (uint8_t)(length >> 8);
+        frame.packed[1] = (uint8_t)length;
+        serializeMsgPack(doc, frame.packed.data() + 2, length);
+        frames.push_back(frame);
+    }
+
+    printf("%-24s %7s %8s %7s | %10s %10s %8s\n", "frame", "json B", "msgpack", "saved",
+           "json ns", "msgpack ns", "speedup");
+    size_t totalJson = 0, totalPacked = 0;
+    double totalJsonNs = 0, totalPackedNs = 0;
+    for (const Frame& frame : frames) {
+        // En el cable la línea JSON lleva "\r\n"; la trama empaquetada, su largo
+        size_t jsonBytes = frame.json.length() + 2;
+        size_t packedBytes = frame.packed.size();
+        double jsonNs = nsPerParse([&]() {
+            return (bool)deserializeJson(doc, frame.json.c_str(), frame.json.length());
+        });
+        double packedNs = nsPerParse([&]() {
+            return (bool)deserializeMsgPack(doc, (const char*)frame.packed.data() + 2, frame.packed.size() - 2);
+        });
+        printf("%-24s %7zu %8zu %6.1f%% | %10.0f %10.0f %7.2fx\n", frame.name, jsonBytes, packedBytes,
+               100.0 * (1.0 - (double)packedBytes / jsonBytes), jsonNs, packedNs, jsonNs / packedNs);
+        totalJson += jsonBytes;
+        totalPacked += packedBytes;
+        totalJsonNs += jsonNs;
+        totalPackedNs += packedNs;
+    }
+    printf("%-24s %7zu %8zu %6.1f%% | %10.0f %10.0f %7.2fx\n", "total", totalJson, totalPacked,
+           100.0 * (1.0 - (double)totalPacked / totalJson), totalJsonNs, totalPackedNs, totalJsonNs / totalPackedNs);
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Benchmark del vencimiento de heartbeats con miles de módulos simulados.
+// Compara el recorrido completo por pasada (checkModuleHeartbeats anterior)
+// contra TimerWheel, con un reloj simulado que avanza 10 ms por pasada de loop().
+//   pio run -e bench_timers && .pio/build/bench_timers/program
+#include <Arduino.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "TimerWheel.h"
+
+static const unsigned long PASS_MS = 10;            // delay(10) de loop()
+static const unsigned long TIMEOUT_MS = 60000;      // heartbeatInterval * 2
+static const unsigned long SIM_MS = 5 * 60 * 1000;  // 5 minutos simulados
+
+struct SimModule {
+    unsigned long lastHeartbeat;
+    unsigned long period;     // cada cuánto manda heartbeat (0 = nunca más)
+    bool isActive;
+    uint32_t expiryTimer;
+};
+
+struct Key {
+    uint32_t index;
+    uint32_t generation;
+};
+
+// Un 5% de los módulos deja de mandar heartbeats para que haya vencimientos
+static void makeModules(std::vector<SimModule>& modules, size_t count) {
+    modules.assign(count, SimModule());
+    for (size_t i = 0; i < count; i++) {
+        modules[i].lastHeartbeat = 0;
+        modules[i].period = (i % 20 == 0) ? 0 : 25000 + (esp_random() % 10000);
+        modules[i].isActive = true;
+        modules[i].expiryTimer = 0;
+    }
+}
+
+// Los heartbeats llegan igual en ambos casos; sólo se mide la detección de vencidos
+static void deliverHeartbeats(std::vector<SimModule>& modules, unsigned long now) {
+    for (size_t i = 0; i < modules.size(); i++) {
+        SimModule& m = modules[i];
+        if (m.period && now - m.lastHeartbeat >= m.period) m.lastHeartbeat = now;
+    }
+}
+
+static double runScan(size_t count, size_t& expiredOut) {
+    std::vector<SimModule> modules;
+    makeModules(modules, count);
+    double ns = 0;
+    expiredOut = 0;
+    for (unsigned long now = 0; now < SIM_MS; now += PASS_MS) {
+        deliverHeartbeats(modules, now);
+        auto start = std::chrono::steady_clock::now();
+        for (auto& m : modules) {
+            if (m.isActive && now - m.lastHeartbeat > TIMEOUT_MS) {
+                m.isActive = false;
+                expiredOut++;
+            }
+        }
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    return ns / (SIM_MS / PASS_MS);
+}
+
+static double runWheel(size_t count, size_t& expiredOut) {
+    std::vector<SimModule> modules;
+    makeModules(modules, count);
+    TimerWheel<Key> wheel(0);
+    std::vector<TimerWheel<Key>::Timer> expired;
+    uint32_t generation = 0;
+    for (size_t i = 0; i < count; i++) {
+        modules[i].expiryTimer = ++generation;
+        wheel.schedule(Key{(uint32_t)i, generation}, modules[i].lastHeartbeat + TIMEOUT_MS);
+    }
+
+    double ns = 0;
+    expiredOut = 0;
+    for (unsigned long now = 0; now < SIM_MS; now += PASS_MS) {
+        deliverHeartbeats(modules, now);
+        auto start = std::chrono::steady_clock::now();
+        if (wheel.advance(now, expired) > 0) {
+            for (const auto& t : expired) {
+                SimModule& m = modules[t.key.index];
+                if (m.expiryTimer != t.key.generation) continue;
+                m.expiryTimer = 0;
+                if (now - m.lastHeartbeat > TIMEOUT_MS) {
+                    m.isActive = false;
+                    expiredOut++;
+                } else {
+                    m.expiryTimer = ++generation;
+                    wheel.schedule(Key{t.key.index, generation}, m.lastHeartbeat + TIMEOUT_MS);
+                }
+            }
+            expired.clear();
+        }
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    return ns / (SIM_MS / PASS_MS);
+}
+
+int main() {
+    const size_t counts[] = { 10, 100, 1000, 5000, 10000 };
+    printf("%8s %14s %14s %9s %9s\n", "modules", "scan ns/pass", "wheel ns/pass", "expired", "speedup");
+    for (size_t count : counts) {
+        size_t expiredScan = 0, expiredWheel = 0;
+        double scan = runScan(count, expiredScan);
+        double wheel = runWheel(count, expiredWheel);
+        printf("%8zu %14.1f %14.1f %4zu/%-4zu %8.1fx\n",
+               count, scan, wheel, expiredScan, expiredWheel, scan / wheel);
+    }
+    return 0;
+}
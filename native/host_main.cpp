@@ -0,0 +1,73 @@
+// Punto de entrada del build nativo (pio run -e native).
+// Reproduce setup()/loop() de src/main.cpp sin WiFi ni servidor web:
+// el broker escucha en 0.0.0.0:MQTT_PORT usando sockets POSIX.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+#include "WiFiManager.h"
+#include "MQTTBrokerManager.h"
+#include "DeviceManager.h"
+#include "EEPROMManager.h"
+#include "Logger.h"
+#include "EventLoop.h"
+
+// pio test compila src/ y los shims junto con test/: cada test trae su main()
+#ifndef PIO_UNIT_TESTING
+
+// Managers del sistema
+WiFiManager* wifiManager;
+MQTTBrokerManager* mqttBrokerManager;
+DeviceManager* deviceManager;
+EEPROMManager* eepromManager;
+EventLoop eventLoop;
+
+void setup() {
+  Serial.begin(SERIAL_BAUDRATE);
+
+  Serial.println();
+  Serial.println("==============================================");
+  Serial.println("🚀 Iniciando Broker MQTT Modular (nativo)");
+  Serial.println("==============================================");
+
+  // 1) "Wi-Fi": en Linux la red ya está disponible
+  wifiManager = new WiFiManager();
+
+  // 2) MQTT broker
+  mqttBrokerManager = new MQTTBrokerManager(wifiManager, nullptr);
+  // 3) EEPROM (emulada en archivo)
+  eepromManager = new EEPROMManager();
+  eepromManager->begin();
+  // 4) Devices
+  deviceManager = new DeviceManager(wifiManager, mqttBrokerManager, eepromManager);
+  deviceManager->initialize();
+  Logger::flush();
+  mqttBrokerManager->setDeviceManager(deviceManager);
+  mqttBrokerManager->initialize();
+
+  mqttBrokerManager->registerEvents(eventLoop);
+  deviceManager->registerEvents(eventLoop);
+  eventLoop.addSource("log",
+      [](EventLoop& loop) { if (Logger::pending() > 0) loop.wakeNow(); },
+      []() { Logger::drain(); });
+
+  Logger::flush();
+  Serial.println("✅ Sistema modular listo");
+  Serial.println("==============================================");
+}
+
+void loop() {
+    // Mismo esquema que src/main.cpp (sin webServerManager)
+    eventLoop.runOnce();
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    setup();
+    for (;;) {
+        loop();
+    }
+    return 0;
+}
+
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,136 @@
+#include "Arduino.h"
+#include <chrono>
+#include <thread>
+#include <random>
+#include <unistd.h>
+#include <poll.h>
+
+HostSerial Serial;
+EspClass ESP;
+
+static const auto bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+uint32_t esp_random() {
+    static std::mt19937 rng(std::random_device{}());
+    return rng();
+}
+
+// =================================
+// Stream
+// =================================
+int Stream::timedRead() {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0) return c;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = timedRead();
+        if (c < 0) break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+String Stream::readStringUntil(char terminator) {
+    String ret;
+    int c = timedRead();
+    while (c >= 0 && c != terminator) {
+        ret += (char)c;
+        c = timedRead();
+    }
+    return ret;
+}
+
+String Stream::readString() {
+    String ret;
+    int c = timedRead();
+    while (c >= 0) {
+        ret += (char)c;
+        c = timedRead();
+    }
+    return ret;
+}
+
+// =================================
+// HostSerial: stdout + stdin sin bloquear
+// =================================
+size_t HostSerial::write(uint8_t c) {
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HostSerial::write(const uint8_t* buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HostSerial::flush() {
+    fflush(stdout);
+}
+
+int HostSerial::available() {
+    if (_peeked >= 0) return 1;
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) ? 1 : 0;
+}
+
+int HostSerial::read() {
+    if (_peeked >= 0) {
+        int c = _peeked;
+        _peeked = -1;
+        return c;
+    }
+    if (!available()) return -1;
+    unsigned char c;
+    return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int HostSerial::peek() {
+    if (_peeked < 0) _peeked = read();
+    return _peeked;
+}
+
+// =================================
+// ESP
+// =================================
+void EspClass::restart() {
+    fflush(stdout);
+    exit(0);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    // No hay un equivalente significativo en Linux
+    return 0;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return 0;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return 0;
+}
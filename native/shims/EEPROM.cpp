@@ -0,0 +1,50 @@
+#include "EEPROM.h"
+#include <cstdlib>
+
+EEPROMClass EEPROM;
+
+const char* EEPROMClass::path() const {
+    const char* env = getenv("NATIVE_EEPROM_FILE");
+    return env ? env : "native_eeprom.bin";
+}
+
+bool EEPROMClass::begin(size_t size) {
+    if (_data.size() == size) return true;
+    _data.assign(size, 0xFF);
+    FILE* f = fopen(path(), "rb");
+    if (f) {
+        size_t n = fread(_data.data(), 1, size, f);
+        (void)n;
+        fclose(f);
+    }
+    _dirty = false;
+    return true;
+}
+
+void EEPROMClass::end() {
+    commit();
+    _data.clear();
+}
+
+uint8_t EEPROMClass::read(int address) {
+    if (address < 0 || (size_t)address >= _data.size()) return 0;
+    return _data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+    if (address < 0 || (size_t)address >= _data.size()) return;
+    if (_data[address] != value) {
+        _data[address] = value;
+        _dirty = true;
+    }
+}
+
+bool EEPROMClass::commit() {
+    if (!_dirty) return true;
+    FILE* f = fopen(path(), "wb");
+    if (!f) return false;
+    size_t n = fwrite(_data.data(), 1, _data.size(), f);
+    fclose(f);
+    _dirty = false;
+    return n == _data.size();
+}
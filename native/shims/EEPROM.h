@@ -0,0 +1,44 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+// EEPROM emulada sobre un archivo (por defecto native_eeprom.bin en el
+// directorio de trabajo; se puede cambiar con la variable NATIVE_EEPROM_FILE).
+
+#include "Arduino.h"
+#include <vector>
+
+class EEPROMClass {
+public:
+    bool begin(size_t size);
+    void end();
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    size_t length() const { return _data.size(); }
+
+    template <typename T>
+    T& get(int address, T& t) {
+        if (address >= 0 && address + sizeof(T) <= _data.size()) {
+            memcpy((uint8_t*)&t, &_data[address], sizeof(T));
+        }
+        return t;
+    }
+
+    template <typename T>
+    const T& put(int address, const T& t) {
+        if (address >= 0 && address + sizeof(T) <= _data.size()) {
+            memcpy(&_data[address], (const uint8_t*)&t, sizeof(T));
+            _dirty = true;
+        }
+        return t;
+    }
+
+private:
+    std::vector<uint8_t> _data;
+    bool _dirty = false;
+    const char* path() const;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // NATIVE_EEPROM_H
@@ -0,0 +1,172 @@
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+// Shim de Arduino String para el build nativo (Linux).
+// Implementa sólo la API que usan los managers, sobre std::string.
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+
+#ifndef DEC
+#define DEC 10
+#endif
+#ifndef HEX
+#define HEX 16
+#endif
+
+class String {
+public:
+    String() {}
+    String(const char* cstr) : s(cstr ? cstr : "") {}
+    String(const char* cstr, unsigned int len) : s(cstr ? std::string(cstr, len) : std::string()) {}
+    String(const std::string& str) : s(str) {}
+    String(const String& other) = default;
+    String(String&& other) = default;
+    explicit String(char c) : s(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : s(fromUnsigned(value, base)) {}
+    explicit String(int value, unsigned char base = 10) : s(fromSigned(value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : s(fromUnsigned(value, base)) {}
+    explicit String(long value, unsigned char base = 10) : s(fromSigned(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : s(fromUnsigned(value, base)) {}
+    explicit String(long long value, unsigned char base = 10) : s(fromSigned(value, base)) {}
+    explicit String(unsigned long long value, unsigned char base = 10) : s(fromUnsigned(value, base)) {}
+    explicit String(float value, unsigned char decimals = 2) : s(fromDouble(value, decimals)) {}
+    explicit String(double value, unsigned char decimals = 2) : s(fromDouble(value, decimals)) {}
+
+    String& operator=(const String& rhs) = default;
+    String& operator=(String&& rhs) = default;
+    String& operator=(const char* cstr) { s = cstr ? cstr : ""; return *this; }
+
+    // Capacidad / acceso
+    unsigned int length() const { return (unsigned int)s.length(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    const char* c_str() const { return s.c_str(); }
+    char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+    void setCharAt(unsigned int index, char c) { if (index < s.length()) s[index] = c; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index) { return s[index]; }
+    explicit operator bool() const { return true; }
+    const std::string& str() const { return s; }
+
+    // Concatenación (ArduinoJson usa concat(const char*))
+    bool concat(const String& str) { s += str.s; return true; }
+    bool concat(const char* cstr) { if (!cstr) return false; s += cstr; return true; }
+    bool concat(const char* cstr, unsigned int len) { if (!cstr) return false; s.append(cstr, len); return true; }
+    bool concat(char c) { s += c; return true; }
+    bool concat(unsigned char num) { s += fromUnsigned(num, 10); return true; }
+    bool concat(int num) { s += fromSigned(num, 10); return true; }
+    bool concat(unsigned int num) { s += fromUnsigned(num, 10); return true; }
+    bool concat(long num) { s += fromSigned(num, 10); return true; }
+    bool concat(unsigned long num) { s += fromUnsigned(num, 10); return true; }
+    bool concat(double num) { s += fromDouble(num, 2); return true; }
+
+    template <typename T>
+    String& operator+=(const T& rhs) { concat(rhs); return *this; }
+
+    // Comparación
+    bool equals(const String& other) const { return s == other.s; }
+    bool equals(const char* cstr) const { return s == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String& other) const {
+        if (s.length() != other.s.length()) return false;
+        for (size_t i = 0; i < s.length(); ++i) {
+            if (tolower((unsigned char)s[i]) != tolower((unsigned char)other.s[i])) return false;
+        }
+        return true;
+    }
+    int compareTo(const String& other) const { return s.compare(other.s); }
+    bool operator==(const String& rhs) const { return s == rhs.s; }
+    bool operator==(const char* rhs) const { return equals(rhs); }
+    bool operator!=(const String& rhs) const { return s != rhs.s; }
+    bool operator!=(const char* rhs) const { return !equals(rhs); }
+    bool operator<(const String& rhs) const { return s < rhs.s; }
+    bool operator>(const String& rhs) const { return s > rhs.s; }
+    bool operator<=(const String& rhs) const { return s <= rhs.s; }
+    bool operator>=(const String& rhs) const { return s >= rhs.s; }
+
+    bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+    bool startsWith(const String& prefix, unsigned int offset) const {
+        return offset <= s.length() && s.compare(offset, prefix.s.length(), prefix.s) == 0;
+    }
+    bool endsWith(const String& suffix) const {
+        return s.length() >= suffix.s.length() &&
+               s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+    }
+
+    // Búsqueda
+    int indexOf(char ch, unsigned int from = 0) const { return npos(s.find(ch, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return npos(s.find(str.s, from)); }
+    int lastIndexOf(char ch) const { return npos(s.rfind(ch)); }
+    int lastIndexOf(const String& str) const { return npos(s.rfind(str.s)); }
+
+    String substring(unsigned int from) const { return from >= s.length() ? String() : String(s.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int tmp = from; from = to; to = tmp; }
+        if (from >= s.length()) return String();
+        return String(s.substr(from, to - from));
+    }
+
+    // Modificación
+    void replace(const String& find, const String& repl) {
+        if (find.s.empty()) return;
+        size_t pos = 0;
+        while ((pos = s.find(find.s, pos)) != std::string::npos) {
+            s.replace(pos, find.s.length(), repl.s);
+            pos += repl.s.length();
+        }
+    }
+    void remove(unsigned int index) { if (index < s.length()) s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s.length()) s.erase(index, count); }
+    void toLowerCase() { for (auto& c : s) c = (char)tolower((unsigned char)c); }
+    void toUpperCase() { for (auto& c : s) c = (char)toupper((unsigned char)c); }
+    void trim() {
+        size_t b = s.find_first_not_of(" \t\r\n\f\v");
+        if (b == std::string::npos) { s.clear(); return; }
+        size_t e = s.find_last_not_of(" \t\r\n\f\v");
+        s = s.substr(b, e - b + 1);
+    }
+
+    // Conversión
+    long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(s.c_str(), nullptr); }
+    double toDouble() const { return strtod(s.c_str(), nullptr); }
+
+private:
+    std::string s;
+
+    static int npos(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    static std::string fromUnsigned(unsigned long long value, unsigned char base) {
+        if (base < 2 || base > 36) base = 10;
+        char buf[72];
+        int i = sizeof(buf) - 1;
+        buf[i] = '\0';
+        do {
+            int digit = (int)(value % base);
+            buf[--i] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+            value /= base;
+        } while (value && i > 0);
+        return std::string(&buf[i]);
+    }
+    static std::string fromSigned(long long value, unsigned char base) {
+        if (base == 10 && value < 0) return "-" + fromUnsigned((unsigned long long)(-(value + 1)) + 1, 10);
+        return fromUnsigned((unsigned long long)value, base);
+    }
+    static std::string fromDouble(double value, unsigned char decimals) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+        return std::string(buf);
+    }
+};
+
+inline String operator+(const String& lhs, const String& rhs) { String r(lhs); r.concat(rhs); return r; }
+inline String operator+(const String& lhs, const char* rhs) { String r(lhs); r.concat(rhs); return r; }
+inline String operator+(const char* lhs, const String& rhs) { String r(lhs); r.concat(rhs); return r; }
+inline String operator+(const String& lhs, char rhs) { String r(lhs); r.concat(rhs); return r; }
+inline bool operator==(const char* lhs, const String& rhs) { return rhs.equals(lhs); }
+inline bool operator!=(const char* lhs, const String& rhs) { return !rhs.equals(lhs); }
+
+#endif // NATIVE_WSTRING_H
@@ -0,0 +1,191 @@
+#include "WiFi.h"
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+WiFiClass WiFi;
+
+static void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// =================================
+// WiFiClient
+// =================================
+WiFiClient::SocketHandle::~SocketHandle() {
+    if (fd >= 0) ::close(fd);
+}
+
+WiFiClient::WiFiClient(int fd) {
+    if (fd >= 0) {
+        setNonBlocking(fd);
+        handle = std::make_shared<SocketHandle>(fd);
+    }
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    struct addrinfo hints = {};
+    struct addrinfo* res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    if (getaddrinfo(host, portStr, &hints, &res) != 0 || !res) return 0;
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { freeaddrinfo(res); return 0; }
+    int rc = ::connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0) { ::close(fd); return 0; }
+
+    setNonBlocking(fd);
+    handle = std::make_shared<SocketHandle>(fd);
+    return 1;
+}
+
+int WiFiClient::fd() const {
+    return handle ? handle->fd : -1;
+}
+
+bool WiFiClient::connected() {
+    if (!handle) return false;
+    char c;
+    ssize_t n = ::recv(handle->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) return true;
+    if (n == 0) return false; // el otro extremo cerró
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+void WiFiClient::stop() {
+    handle.reset();
+}
+
+IPAddress WiFiClient::remoteIP() const {
+    if (!handle) return IPAddress();
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (getpeername(handle->fd, (struct sockaddr*)&addr, &len) != 0) return IPAddress();
+    return IPAddress((uint32_t)addr.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const {
+    if (!handle) return 0;
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (getpeername(handle->fd, (struct sockaddr*)&addr, &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+size_t WiFiClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    if (!handle) return 0;
+    size_t sent = 0;
+    unsigned long start = millis();
+    // Igual que arduino-esp32: reintentar hasta el timeout si el buffer TCP está lleno
+    while (sent < size) {
+        ssize_t n = ::send(handle->fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (millis() - start > _timeout) break;
+            delay(1);
+            continue;
+        }
+        break;
+    }
+    return sent;
+}
+
+int WiFiClient::available() {
+    if (!handle) return 0;
+    int count = 0;
+    if (ioctl(handle->fd, FIONREAD, &count) < 0) return 0;
+    return count;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    if (!handle) return -1;
+    ssize_t n = ::recv(handle->fd, buffer, size, MSG_DONTWAIT);
+    if (n < 0) return -1;
+    return (int)n;
+}
+
+int WiFiClient::peek() {
+    if (!handle) return -1;
+    uint8_t c;
+    ssize_t n = ::recv(handle->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 1 ? c : -1;
+}
+
+void WiFiClient::setNoDelay(bool noDelay) {
+    if (!handle) return;
+    int flag = noDelay ? 1 : 0;
+    setsockopt(handle->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+// =================================
+// WiFiServer
+// =================================
+void WiFiServer::begin(uint16_t port) {
+    if (port) _port = port;
+    if (_sockfd >= 0) return;
+
+    _sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (_sockfd < 0) return;
+
+    int reuse = 1;
+    setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(_port);
+    if (::bind(_sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(_sockfd, 16) < 0) {
+        Serial.printf("[WiFiServer] No se pudo escuchar en el puerto %u: %s\n", _port, strerror(errno));
+        ::close(_sockfd);
+        _sockfd = -1;
+        return;
+    }
+    setNonBlocking(_sockfd);
+}
+
+void WiFiServer::end() {
+    if (_sockfd >= 0) {
+        ::close(_sockfd);
+        _sockfd = -1;
+    }
+}
+
+bool WiFiServer::hasClient() {
+    if (_sockfd < 0) return false;
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(_sockfd, &readSet);
+    struct timeval tv = { 0, 0 };
+    return ::select(_sockfd + 1, &readSet, nullptr, nullptr, &tv) > 0;
+}
+
+WiFiClient WiFiServer::available() {
+    if (_sockfd < 0) return WiFiClient();
+    int fd = ::accept(_sockfd, nullptr, nullptr);
+    if (fd < 0) return WiFiClient();
+    return WiFiClient(fd);
+}
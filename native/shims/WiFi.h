@@ -0,0 +1,69 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+// Transporte POSIX para WiFiServer/WiFiClient en el build nativo.
+// Igual que en arduino-esp32, WiFiClient comparte el socket entre copias
+// (shared_ptr) y stop() sólo suelta la referencia propia.
+
+#include "Arduino.h"
+#include <memory>
+
+class WiFiClient : public Stream {
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+
+    int connect(const char* host, uint16_t port);
+    bool connected();
+    void stop();
+    explicit operator bool() { return connected(); }
+    int fd() const;
+    IPAddress remoteIP() const;
+    uint16_t remotePort() const;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    int peek() override;
+    void flush() override {}
+
+    void setNoDelay(bool noDelay);
+
+private:
+    struct SocketHandle {
+        explicit SocketHandle(int fd) : fd(fd) {}
+        ~SocketHandle();
+        int fd;
+    };
+    std::shared_ptr<SocketHandle> handle;
+};
+
+class WiFiServer {
+public:
+    explicit WiFiServer(uint16_t port = 80) : _port(port) {}
+    ~WiFiServer() { end(); }
+
+    void begin(uint16_t port = 0);
+    void end();
+    bool hasClient();
+    WiFiClient available();
+    WiFiClient accept() { return available(); }
+    int fd() const { return _sockfd; }
+    explicit operator bool() const { return _sockfd >= 0; }
+
+private:
+    uint16_t _port;
+    int _sockfd = -1;
+};
+
+class WiFiClass {
+public:
+    String macAddress() { return String("02:00:00:00:00:01"); }
+};
+
+extern WiFiClass WiFi;
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,15 @@
+#ifndef NATIVE_WIFI_MANAGER_H
+#define NATIVE_WIFI_MANAGER_H
+
+// Sustituto del WiFiManager de ../shared_libs para el build nativo:
+// en Linux la red ya existe, sólo se exponen los getters que usan los managers.
+
+#include <Arduino.h>
+
+class WiFiManager {
+public:
+    String getAPIP() { return String("127.0.0.1"); }
+    int getConnectedClients() { return 0; }
+};
+
+#endif // NATIVE_WIFI_MANAGER_H
@@ -6,6 +6,8 @@
 #include "MQTTBrokerManager.h"
 #include "DeviceManager.h"
 #include "EEPROMManager.h"
+#include "Logger.h"
+#include "EventLoop.h"
 
 
 
@@ -16,6 +18,7 @@ WebServerManager* webServerManager;
 MQTTBrokerManager* mqttBrokerManager;
 DeviceManager* deviceManager;
 EEPROMManager* eepromManager;
+EventLoop eventLoop;
 
 void setup() {
   Serial.begin(SERIAL_BAUDRATE);
@@ -54,6 +57,7 @@ void setup() {
   // 4) Devices
   deviceManager = new DeviceManager(wifiManager, mqttBrokerManager, eepromManager);
   deviceManager->initialize();
+  Logger::flush(); // la carga desde EEPROM genera varias líneas de log
   // Conectar los dos mundos
   mqttBrokerManager->setDeviceManager(deviceManager);
   mqttBrokerManager->initialize();
@@ -64,28 +68,21 @@ void setup() {
   webServerManager->setMQTTBrokerManager(mqttBrokerManager);
   webServerManager->initialize();
 
+  // 6) Loop de eventos: cada subsistema registra sus sockets y timers
+  mqttBrokerManager->registerEvents(eventLoop);
+  deviceManager->registerEvents(eventLoop);
+  webServerManager->registerEvents(eventLoop);
+  eventLoop.addSource("log",
+      [](EventLoop& loop) { if (Logger::pending() > 0) loop.wakeNow(); },
+      []() { Logger::drain(); });
+
+  Logger::flush();
   Serial.println("✅ Sistema modular listo");
   Serial.println("==============================================");
 }
 
 void loop() {
-    // Manejar nuevas conexiones MQTT
-    mqttBrokerManager->handleNewConnections();
-    
-    // Procesar mensajes de clientes conectados
-    mqttBrokerManager->processClientMessages();
-    
-    // Enviar heartbeat a clientes para mantener conexión TCP
-    mqttBrokerManager->sendHeartbeatToClients();
-    
-    // Verificar heartbeats de módulos
-    mqttBrokerManager->checkModuleHeartbeats();
-    
-    // Procesar comandos del sistema
-    deviceManager->processSystemCommands();
-    
-    // Manejar peticiones del servidor web
-    webServerManager->handleClient();
-    
-    delay(10);
+    // Espera eventos (sockets listos, plazos de timers, fuentes por intervalo)
+    // y atiende sólo los subsistemas que tienen algo que hacer
+    eventLoop.runOnce();
 }
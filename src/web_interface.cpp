@@ -1315,6 +1315,7 @@ function openModuleMenu(moduleId) {
                       <div style="margin:8px 0"><strong>Funciones disponibles:</strong></div>
                       <div style="display:flex;flex-direction:column;gap:8px">`;
         data.capabilities.forEach(cap => {
+          if (typeof cap.reply === 'boolean') declaredReplies[moduleId + '/' + cap.name] = cap.reply;
           const capTitle = cap.title || cap.name;
           const capDesc = cap.description ? `<div style="font-size:12px;color:#666;margin-top:4px">${cap.description}</div>` : '';
           html += `
@@ -1459,17 +1460,34 @@ function openModuleMenu(moduleId) {
   menu.setAttribute('aria-hidden', 'false');
 }
 
+/* Comandos cuyo módulo contesta con un resultado: sólo para ésos vale esperarlo.
+   Si el módulo declara sus capacidades como objetos con "reply", manda eso */
+const COMMANDS_WITH_REPLY = ['scan', 'enroll', 'list', 'delete',
+                             'scan_fingerprint', 'enroll_user', 'list_all_fingerprints', 'delete_user'];
+const declaredReplies = {};
+
+function commandReplies(moduleId, commandName) {
+  const declared = declaredReplies[moduleId + '/' + commandName];
+  if (declared !== undefined) return declared;
+  return COMMANDS_WITH_REPLY.includes(commandName.split(':')[0]);
+}
+
 /* Nueva función: ejecutar comando en módulo vía servidor */
 function sendModuleCommand(moduleId, commandName, params = {}) {
   showMessage('Enviando comando ' + commandName + ' a ' + moduleId + ' ...', false);
+  const body = { moduleId, action: commandName, params };
+  // wait_ms: el servidor responde con el resultado del módulo (o 504 si no llega).
+  // El resto se contesta enseguida y no ocupa una de las esperas del servidor
+  if (commandReplies(moduleId, commandName)) body.wait_ms = 15000;
   return fetch('/api/modules/action', {
     method: 'POST',
     headers: { 'Content-Type': 'application/json' },
-    body: JSON.stringify({ moduleId, action: commandName, params })
+    body: JSON.stringify(body)
   }).then(r => r.json().catch(()=>({ success:false })))
     .then(res => {
       if (res && res.success) {
-        showMessage('Comando ejecutado correctamente', false);
+        const detail = res.response && res.response.message ? ': ' + res.response.message : '';
+        showMessage('Comando ejecutado correctamente' + detail + (res.rtt_ms !== undefined ? ' (' + res.rtt_ms + ' ms)' : ''), false);
       } else {
         showMessage('Error ejecutando comando: ' + (res.message || 'sin detalle'), true);
       }
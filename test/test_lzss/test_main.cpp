@@ -0,0 +1,140 @@
+// Lzss::expand con streams corruptos, truncados o con largo declarado falso.
+//   pio test -e native -f test_lzss
+
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include "Lzss.h"
+
+void setUp() {}
+void tearDown() {}
+
+static Lzss lzss;
+static const uint8_t GUARD = 0xA5;
+
+// Referencia de 2 bytes: (distancia-1) << 6 | (largo-MIN_MATCH)
+static void putRef(uint8_t* p, size_t distance, size_t length) {
+    uint16_t v = (uint16_t)(((distance - 1) << 6) | (length - Lzss::MIN_MATCH));
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static bool guardIntact(const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] != GUARD) return false;
+    }
+    return true;
+}
+
+void test_roundtrip() {
+    static uint8_t input[2048];
+    for (size_t i = 0; i < sizeof(input); i++) input[i] = "{\"id\":1,\"name\":\"abc\"},"[i % 23];
+    static uint8_t packed[2048];
+    size_t n = lzss.compress(input, sizeof(input), packed, sizeof(packed));
+    TEST_ASSERT_TRUE(n > 0 && n < sizeof(input));
+
+    static uint8_t out[2048];
+    TEST_ASSERT_TRUE(Lzss::expand(packed, n, out, sizeof(input)));
+    TEST_ASSERT_EQUAL_MEMORY(input, out, sizeof(input));
+}
+
+void test_valid_reference() {
+    // "ab" literal + referencia distancia 2 largo 4 -> "ababab"
+    uint8_t stream[] = {0x03, 'a', 'b', 0, 0};
+    putRef(&stream[3], 2, 4);
+    uint8_t out[6];
+    TEST_ASSERT_TRUE(Lzss::expand(stream, sizeof(stream), out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY("ababab", out, 6);
+}
+
+void test_truncated_stream() {
+    static uint8_t input[512];
+    for (size_t i = 0; i < sizeof(input); i++) input[i] = (uint8_t)(i % 7);
+    static uint8_t packed[512];
+    size_t n = lzss.compress(input, sizeof(input), packed, sizeof(packed));
+    TEST_ASSERT_TRUE(n > 0);
+
+    static uint8_t out[sizeof(input)];
+    for (size_t cut = 0; cut < n; cut++) {
+        TEST_ASSERT_FALSE(Lzss::expand(packed, cut, out, sizeof(input)));
+    }
+}
+
+void test_half_reference() {
+    // Referencia cortada después del primer byte
+    const uint8_t stream[] = {0x01, 'a', 0x00};
+    uint8_t out[4];
+    TEST_ASSERT_FALSE(Lzss::expand(stream, sizeof(stream), out, sizeof(out)));
+}
+
+void test_distance_beyond_output() {
+    // Un literal y una referencia que apunta 2 bytes atrás
+    uint8_t stream[] = {0x01, 'a', 0, 0};
+    putRef(&stream[2], 2, 3);
+    uint8_t out[4];
+    TEST_ASSERT_FALSE(Lzss::expand(stream, sizeof(stream), out, sizeof(out)));
+
+    // Referencia como primer elemento
+    uint8_t first[] = {0x00, 0, 0};
+    putRef(&first[1], 1, 3);
+    TEST_ASSERT_FALSE(Lzss::expand(first, sizeof(first), out, 3));
+}
+
+void test_over_declared_length() {
+    // El stream produce 3 bytes pero la trama declara más
+    const uint8_t stream[] = {0x07, 'a', 'b', 'c'};
+    uint8_t out[16];
+    memset(out, GUARD, sizeof(out));
+    TEST_ASSERT_FALSE(Lzss::expand(stream, sizeof(stream), out, 10));
+}
+
+void test_under_declared_length() {
+    // Literales que sobran después de completar el largo declarado
+    const uint8_t stream[] = {0x07, 'a', 'b', 'c'};
+    uint8_t out[8];
+    memset(out, GUARD, sizeof(out));
+    TEST_ASSERT_FALSE(Lzss::expand(stream, sizeof(stream), out, 2));
+    TEST_ASSERT_TRUE(guardIntact(&out[2], sizeof(out) - 2));
+
+    // Referencia que pasaría del largo declarado
+    uint8_t ref[] = {0x01, 'a', 0, 0};
+    putRef(&ref[2], 1, 10);
+    memset(out, GUARD, sizeof(out));
+    TEST_ASSERT_FALSE(Lzss::expand(ref, sizeof(ref), out, 4));
+    TEST_ASSERT_TRUE(guardIntact(&out[4], sizeof(out) - 4));
+}
+
+void test_empty_input() {
+    uint8_t out[4];
+    TEST_ASSERT_FALSE(Lzss::expand(nullptr, 0, out, 4));
+    TEST_ASSERT_EQUAL(0, lzss.compress(nullptr, 0, out, sizeof(out)));
+}
+
+void test_random_garbage_stays_in_bounds() {
+    // Streams al azar: no importa el resultado, sólo que no escriba de más
+    static uint8_t stream[256];
+    static uint8_t out[512 + 64];
+    srand(1234);
+    for (int round = 0; round < 2000; round++) {
+        size_t length = 1 + rand() % sizeof(stream);
+        for (size_t i = 0; i < length; i++) stream[i] = (uint8_t)rand();
+        size_t expected = 1 + rand() % 512;
+        memset(out, GUARD, sizeof(out));
+        Lzss::expand(stream, length, out, expected);
+        TEST_ASSERT_TRUE(guardIntact(&out[expected], sizeof(out) - expected));
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_roundtrip);
+    RUN_TEST(test_valid_reference);
+    RUN_TEST(test_truncated_stream);
+    RUN_TEST(test_half_reference);
+    RUN_TEST(test_distance_beyond_output);
+    RUN_TEST(test_over_declared_length);
+    RUN_TEST(test_under_declared_length);
+    RUN_TEST(test_empty_input);
+    RUN_TEST(test_random_garbage_stays_in_bounds);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+// Parser MQTT 3.1.1 y validación de topics con entrada mal formada.
+//   pio test -e native -f test_mqtt_codec
+
+#include <Arduino.h>
+#include <unity.h>
+#include "MqttCodec.h"
+#include "TopicTrie.h"
+
+void setUp() {}
+void tearDown() {}
+
+static MqttPacket packet(MqttPacketType type, uint8_t flags, const uint8_t* body, size_t length) {
+    MqttPacket p;
+    p.type = type;
+    p.flags = flags;
+    p.body = body;
+    p.length = (uint32_t)length;
+    return p;
+}
+
+static MqttLengthDecoder::Status decode(const uint8_t* bytes, size_t n, MqttLengthDecoder& decoder) {
+    decoder.reset();
+    MqttLengthDecoder::Status status = MqttLengthDecoder::NEED_MORE;
+    for (size_t i = 0; i < n && status == MqttLengthDecoder::NEED_MORE; i++) status = decoder.feed(bytes[i]);
+    return status;
+}
+
+// ---- Remaining length ----
+
+void test_remaining_length_boundaries() {
+    const uint32_t values[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+    const size_t sizes[] = {1, 1, 2, 2, 3, 3, 4, 4};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint8_t encoded[4];
+        size_t n = mqttEncodeRemainingLength(values[i], encoded);
+        TEST_ASSERT_EQUAL(sizes[i], n);
+        MqttLengthDecoder decoder;
+        TEST_ASSERT_EQUAL(MqttLengthDecoder::DONE, decode(encoded, n, decoder));
+        TEST_ASSERT_EQUAL_UINT32(values[i], decoder.length());
+        TEST_ASSERT_EQUAL(n, decoder.bytesUsed());
+    }
+}
+
+void test_remaining_length_fifth_byte_is_malformed() {
+    const uint8_t bytes[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x7F};
+    MqttLengthDecoder decoder;
+    TEST_ASSERT_EQUAL(MqttLengthDecoder::MALFORMED, decode(bytes, sizeof(bytes), decoder));
+    TEST_ASSERT_EQUAL(4, decoder.bytesUsed());
+}
+
+void test_remaining_length_partial_then_sticky() {
+    MqttLengthDecoder decoder;
+    TEST_ASSERT_EQUAL(MqttLengthDecoder::NEED_MORE, decoder.feed(0x80));
+    TEST_ASSERT_EQUAL(MqttLengthDecoder::DONE, decoder.feed(0x01));
+    TEST_ASSERT_EQUAL_UINT32(128, decoder.length());
+    // Después de DONE no consume más bytes
+    TEST_ASSERT_EQUAL(MqttLengthDecoder::DONE, decoder.feed(0x05));
+    TEST_ASSERT_EQUAL(2, decoder.bytesUsed());
+}
+
+// ---- CONNECT ----
+
+static const uint8_t CONNECT_OK[] = {
+    0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x3C, 0x00, 0x02, 'i', 'd'
+};
+
+void test_connect_valid() {
+    MqttConnect c;
+    TEST_ASSERT_TRUE(mqttParseConnect(packet(MqttPacketType::Connect, 0, CONNECT_OK, sizeof(CONNECT_OK)), c));
+    TEST_ASSERT_TRUE(c.protocolName.equals("MQTT"));
+    TEST_ASSERT_EQUAL(60, c.keepAlive);
+    TEST_ASSERT_TRUE(c.clientId.equals("id"));
+}
+
+void test_connect_truncated_at_every_length() {
+    for (size_t n = 0; n < sizeof(CONNECT_OK); n++) {
+        MqttConnect c;
+        TEST_ASSERT_FALSE(mqttParseConnect(packet(MqttPacketType::Connect, 0, CONNECT_OK, n), c));
+    }
+}
+
+void test_connect_rejects_flags_and_reserved_bit() {
+    MqttConnect c;
+    TEST_ASSERT_FALSE(mqttParseConnect(packet(MqttPacketType::Connect, 0x01, CONNECT_OK, sizeof(CONNECT_OK)), c));
+    uint8_t reserved[sizeof(CONNECT_OK)];
+    memcpy(reserved, CONNECT_OK, sizeof(CONNECT_OK));
+    reserved[7] |= 0x01;
+    TEST_ASSERT_FALSE(mqttParseConnect(packet(MqttPacketType::Connect, 0, reserved, sizeof(reserved)), c));
+}
+
+void test_connect_declared_fields_must_be_present() {
+    // Will, usuario y contraseña declarados en los flags pero ausentes
+    const uint8_t flags[] = {0x04, 0x80, 0x40};
+    for (uint8_t flag : flags) {
+        uint8_t body[sizeof(CONNECT_OK)];
+        memcpy(body, CONNECT_OK, sizeof(CONNECT_OK));
+        body[7] |= flag;
+        MqttConnect c;
+        TEST_ASSERT_FALSE(mqttParseConnect(packet(MqttPacketType::Connect, 0, body, sizeof(body)), c));
+    }
+}
+
+void test_connect_string_length_past_end() {
+    const uint8_t body[] = {0xFF, 0xFF, 'M', 'Q', 'T', 'T'};
+    MqttConnect c;
+    TEST_ASSERT_FALSE(mqttParseConnect(packet(MqttPacketType::Connect, 0, body, sizeof(body)), c));
+}
+
+// ---- PUBLISH ----
+
+void test_publish_qos0_and_qos1() {
+    const uint8_t body[] = {0x00, 0x03, 'a', '/', 'b', 0x12, 0x34, 'x'};
+    MqttPublish p;
+    TEST_ASSERT_TRUE(mqttParsePublish(packet(MqttPacketType::Publish, 0x01, body, sizeof(body)), p));
+    TEST_ASSERT_TRUE(p.retain);
+    TEST_ASSERT_EQUAL(3, p.payloadLength);
+    TEST_ASSERT_TRUE(mqttParsePublish(packet(MqttPacketType::Publish, 0x02, body, sizeof(body)), p));
+    TEST_ASSERT_EQUAL(0x1234, p.packetId);
+    TEST_ASSERT_EQUAL(1, p.payloadLength);
+}
+
+void test_publish_malformed() {
+    const uint8_t body[] = {0x00, 0x03, 'a', '/', 'b'};
+    MqttPublish p;
+    // QoS 3 no existe
+    TEST_ASSERT_FALSE(mqttParsePublish(packet(MqttPacketType::Publish, 0x06, body, sizeof(body)), p));
+    // QoS 1 sin packet id
+    TEST_ASSERT_FALSE(mqttParsePublish(packet(MqttPacketType::Publish, 0x02, body, sizeof(body)), p));
+    // Topic más largo que el paquete
+    TEST_ASSERT_FALSE(mqttParsePublish(packet(MqttPacketType::Publish, 0, body, 4), p));
+    TEST_ASSERT_FALSE(mqttParsePublish(packet(MqttPacketType::Publish, 0, body, 1), p));
+    // Tipo equivocado
+    TEST_ASSERT_FALSE(mqttParsePublish(packet(MqttPacketType::Connect, 0, body, sizeof(body)), p));
+}
+
+// ---- SUBSCRIBE / UNSUBSCRIBE ----
+
+void test_subscribe_valid() {
+    const uint8_t body[] = {0x00, 0x0A, 0x00, 0x03, 'a', '/', '#', 0x01, 0x00, 0x01, '+', 0x00};
+    uint16_t id = 0;
+    std::vector<MqttTopicFilter> filters;
+    TEST_ASSERT_TRUE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x02, body, sizeof(body)), id, filters));
+    TEST_ASSERT_EQUAL(10, id);
+    TEST_ASSERT_EQUAL(2, filters.size());
+    TEST_ASSERT_TRUE(filters[0].filter.equals("a/#"));
+    TEST_ASSERT_EQUAL(1, filters[0].qos);
+}
+
+void test_subscribe_malformed() {
+    const uint8_t body[] = {0x00, 0x0A, 0x00, 0x01, 'a', 0x01};
+    uint16_t id;
+    std::vector<MqttTopicFilter> filters;
+    // Flags distintos de 0x02
+    TEST_ASSERT_FALSE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x00, body, sizeof(body)), id, filters));
+    // Falta el QoS del último filtro
+    filters.clear();
+    TEST_ASSERT_FALSE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x02, body, sizeof(body) - 1), id, filters));
+    // QoS > 2
+    const uint8_t badQos[] = {0x00, 0x0A, 0x00, 0x01, 'a', 0x03};
+    filters.clear();
+    TEST_ASSERT_FALSE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x02, badQos, sizeof(badQos)), id, filters));
+    // Sin filtros
+    filters.clear();
+    TEST_ASSERT_FALSE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x02, body, 2), id, filters));
+    // Sin packet id
+    filters.clear();
+    TEST_ASSERT_FALSE(mqttParseSubscribe(packet(MqttPacketType::Subscribe, 0x02, body, 1), id, filters));
+}
+
+void test_unsubscribe_malformed() {
+    const uint8_t body[] = {0x00, 0x07, 0x00, 0x05, 'a'};
+    uint16_t id;
+    std::vector<MqttTopicFilter> filters;
+    TEST_ASSERT_FALSE(mqttParseUnsubscribe(packet(MqttPacketType::Unsubscribe, 0x02, body, sizeof(body)), id, filters));
+}
+
+// ---- Topics y filtros ----
+
+void test_filter_wildcards() {
+    TEST_ASSERT_TRUE(TopicTrie::isValidFilter("a/+/c"));
+    TEST_ASSERT_TRUE(TopicTrie::isValidFilter("a/#"));
+    TEST_ASSERT_TRUE(TopicTrie::isValidFilter("#"));
+    TEST_ASSERT_TRUE(TopicTrie::isValidFilter("+"));
+    TEST_ASSERT_FALSE(TopicTrie::isValidFilter(""));
+    TEST_ASSERT_FALSE(TopicTrie::isValidFilter("a/#/c"));
+    TEST_ASSERT_FALSE(TopicTrie::isValidFilter("a/b#"));
+    TEST_ASSERT_FALSE(TopicTrie::isValidFilter("a+/b"));
+}
+
+void test_publish_topic_rejects_wildcards() {
+    TEST_ASSERT_TRUE(TopicTrie::isValidTopic("devices/x/events"));
+    TEST_ASSERT_FALSE(TopicTrie::isValidTopic(""));
+    TEST_ASSERT_FALSE(TopicTrie::isValidTopic("devices/+/events"));
+    TEST_ASSERT_FALSE(TopicTrie::isValidTopic("devices/#"));
+}
+
+void test_filter_matching() {
+    TEST_ASSERT_TRUE(TopicTrie::matches("a/+/c", "a/b/c"));
+    TEST_ASSERT_FALSE(TopicTrie::matches("a/+/c", "a/b/c/d"));
+    TEST_ASSERT_TRUE(TopicTrie::matches("a/#", "a"));
+    TEST_ASSERT_TRUE(TopicTrie::matches("a/#", "a/b/c"));
+    TEST_ASSERT_FALSE(TopicTrie::matches("a/b", "a/b/c"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_remaining_length_boundaries);
+    RUN_TEST(test_remaining_length_fifth_byte_is_malformed);
+    RUN_TEST(test_remaining_length_partial_then_sticky);
+    RUN_TEST(test_connect_valid);
+    RUN_TEST(test_connect_truncated_at_every_length);
+    RUN_TEST(test_connect_rejects_flags_and_reserved_bit);
+    RUN_TEST(test_connect_declared_fields_must_be_present);
+    RUN_TEST(test_connect_string_length_past_end);
+    RUN_TEST(test_publish_qos0_and_qos1);
+    RUN_TEST(test_publish_malformed);
+    RUN_TEST(test_subscribe_valid);
+    RUN_TEST(test_subscribe_malformed);
+    RUN_TEST(test_unsubscribe_malformed);
+    RUN_TEST(test_filter_wildcards);
+    RUN_TEST(test_publish_topic_rejects_wildcards);
+    RUN_TEST(test_filter_matching);
+    return UNITY_END();
+}
@@ -0,0 +1,226 @@
+// Detección de tramas en ClientRxBuffer: líneas JSON, tramas con largo
+// (MessagePack / LZSS) y paquetes MQTT, con largos falsos o mal formados.
+//   pio test -e native -f test_rx_framing
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "config.h"
+#include "ClientRxBuffer.h"
+
+static const uint8_t BOTH = ClientRxBuffer::FORMAT_PACKED | ClientRxBuffer::FORMAT_COMPRESSED;
+
+// Un extremo lo lee el buffer (vía WiFiClient), el otro lo escribe el test
+static int sv[2];
+static WiFiClient* client;
+static ClientRxBuffer* rx;
+static uint8_t scratch[MQTT_MAX_FRAME_SIZE];
+
+void setUp() {
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    client = new WiFiClient(sv[0]);
+    rx = new ClientRxBuffer();
+}
+
+void tearDown() {
+    delete rx;
+    delete client;   // cierra sv[0]
+    close(sv[1]);
+}
+
+static void feed(const void* data, size_t length) {
+    TEST_ASSERT_EQUAL((int)length, (int)write(sv[1], data, length));
+    rx->fill(*client);
+}
+
+static void feed(const char* text) {
+    feed(text, strlen(text));
+}
+
+// Cuerpo de relleno para tramas de largo arbitrario
+static void feedFiller(size_t length) {
+    uint8_t chunk[256];
+    memset(chunk, 'x', sizeof(chunk));
+    while (length > 0) {
+        size_t n = length < sizeof(chunk) ? length : sizeof(chunk);
+        feed(chunk, n);
+        length -= n;
+    }
+}
+
+// ---- Tramas con largo ----
+
+void test_packed_frame_split_across_reads() {
+    const uint8_t frame[] = {0x00, 0x03, 0x81, 0xA1, 0x74};
+    String out;
+    uint8_t format;
+    feed(frame, 1);
+    TEST_ASSERT_FALSE(rx->nextFrame(out, BOTH, format));
+    feed(frame + 1, 2);
+    TEST_ASSERT_FALSE(rx->nextFrame(out, BOTH, format));
+    feed(frame + 3, 2);
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(ClientRxBuffer::FORMAT_PACKED, format);
+    TEST_ASSERT_EQUAL(3, out.length());
+    TEST_ASSERT_EQUAL_MEMORY(frame + 2, out.c_str(), 3);
+}
+
+void test_compressed_lead_byte() {
+    const uint8_t frame[] = {0x80, 0x02, 0x01, 'a'};
+    String out;
+    uint8_t format;
+    feed(frame, sizeof(frame));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(ClientRxBuffer::FORMAT_COMPRESSED, format);
+    TEST_ASSERT_EQUAL(2, out.length());
+}
+
+void test_compressed_lead_not_negotiated_is_a_line() {
+    // Sin LZSS negociado 0x80 no inicia una trama: llega hasta el '\n'
+    const uint8_t frame[] = {0x80, 'a', 'b', '\n'};
+    String out;
+    uint8_t format;
+    feed(frame, sizeof(frame));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, ClientRxBuffer::FORMAT_PACKED, format));
+    TEST_ASSERT_EQUAL(0, format);
+    TEST_ASSERT_EQUAL(3, out.length());
+}
+
+void test_json_line_between_frames() {
+    const uint8_t packed[] = {0x00, 0x01, 0xC0};
+    String out;
+    uint8_t format;
+    feed("{\"type\":\"ping\"}\r\n");
+    feed(packed, sizeof(packed));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(0, format);
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"ping\"}", out.c_str());
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(ClientRxBuffer::FORMAT_PACKED, format);
+}
+
+void test_lead_above_max_is_a_line() {
+    // 0x05 << 8 ya supera MQTT_MAX_FRAME_SIZE: no puede ser un largo válido
+    const uint8_t bytes[] = {0x05, 'z', '\n'};
+    String out;
+    uint8_t format;
+    feed(bytes, sizeof(bytes));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(0, format);
+}
+
+void test_oversized_declared_length_is_skipped() {
+    // Largo 0x4FF > MQTT_MAX_FRAME_SIZE: se descarta entero, aun llegando en partes
+    const size_t length = 0x4FF;
+    const uint8_t header[] = {0x04, 0xFF};
+    const uint8_t next[] = {0x00, 0x01, 0xC3};
+    String out;
+    uint8_t format;
+    feed(header, sizeof(header));
+    feedFiller(600);
+    TEST_ASSERT_FALSE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(1, rx->oversizedFrames());
+    feedFiller(length - 600);
+    feed(next, sizeof(next));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(ClientRxBuffer::FORMAT_PACKED, format);
+    TEST_ASSERT_EQUAL(1, out.length());
+    TEST_ASSERT_EQUAL_UINT8(0xC3, (uint8_t)out[0]);
+    TEST_ASSERT_EQUAL(1, rx->oversizedFrames());
+}
+
+void test_max_length_frame_is_accepted() {
+    const uint8_t header[] = {(uint8_t)(MQTT_MAX_FRAME_SIZE >> 8), (uint8_t)(MQTT_MAX_FRAME_SIZE & 0xFF)};
+    String out;
+    uint8_t format;
+    feed(header, sizeof(header));
+    feedFiller(MQTT_MAX_FRAME_SIZE);
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(MQTT_MAX_FRAME_SIZE, out.length());
+    TEST_ASSERT_EQUAL(0, rx->oversizedFrames());
+}
+
+void test_empty_frame_is_skipped() {
+    const uint8_t frames[] = {0x00, 0x00, 0x80, 0x00, 0x00, 0x01, 0xC2};
+    String out;
+    uint8_t format;
+    feed(frames, sizeof(frames));
+    TEST_ASSERT_TRUE(rx->nextFrame(out, BOTH, format));
+    TEST_ASSERT_EQUAL(ClientRxBuffer::FORMAT_PACKED, format);
+    TEST_ASSERT_EQUAL(1, out.length());
+    TEST_ASSERT_FALSE(rx->nextFrame(out, BOTH, format));
+}
+
+void test_overlong_line_is_discarded() {
+    String out;
+    feedFiller(MQTT_MAX_FRAME_SIZE + 100);
+    TEST_ASSERT_FALSE(rx->nextLine(out));
+    TEST_ASSERT_EQUAL(1, rx->oversizedFrames());
+    feed("rest\n{\"ok\":1}\n");
+    TEST_ASSERT_TRUE(rx->nextLine(out));
+    TEST_ASSERT_EQUAL_STRING("{\"ok\":1}", out.c_str());
+    TEST_ASSERT_EQUAL(1, rx->oversizedFrames());
+}
+
+// ---- Paquetes MQTT ----
+
+void test_mqtt_packet_split_header() {
+    // PINGREQ y un PUBLISH con el remaining length partido en dos lecturas
+    const uint8_t bytes[] = {0xC0, 0x00, 0x30, 0x80};
+    MqttPacket p;
+    feed(bytes, sizeof(bytes));
+    TEST_ASSERT_TRUE(rx->nextPacket(p, scratch));
+    TEST_ASSERT_EQUAL((int)MqttPacketType::Pingreq, (int)p.type);
+    TEST_ASSERT_FALSE(rx->nextPacket(p, scratch));
+    const uint8_t rest[] = {0x01};
+    feed(rest, sizeof(rest));
+    feedFiller(128);
+    TEST_ASSERT_TRUE(rx->nextPacket(p, scratch));
+    TEST_ASSERT_EQUAL((int)MqttPacketType::Publish, (int)p.type);
+    TEST_ASSERT_EQUAL_UINT32(128, p.length);
+}
+
+void test_mqtt_malformed_remaining_length() {
+    const uint8_t bytes[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00};
+    MqttPacket p;
+    feed(bytes, sizeof(bytes));
+    TEST_ASSERT_FALSE(rx->nextPacket(p, scratch));
+    TEST_ASSERT_TRUE(rx->malformed());
+    // El stream ya no se puede resincronizar
+    const uint8_t ping[] = {0xC0, 0x00};
+    feed(ping, sizeof(ping));
+    TEST_ASSERT_FALSE(rx->nextPacket(p, scratch));
+}
+
+void test_mqtt_oversized_packet_is_skipped() {
+    uint8_t header[5] = {0x30};
+    size_t n = 1 + mqttEncodeRemainingLength(MQTT_MAX_FRAME_SIZE + 1, &header[1]);
+    const uint8_t ping[] = {0xC0, 0x00};
+    MqttPacket p;
+    feed(header, n);
+    feedFiller(MQTT_MAX_FRAME_SIZE + 1);
+    feed(ping, sizeof(ping));
+    TEST_ASSERT_TRUE(rx->nextPacket(p, scratch));
+    TEST_ASSERT_EQUAL((int)MqttPacketType::Pingreq, (int)p.type);
+    TEST_ASSERT_EQUAL(1, rx->oversizedFrames());
+    TEST_ASSERT_FALSE(rx->malformed());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_packed_frame_split_across_reads);
+    RUN_TEST(test_compressed_lead_byte);
+    RUN_TEST(test_compressed_lead_not_negotiated_is_a_line);
+    RUN_TEST(test_json_line_between_frames);
+    RUN_TEST(test_lead_above_max_is_a_line);
+    RUN_TEST(test_oversized_declared_length_is_skipped);
+    RUN_TEST(test_max_length_frame_is_accepted);
+    RUN_TEST(test_empty_frame_is_skipped);
+    RUN_TEST(test_overlong_line_is_discarded);
+    RUN_TEST(test_mqtt_packet_split_header);
+    RUN_TEST(test_mqtt_malformed_remaining_length);
+    RUN_TEST(test_mqtt_oversized_packet_is_skipped);
+    return UNITY_END();
+}